@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "include/DSP.h"
+
+// Minimal segment length for which a sliding sum beats summing each segment
+#define DSP_SLIDING_SUM_MIN 64
+
+// Zoom: CIC decimator order, fractional bits of its fixed-point input and length of the FIR
+#define DSP_ZOOM_CIC_ORDER 4
+#define DSP_ZOOM_FRAC_BITS 8
+#define DSP_ZOOM_FIR_TAPS 63
+// Pseudo windowing function of cached zoom FIR tables, their N holds the decimation (log2)
+#define DSP_ZOOM_FILTER -1
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DSP_NEON
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#define DSP_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define DSP_SSE2
+#include <emmintrin.h>
+#endif
+
+typedef struct DSP_Window {
+  int               window_fun_id;
+  unsigned int      N;
+  float             *coeffs;
+  struct DSP_Window *next;
+} DSP_Window;
+
+static DSP_Window *windows = NULL;
+static pthread_mutex_t windows_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * DSP_window_coeff - coefficient n of an N-point windowing function
+ */
+static double DSP_window_coeff(int window_fun_id, unsigned int n, unsigned int N) {
+  const double a0 = 0.35875, a1 = 0.48829, a2 = 0.14128, a3 = 0.01168;
+  double x = (N > 1) ? 2*M_PI*n / (N-1) : 0, y;
+  
+  switch(window_fun_id) {
+    // Hanning Window
+    case HANNING_WINDOW:
+      return 0.5 * (1 - cos(x));
+    // 4-Term Blackman-Harris Window
+    case BLACKMAN_HARRIS_WINDOW:
+      return a0 - a1*cos(x) + a2*cos(2*x) - a3*cos(3*x);
+    // Polyphase filter bank prototype, sinc over DSP_PFB_TAPS bins with Blackman-Harris window
+    case PFB_WINDOW:
+      y = DSP_PFB_TAPS*((double) n - 0.5*(N-1)) / N;
+      return (y != 0 ? sin(M_PI*y) / (M_PI*y) : 1.0) * (a0 - a1*cos(x) + a2*cos(2*x) - a3*cos(3*x));
+    // Rectangular Window
+    default:
+      return 1.0;
+  }
+}
+
+unsigned int DSP_window_taps(int window_fun_id) {
+  return (window_fun_id == PFB_WINDOW) ? DSP_PFB_TAPS : 1;
+}
+
+const float* DSP_window_table(int window_fun_id, unsigned int N) {
+  unsigned int n, len = DSP_window_taps(window_fun_id)*N;
+  DSP_Window *w;
+  
+  pthread_mutex_lock(&windows_mut);
+  
+  // Look up cached table
+  for(w = windows; w != NULL; w = w->next)
+    if(w->window_fun_id == window_fun_id && w->N == N) break;
+  
+  // Compute table once
+  if(w == NULL) {
+    w = (DSP_Window *) malloc(sizeof(DSP_Window));
+    w->window_fun_id = window_fun_id;
+    w->N = N;
+    w->coeffs = (float *) malloc(2*len*sizeof(float));
+    for(n=0; n<len; ++n) {
+      w->coeffs[2*n] = (float) DSP_window_coeff(window_fun_id, n, len);
+      w->coeffs[2*n+1] = w->coeffs[2*n];
+    }
+    w->next = windows;
+    windows = w;
+  }
+  
+  pthread_mutex_unlock(&windows_mut);
+  
+  return w->coeffs;
+}
+
+/*
+ * DSP_sum_iq - sum of I and Q values of n complex samples
+ */
+static void DSP_sum_iq(const uint8_t *restrict iq, unsigned int n, uint32_t *i_sum, uint32_t *q_sum) {
+  unsigned int l = 0;
+  uint32_t i_acc = 0, q_acc = 0;
+  
+#if defined(DSP_NEON)
+  uint32x4_t i_vacc = vdupq_n_u32(0), q_vacc = vdupq_n_u32(0);
+  uint8x16x2_t v;
+  for(; l+32<=2*n; l=l+32) {
+    // Deinterleave 16 complex samples
+    v = vld2q_u8(iq+l);
+    i_vacc = vpadalq_u16(i_vacc, vpaddlq_u8(v.val[0]));
+    q_vacc = vpadalq_u16(q_vacc, vpaddlq_u8(v.val[1]));
+  }
+  i_acc = vgetq_lane_u32(i_vacc, 0) + vgetq_lane_u32(i_vacc, 1)
+	+ vgetq_lane_u32(i_vacc, 2) + vgetq_lane_u32(i_vacc, 3);
+  q_acc = vgetq_lane_u32(q_vacc, 0) + vgetq_lane_u32(q_vacc, 1)
+	+ vgetq_lane_u32(q_vacc, 2) + vgetq_lane_u32(q_vacc, 3);
+#elif defined(DSP_AVX2) || defined(DSP_SSE2)
+  // Sum of absolute differences against zero adds up the even (I) and odd (Q) bytes separately
+  const __m128i even = _mm_set1_epi16(0x00ff), zero = _mm_setzero_si128();
+  __m128i v, i_vacc = _mm_setzero_si128(), q_vacc = _mm_setzero_si128();
+  for(; l+16<=2*n; l=l+16) {
+    v = _mm_loadu_si128((const __m128i *) (iq+l));
+    i_vacc = _mm_add_epi64(i_vacc, _mm_sad_epu8(_mm_and_si128(v, even), zero));
+    q_vacc = _mm_add_epi64(q_vacc, _mm_sad_epu8(_mm_srli_epi16(v, 8), zero));
+  }
+  i_acc = _mm_cvtsi128_si32(i_vacc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(i_vacc, i_vacc));
+  q_acc = _mm_cvtsi128_si32(q_vacc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(q_vacc, q_vacc));
+#endif
+  
+  for(; l<2*n; l=l+2) {
+    i_acc += iq[l];
+    q_acc += iq[l+1];
+  }
+  
+  *i_sum = i_acc;
+  *q_sum = q_acc;
+}
+
+void DSP_segment_means(float *means, const uint8_t *iq, unsigned int N, unsigned int step,
+		       unsigned int cnt) {
+  unsigned int j;
+  uint32_t i_sum = 0, q_sum = 0, i_out, q_out, i_in, q_in;
+  
+  for(j=0; j<cnt; ++j) {
+    // Slide the previous sum by 'step' samples as long as segments overlap
+    if(j > 0 && step < N && N >= DSP_SLIDING_SUM_MIN) {
+      DSP_sum_iq(iq+2*(j-1)*step, step, &i_out, &q_out);
+      DSP_sum_iq(iq+2*((j-1)*step+N), step, &i_in, &q_in);
+      i_sum = i_sum - i_out + i_in;
+      q_sum = q_sum - q_out + q_in;
+    } else {
+      DSP_sum_iq(iq+2*j*step, N, &i_sum, &q_sum);
+    }
+    means[2*j] = (float) i_sum / N;
+    means[2*j+1] = (float) q_sum / N;
+  }
+}
+
+void DSP_window_segment(float *restrict out, const uint8_t *restrict iq,
+			const float *restrict window, unsigned int N, unsigned int taps,
+			const float *mean) {
+  unsigned int l = 0, p, t;
+  float i_acc, q_acc;
+  
+#if defined(DSP_NEON)
+  const float32x4_t bias = {mean[0], mean[1], mean[0], mean[1]};
+  float32x4_t acc0, acc1, acc2, acc3;
+  uint8x16_t v;
+  uint16x8_t lo, hi;
+  for(; l+16<=2*N; l=l+16) {
+    acc0 = acc1 = acc2 = acc3 = vdupq_n_f32(0.f);
+    // Sum up the taps of the polyphase branches
+    for(p=0, t=l; p<taps; ++p, t=t+2*N) {
+      v = vld1q_u8(iq+t);
+      lo = vmovl_u8(vget_low_u8(v));
+      hi = vmovl_u8(vget_high_u8(v));
+      acc0 = vmlaq_f32(acc0, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), bias),
+		       vld1q_f32(window+t));
+      acc1 = vmlaq_f32(acc1, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), bias),
+		       vld1q_f32(window+t+4));
+      acc2 = vmlaq_f32(acc2, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), bias),
+		       vld1q_f32(window+t+8));
+      acc3 = vmlaq_f32(acc3, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), bias),
+		       vld1q_f32(window+t+12));
+    }
+    vst1q_f32(out+l, acc0);
+    vst1q_f32(out+l+4, acc1);
+    vst1q_f32(out+l+8, acc2);
+    vst1q_f32(out+l+12, acc3);
+  }
+#elif defined(DSP_AVX2)
+  const __m256 bias = _mm256_setr_ps(mean[0], mean[1], mean[0], mean[1],
+				     mean[0], mean[1], mean[0], mean[1]);
+  __m256 acc0, acc1;
+  __m128i v;
+  for(; l+16<=2*N; l=l+16) {
+    acc0 = acc1 = _mm256_setzero_ps();
+    // Sum up the taps of the polyphase branches
+    for(p=0, t=l; p<taps; ++p, t=t+2*N) {
+      v = _mm_loadu_si128((const __m128i *) (iq+t));
+      acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_sub_ps(
+	_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), bias), _mm256_loadu_ps(window+t)));
+      acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_sub_ps(
+	_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))), bias),
+	_mm256_loadu_ps(window+t+8)));
+    }
+    _mm256_storeu_ps(out+l, acc0);
+    _mm256_storeu_ps(out+l+8, acc1);
+  }
+#elif defined(DSP_SSE2)
+  const __m128 bias = _mm_setr_ps(mean[0], mean[1], mean[0], mean[1]);
+  const __m128i zero = _mm_setzero_si128();
+  __m128 acc0, acc1, acc2, acc3;
+  __m128i v, lo, hi;
+  for(; l+16<=2*N; l=l+16) {
+    acc0 = acc1 = acc2 = acc3 = _mm_setzero_ps();
+    // Sum up the taps of the polyphase branches
+    for(p=0, t=l; p<taps; ++p, t=t+2*N) {
+      v = _mm_loadu_si128((const __m128i *) (iq+t));
+      lo = _mm_unpacklo_epi8(v, zero);
+      hi = _mm_unpackhi_epi8(v, zero);
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_sub_ps(
+	_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), bias), _mm_loadu_ps(window+t)));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_sub_ps(
+	_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), bias), _mm_loadu_ps(window+t+4)));
+      acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_sub_ps(
+	_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), bias), _mm_loadu_ps(window+t+8)));
+      acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_sub_ps(
+	_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), bias), _mm_loadu_ps(window+t+12)));
+    }
+    _mm_storeu_ps(out+l, acc0);
+    _mm_storeu_ps(out+l+4, acc1);
+    _mm_storeu_ps(out+l+8, acc2);
+    _mm_storeu_ps(out+l+12, acc3);
+  }
+#endif
+  
+  // Scalar fallback and remainder
+  for(; l<2*N; l=l+2) {
+    i_acc = 0;
+    q_acc = 0;
+    for(p=0, t=l; p<taps; ++p, t=t+2*N) {
+      i_acc += ((float) iq[t] - mean[0]) * window[t];
+      q_acc += ((float) iq[t+1] - mean[1]) * window[t+1];
+    }
+    out[l] = i_acc;
+    out[l+1] = q_acc;
+  }
+}
+
+/*
+ * Binary logarithm, as used by DSP_power_db and DSP_db
+ * 
+ * x is split into 2^e * m with m in [sqrt(1/2), sqrt(2)), and log2(m) is evaluated with the series
+ * 2/ln(2) * (s + s^3/3 + s^5/5 + ...) for s = (m-1)/(m+1). Since |s| <= 0.1716, truncating after
+ * s^5 gives an absolute error below 1.9e-6. Zero and denormal inputs yield about -127.
+ */
+#define DSP_LOG2_C1 2.88539008f	// 2/ln(2)
+#define DSP_LOG2_C3 0.96179669f	// 2/(3*ln(2))
+#define DSP_LOG2_C5 0.57707802f	// 2/(5*ln(2))
+#define DSP_SQRT1_2_BITS 0x3f3504f3	// Bit pattern of sqrt(1/2)
+#define DSP_DB_PER_LOG2 3.01029996f	// 10*log10(2)
+
+static inline float DSP_log2(float x) {
+  union { float f; int32_t i; } u = { x };
+  float s, s2;
+  int32_t e;
+  
+  e = (u.i - DSP_SQRT1_2_BITS) >> 23;
+  u.i = u.i - (e << 23);
+  s = (u.f - 1) / (u.f + 1);
+  s2 = s*s;
+  return (float) e + s*(DSP_LOG2_C1 + s2*(DSP_LOG2_C3 + s2*DSP_LOG2_C5));
+}
+
+#if defined(DSP_NEON)
+// Magnitudes squared of 4 interleaved complex values
+static inline float32x4_t DSP_power_neon(const float *X) {
+  float32x4x2_t v = vld2q_f32(X);
+  return vmlaq_f32(vmulq_f32(v.val[0], v.val[0]), v.val[1], v.val[1]);
+}
+
+static inline float32x4_t DSP_log2_neon(float32x4_t x) {
+  const float32x4_t one = vdupq_n_f32(1.f);
+  float32x4_t m, d, s, s2, r;
+  int32x4_t i, e;
+  
+  i = vreinterpretq_s32_f32(x);
+  e = vshrq_n_s32(vsubq_s32(i, vdupq_n_s32(DSP_SQRT1_2_BITS)), 23);
+  m = vreinterpretq_f32_s32(vsubq_s32(i, vshlq_n_s32(e, 23)));
+  d = vaddq_f32(m, one);
+#if defined(__aarch64__)
+  s = vdivq_f32(vsubq_f32(m, one), d);
+#else
+  // Reciprocal estimate refined by two Newton-Raphson steps
+  r = vrecpeq_f32(d);
+  r = vmulq_f32(vrecpsq_f32(d, r), r);
+  r = vmulq_f32(vrecpsq_f32(d, r), r);
+  s = vmulq_f32(vsubq_f32(m, one), r);
+#endif
+  s2 = vmulq_f32(s, s);
+  r = vmlaq_f32(vdupq_n_f32(DSP_LOG2_C3), s2, vdupq_n_f32(DSP_LOG2_C5));
+  r = vmlaq_f32(vdupq_n_f32(DSP_LOG2_C1), s2, r);
+  return vmlaq_f32(vcvtq_f32_s32(e), s, r);
+}
+#elif defined(DSP_AVX2)
+// Magnitudes squared of 8 interleaved complex values
+static inline __m256 DSP_power_avx2(const float *X) {
+  __m256 a = _mm256_loadu_ps(X), b = _mm256_loadu_ps(X+8), p;
+  // Pairwise sums are in order p0 p1 p4 p5 | p2 p3 p6 p7
+  p = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+  return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), _MM_SHUFFLE(3,1,2,0)));
+}
+
+static inline __m256 DSP_log2_avx2(__m256 x) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  __m256 m, s, s2, r;
+  __m256i i, e;
+  
+  i = _mm256_castps_si256(x);
+  e = _mm256_srai_epi32(_mm256_sub_epi32(i, _mm256_set1_epi32(DSP_SQRT1_2_BITS)), 23);
+  m = _mm256_castsi256_ps(_mm256_sub_epi32(i, _mm256_slli_epi32(e, 23)));
+  s = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+  s2 = _mm256_mul_ps(s, s);
+  r = _mm256_add_ps(_mm256_set1_ps(DSP_LOG2_C3), _mm256_mul_ps(s2, _mm256_set1_ps(DSP_LOG2_C5)));
+  r = _mm256_add_ps(_mm256_set1_ps(DSP_LOG2_C1), _mm256_mul_ps(s2, r));
+  return _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_mul_ps(s, r));
+}
+#elif defined(DSP_SSE2)
+// Magnitudes squared of 4 interleaved complex values
+static inline __m128 DSP_power_sse2(const float *X) {
+  __m128 a = _mm_loadu_ps(X), b = _mm_loadu_ps(X+4);
+  a = _mm_mul_ps(a, a);
+  b = _mm_mul_ps(b, b);
+  return _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+}
+
+static inline __m128 DSP_log2_sse2(__m128 x) {
+  const __m128 one = _mm_set1_ps(1.f);
+  __m128 m, s, s2, r;
+  __m128i i, e;
+  
+  i = _mm_castps_si128(x);
+  e = _mm_srai_epi32(_mm_sub_epi32(i, _mm_set1_epi32(DSP_SQRT1_2_BITS)), 23);
+  m = _mm_castsi128_ps(_mm_sub_epi32(i, _mm_slli_epi32(e, 23)));
+  s = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+  s2 = _mm_mul_ps(s, s);
+  r = _mm_add_ps(_mm_set1_ps(DSP_LOG2_C3), _mm_mul_ps(s2, _mm_set1_ps(DSP_LOG2_C5)));
+  r = _mm_add_ps(_mm_set1_ps(DSP_LOG2_C1), _mm_mul_ps(s2, r));
+  return _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(s, r));
+}
+#endif
+
+/*
+ * DSP_power_db_block - dB values of n consecutive complex bins
+ */
+static void DSP_power_db_block(float *restrict out, const float *restrict X, unsigned int n,
+			       float offset) {
+  unsigned int j = 0;
+  
+#if defined(DSP_NEON)
+  const float32x4_t db = vdupq_n_f32(DSP_DB_PER_LOG2), off = vdupq_n_f32(offset);
+  const float32x4_t lim = vdupq_n_f32(-100.f);
+  for(; j+4<=n; j=j+4)
+    vst1q_f32(out+j, vmaxq_f32(vmlaq_f32(off, DSP_log2_neon(DSP_power_neon(X+2*j)), db), lim));
+#elif defined(DSP_AVX2)
+  const __m256 db = _mm256_set1_ps(DSP_DB_PER_LOG2), off = _mm256_set1_ps(offset);
+  const __m256 lim = _mm256_set1_ps(-100.f);
+  for(; j+8<=n; j=j+8)
+    _mm256_storeu_ps(out+j, _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(
+      DSP_log2_avx2(DSP_power_avx2(X+2*j)), db), off), lim));
+#elif defined(DSP_SSE2)
+  const __m128 db = _mm_set1_ps(DSP_DB_PER_LOG2), off = _mm_set1_ps(offset);
+  const __m128 lim = _mm_set1_ps(-100.f);
+  for(; j+4<=n; j=j+4)
+    _mm_storeu_ps(out+j, _mm_max_ps(_mm_add_ps(_mm_mul_ps(
+      DSP_log2_sse2(DSP_power_sse2(X+2*j)), db), off), lim));
+#endif
+  
+  // Scalar fallback and remainder
+  for(; j<n; ++j) {
+    out[j] = DSP_DB_PER_LOG2*DSP_log2(X[2*j]*X[2*j] + X[2*j+1]*X[2*j+1]) + offset;
+    if(out[j] < -100.f) out[j] = -100.f;
+  }
+}
+
+void DSP_power_db(float *restrict out, const float *restrict X, unsigned int N) {
+  // Scaling by 1/N^2 is an offset on the dB scale
+  const float offset = -20.f*log10f((float) N);
+  
+  // Shift zero frequency to the center, i.e. swap the halves of the spectrum
+  DSP_power_db_block(out, X+N, N/2, offset);
+  DSP_power_db_block(out+N/2, X, N-N/2, offset);
+}
+
+/*
+ * DSP_power_accumulate_block - add magnitudes squared of n consecutive complex bins
+ */
+static void DSP_power_accumulate_block(float *restrict acc, const float *restrict X,
+				       unsigned int n) {
+  unsigned int j = 0;
+  
+#if defined(DSP_NEON)
+  for(; j+4<=n; j=j+4) vst1q_f32(acc+j, vaddq_f32(vld1q_f32(acc+j), DSP_power_neon(X+2*j)));
+#elif defined(DSP_AVX2)
+  for(; j+8<=n; j=j+8)
+    _mm256_storeu_ps(acc+j, _mm256_add_ps(_mm256_loadu_ps(acc+j), DSP_power_avx2(X+2*j)));
+#elif defined(DSP_SSE2)
+  for(; j+4<=n; j=j+4) _mm_storeu_ps(acc+j, _mm_add_ps(_mm_loadu_ps(acc+j), DSP_power_sse2(X+2*j)));
+#endif
+  
+  // Scalar fallback and remainder
+  for(; j<n; ++j) acc[j] += X[2*j]*X[2*j] + X[2*j+1]*X[2*j+1];
+}
+
+void DSP_power_accumulate(float *restrict acc, const float *restrict X, unsigned int N) {
+  // Shift zero frequency to the center, i.e. swap the halves of the spectrum
+  DSP_power_accumulate_block(acc, X+N, N/2);
+  DSP_power_accumulate_block(acc+N/2, X, N-N/2);
+}
+
+void DSP_db(float *out, const float *P, unsigned int N, float scale) {
+  unsigned int j = 0;
+  const float offset = 10.f*log10f(scale);
+  
+#if defined(DSP_NEON)
+  const float32x4_t db = vdupq_n_f32(DSP_DB_PER_LOG2), off = vdupq_n_f32(offset);
+  const float32x4_t lim = vdupq_n_f32(-100.f);
+  for(; j+4<=N; j=j+4)
+    vst1q_f32(out+j, vmaxq_f32(vmlaq_f32(off, DSP_log2_neon(vld1q_f32(P+j)), db), lim));
+#elif defined(DSP_AVX2)
+  const __m256 db = _mm256_set1_ps(DSP_DB_PER_LOG2), off = _mm256_set1_ps(offset);
+  const __m256 lim = _mm256_set1_ps(-100.f);
+  for(; j+8<=N; j=j+8)
+    _mm256_storeu_ps(out+j, _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(
+      DSP_log2_avx2(_mm256_loadu_ps(P+j)), db), off), lim));
+#elif defined(DSP_SSE2)
+  const __m128 db = _mm_set1_ps(DSP_DB_PER_LOG2), off = _mm_set1_ps(offset);
+  const __m128 lim = _mm_set1_ps(-100.f);
+  for(; j+4<=N; j=j+4)
+    _mm_storeu_ps(out+j, _mm_max_ps(_mm_add_ps(_mm_mul_ps(
+      DSP_log2_sse2(_mm_loadu_ps(P+j)), db), off), lim));
+#endif
+  
+  // Scalar fallback and remainder
+  for(; j<N; ++j) {
+    out[j] = DSP_DB_PER_LOG2*DSP_log2(P[j]) + offset;
+    if(out[j] < -100.f) out[j] = -100.f;
+  }
+}
+
+/*
+ * DSP_zoom_coeff - tap t of the FIR filter following the CIC decimator, i.e. a lowpass with
+ * passband DSP_ZOOM_PASSBAND (cycles per CIC output sample) that compensates the CIC droop
+ */
+static double DSP_zoom_coeff(unsigned int t, unsigned int R) {
+  const double a0 = 0.35875, a1 = 0.48829, a2 = 0.14128, a3 = 0.01168;
+  const double fp = DSP_ZOOM_PASSBAND, fs = 0.5 - DSP_ZOOM_PASSBAND;
+  const int G = 1024;
+  int k, i;
+  double f, d, droop, h = 0;
+  double c = 0.5*(DSP_ZOOM_FIR_TAPS-1), x = 2*M_PI*t / (DSP_ZOOM_FIR_TAPS-1);
+  
+  // Frequency sampling of the desired response
+  for(k=-G/2; k<G/2; ++k) {
+    f = (double) k / G;
+    if(fabs(f) <= fp) d = 1;
+    else if(fabs(f) < fs) d = 0.5 * (1 + cos(M_PI*(fabs(f)-fp) / (fs-fp)));
+    else continue;
+    // Inverse CIC magnitude response
+    droop = 1;
+    if(k != 0 && R > 1)
+      for(i=0; i<DSP_ZOOM_CIC_ORDER; ++i) droop *= sin(M_PI*f) / (R*sin(M_PI*f/R));
+    h += d / droop * cos(2*M_PI*f*(t-c));
+  }
+  
+  // Blackman-Harris window
+  return h / G * (a0 - a1*cos(x) + a2*cos(2*x) - a3*cos(3*x));
+}
+
+/*
+ * DSP_zoom_table - cached FIR filter taps for decimation 2^log2_decim, normalized to unit DC gain
+ */
+static const float* DSP_zoom_table(unsigned int log2_decim) {
+  unsigned int t;
+  double sum = 0;
+  DSP_Window *w;
+  
+  pthread_mutex_lock(&windows_mut);
+  
+  // Look up cached table
+  for(w = windows; w != NULL; w = w->next)
+    if(w->window_fun_id == DSP_ZOOM_FILTER && w->N == log2_decim) break;
+  
+  // Compute table once
+  if(w == NULL) {
+    w = (DSP_Window *) malloc(sizeof(DSP_Window));
+    w->window_fun_id = DSP_ZOOM_FILTER;
+    w->N = log2_decim;
+    w->coeffs = (float *) malloc(DSP_ZOOM_FIR_TAPS*sizeof(float));
+    for(t=0; t<DSP_ZOOM_FIR_TAPS; ++t) sum += DSP_zoom_coeff(t, 1u<<(log2_decim-1));
+    for(t=0; t<DSP_ZOOM_FIR_TAPS; ++t)
+      w->coeffs[t] = (float) (DSP_zoom_coeff(t, 1u<<(log2_decim-1)) / sum);
+    w->next = windows;
+    windows = w;
+  }
+  
+  pthread_mutex_unlock(&windows_mut);
+  
+  return w->coeffs;
+}
+
+unsigned int DSP_zoom_length(unsigned int n, unsigned int log2_decim) {
+  unsigned int J = n >> (log2_decim-1);
+  
+  // CIC outputs after the comb warm-up, FIR outputs from full filter spans only
+  if(J < DSP_ZOOM_CIC_ORDER + DSP_ZOOM_FIR_TAPS) return 0;
+  return (J - DSP_ZOOM_CIC_ORDER - DSP_ZOOM_FIR_TAPS) / 2 + 1;
+}
+
+unsigned int DSP_zoom_input(unsigned int M, unsigned int log2_decim) {
+  return (DSP_ZOOM_CIC_ORDER + DSP_ZOOM_FIR_TAPS + 2*(M-1)) << (log2_decim-1);
+}
+
+unsigned int DSP_zoom_scratch(unsigned int n, unsigned int log2_decim) {
+  // Interleaved CIC decimator outputs
+  return 2*(n >> (log2_decim-1));
+}
+
+unsigned int DSP_zoom(float *out, float *scratch, const uint8_t *iq, unsigned int n,
+		      const float *mean, double shift, unsigned int log2_decim) {
+  unsigned int l, j, t, k, J, M;
+  const unsigned int R = 1u<<(log2_decim-1);
+  const float *h = DSP_zoom_table(log2_decim);
+  const double scale = 1.0 / ((double) (1u<<DSP_ZOOM_FRAC_BITS) * pow(R, DSP_ZOOM_CIC_ORDER));
+  double ph_re = 1, ph_im = 0, rot_re = cos(-2*M_PI*shift), rot_im = sin(-2*M_PI*shift), tmp, a;
+  float x_re, x_im, acc_re, acc_im, *y = scratch;
+  // CIC state in two's complement, wrap-arounds cancel out in the combs
+  uint64_t integ_re[DSP_ZOOM_CIC_ORDER] = {0}, integ_im[DSP_ZOOM_CIC_ORDER] = {0};
+  uint64_t delay_re[DSP_ZOOM_CIC_ORDER] = {0}, delay_im[DSP_ZOOM_CIC_ORDER] = {0};
+  uint64_t c_re, c_im, d;
+  
+  M = DSP_zoom_length(n, log2_decim);
+  if(M == 0) return 0;
+  J = n / R;
+  
+  for(l=0, j=0; j<J; ++l) {
+    // Mix down, the oscillator is renormalized regularly to bound its rounding error
+    x_re = (float) iq[2*l] - mean[0];
+    x_im = (float) iq[2*l+1] - mean[1];
+    c_re = (uint64_t) (int64_t) lrint((x_re*ph_re - x_im*ph_im) * (1u<<DSP_ZOOM_FRAC_BITS));
+    c_im = (uint64_t) (int64_t) lrint((x_re*ph_im + x_im*ph_re) * (1u<<DSP_ZOOM_FRAC_BITS));
+    tmp = ph_re*rot_re - ph_im*rot_im;
+    ph_im = ph_re*rot_im + ph_im*rot_re;
+    ph_re = tmp;
+    if((l & 1023) == 1023) {
+      a = 1.0 / sqrt(ph_re*ph_re + ph_im*ph_im);
+      ph_re *= a;
+      ph_im *= a;
+    }
+    
+    // Integrators
+    for(k=0; k<DSP_ZOOM_CIC_ORDER; ++k) {
+      integ_re[k] += c_re;
+      integ_im[k] += c_im;
+      c_re = integ_re[k];
+      c_im = integ_im[k];
+    }
+    
+    // Combs at the decimated rate
+    if((l+1) % R == 0) {
+      for(k=0; k<DSP_ZOOM_CIC_ORDER; ++k) {
+	d = c_re - delay_re[k]; delay_re[k] = c_re; c_re = d;
+	d = c_im - delay_im[k]; delay_im[k] = c_im; c_im = d;
+      }
+      y[2*j] = (float) ((int64_t) c_re * scale);
+      y[2*j+1] = (float) ((int64_t) c_im * scale);
+      ++j;
+    }
+  }
+  
+  // Compensating lowpass FIR, decimating by two
+  for(j=0; j<M; ++j) {
+    acc_re = 0;
+    acc_im = 0;
+    for(t=0; t<DSP_ZOOM_FIR_TAPS; ++t) {
+      acc_re += h[t] * y[2*(DSP_ZOOM_CIC_ORDER+2*j+t)];
+      acc_im += h[t] * y[2*(DSP_ZOOM_CIC_ORDER+2*j+t)+1];
+    }
+    out[2*j] = acc_re;
+    out[2*j+1] = acc_im;
+  }
+  
+  return M;
+}
+
+void DSP_window_samples(float *restrict out, const float *restrict x, const float *restrict window,
+			unsigned int N, unsigned int taps) {
+  unsigned int l, p, t;
+  
+  // Plain loop, vectorized by the compiler
+  for(l=0; l<2*N; ++l) out[l] = x[l] * window[l];
+  for(p=1, t=2*N; p<taps; ++p, t=t+2*N)
+    for(l=0; l<2*N; ++l) out[l] += x[t+l] * window[t+l];
+}
+
+void DSP_release_windows() {
+  DSP_Window *w;
+  
+  pthread_mutex_lock(&windows_mut);
+  while(windows != NULL) {
+    w = windows;
+    windows = w->next;
+    free(w->coeffs);
+    free(w);
+  }
+  pthread_mutex_unlock(&windows_mut);
+}
@@ -20,69 +20,244 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
 
-#if defined(RPI_GPU)
 #include "include/FFT.h"
+#include "include/DSP.h"
+#if defined(RPI_GPU)
 #include "include/mailbox.h"
 #include "include/gpu_fft.h"
+#elif defined(FFTW3)
+#include <string.h>
+#include <fftw3.h>
+#elif defined(BUILTIN_FFT)
+#include <string.h>
+#include "include/R4F.h"
 #else
 #include <fftw.h>
 #endif
 
-#define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
-
-static int _LOG2_N = 0, _N = 0;
-static int _BATCHSIZE;
+// Maximal number of prepared FFT plans kept at the same time
+#define FFT_PLAN_CACHE_SIZE 4
 
+/*
+ * Prepared FFT resources for a given FFT size and batch size
+ */
+typedef struct {
+  int           log2_N;
+  int           N;
+  int           batchsize;
+  unsigned long last_used;
 #if defined(RPI_GPU)
-static int _IOCTL_MB;
-static struct GPU_FFT *gpu_fft = NULL;
+  struct GPU_FFT *gpu_fft;
+#elif defined(FFTW3)
+  fftwf_complex *in, *out;
+  fftwf_plan    plan;
+#elif defined(BUILTIN_FFT)
+  R4F_Plan      *plan;
 #else
-static fftw_complex *fftw_in = NULL, *fftw_out = NULL;
-static fftw_plan plan = NULL;
+  fftw_complex  *in, *out;
+  float         *X;		// Single-precision copy of the output
+  fftw_plan     plan;
 #endif
+} FFT_Plan;
 
-void FFT_initialize(int log2_N, int batchsize) {
-  // Set FFT length
-  _LOG2_N = log2_N;
-  _N = 1<<log2_N;
-  // Set batch size
-  _BATCHSIZE = batchsize;
+/*
+ * FFT context with its own plan cache, least recently used plans are evicted first
+ */
+struct FFT_Context {
+  FFT_Plan      plans[FFT_PLAN_CACHE_SIZE];
+  int           plan_cnt;
+  unsigned long use_cnt;
+  FFT_Plan      *cur;
+#if defined(RPI_GPU)
+  int           mb;		// ioctl mailbox
+#endif
+};
+
+// The planners are not thread-safe, plans are created and destroyed one at a time. The GPU
+// backend also executes under this lock, all contexts share the V3D and its QPU enable state.
+static pthread_mutex_t planner_mut = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined(FFTW3)
+static char *wisdom_file = NULL;
+static unsigned int planner_flags = FFTW_ESTIMATE;
+#endif
+
+/*
+ * FFT_plan_create - allocate resources and plan FFT, returns 0 on success or -1 when out of memory
+ */
+static int FFT_plan_create(FFT_Context *ctx, FFT_Plan *p, int log2_N, int batchsize) {
+  p->log2_N = log2_N;
+  p->N = 1<<log2_N;
+  p->batchsize = batchsize;
 #if defined(RPI_GPU)
   int r;
-  // Open ioctl mailbox through which ARM CPU and Videocore GPU communicate
-  _IOCTL_MB = mbox_open();
   // Allocate memory and initialize data structures for forward FFT
-  r = gpu_fft_prepare(_IOCTL_MB, _LOG2_N, GPU_FFT_FWD, _BATCHSIZE, &gpu_fft);
+  pthread_mutex_lock(&planner_mut);
+  r = gpu_fft_prepare(ctx->mb, p->log2_N, GPU_FFT_FWD, p->batchsize, &p->gpu_fft);
+  pthread_mutex_unlock(&planner_mut);
   switch(r) {
       case -1: 
 	fprintf(stderr, "Unable to enable V3D. Please check your firmware is up to date.\n");
 	exit(1);
       case -2:
-	fprintf(stderr, "log2_N=%d not supported. Try between 8 and 17.\n", _LOG2_N);
+	fprintf(stderr, "log2_N=%d not supported. Try between 8 and 17.\n", p->log2_N);
 	exit(1);
       case -3:
-	fprintf(stderr, "Out of memory. Try a smaller batch or increase GPU memory.\n");
-	exit(1);
+	return -1;
+  }
+#elif defined(FFTW3)
+  // Aligned buffers holding the whole batch, allocated and freed under the planner lock
+  pthread_mutex_lock(&planner_mut);
+  p->in = (fftwf_complex *) fftwf_malloc(p->N*p->batchsize*sizeof(fftwf_complex));
+  p->out = (fftwf_complex *) fftwf_malloc(p->N*p->batchsize*sizeof(fftwf_complex));
+  if(p->in == NULL || p->out == NULL) {
+    fftwf_free(p->in);
+    fftwf_free(p->out);
+    pthread_mutex_unlock(&planner_mut);
+    return -1;
+  }
+  // Reuse plan from wisdom, otherwise plan and extend wisdom
+  p->plan = NULL;
+  if(wisdom_file != NULL)
+    p->plan = fftwf_plan_many_dft(1, &p->N, p->batchsize, p->in, NULL, 1, p->N, p->out, NULL, 1,
+				  p->N, FFTW_FORWARD, planner_flags | FFTW_WISDOM_ONLY);
+  if(p->plan == NULL) {
+    p->plan = fftwf_plan_many_dft(1, &p->N, p->batchsize, p->in, NULL, 1, p->N, p->out, NULL, 1,
+				  p->N, FFTW_FORWARD, planner_flags);
+    if(wisdom_file != NULL && !fftwf_export_wisdom_to_filename(wisdom_file))
+      fprintf(stderr, "WARNING: Failed to save FFT wisdom to %s.\n", wisdom_file);
+  }
+  pthread_mutex_unlock(&planner_mut);
+#elif defined(BUILTIN_FFT)
+  // Plans share no state, no need to serialize planning
+  p->plan = R4F_initialize(p->log2_N, p->batchsize);
+  if(p->plan == NULL) {
+    if(p->log2_N < R4F_MIN_LOG2_N || p->log2_N > R4F_MAX_LOG2_N) {
+      fprintf(stderr, "log2_N=%d not supported. Try between %d and %d.\n", p->log2_N,
+	      R4F_MIN_LOG2_N, R4F_MAX_LOG2_N);
+      exit(1);
+    }
+    return -1;
   }
 #else
-  fftw_in = (fftw_complex *) malloc(_N*sizeof(fftw_complex));
-  fftw_out = (fftw_complex *) malloc(_N*sizeof(fftw_complex));
-  plan = fftw_create_plan(_N, FFTW_FORWARD, FFTW_ESTIMATE);
+  p->in = (fftw_complex *) malloc(p->N*sizeof(fftw_complex));
+  p->out = (fftw_complex *) malloc(p->N*sizeof(fftw_complex));
+  p->X = (float *) malloc(2*p->N*sizeof(float));
+  if(p->in == NULL || p->out == NULL || p->X == NULL) {
+    free(p->in);
+    free(p->out);
+    free(p->X);
+    return -1;
+  }
+  pthread_mutex_lock(&planner_mut);
+  p->plan = fftw_create_plan(p->N, FFTW_FORWARD, FFTW_ESTIMATE);
+  pthread_mutex_unlock(&planner_mut);
+#endif
+  return 0;
+}
+
+/*
+ * FFT_plan_destroy - release resources of a plan
+ */
+static void FFT_plan_destroy(FFT_Context *ctx, FFT_Plan *p) {
+  pthread_mutex_lock(&planner_mut);
+#if defined(RPI_GPU)
+  gpu_fft_release(p->gpu_fft);
+#elif defined(FFTW3)
+  fftwf_destroy_plan(p->plan);
+  fftwf_free(p->in);
+  fftwf_free(p->out);
+#elif defined(BUILTIN_FFT)
+  R4F_release(p->plan);
+#else
+  fftw_destroy_plan(p->plan);
+  free(p->in);
+  free(p->out);
+  free(p->X);
+#endif
+  pthread_mutex_unlock(&planner_mut);
+  if(ctx->cur == p) ctx->cur = NULL;
+}
+
+/*
+ * FFT_plan_evict - release the least recently used plan, returns its slot
+ */
+static FFT_Plan* FFT_plan_evict(FFT_Context *ctx) {
+  int i;
+  FFT_Plan *lru = &ctx->plans[0];
+  
+  for(i=1; i<ctx->plan_cnt; ++i)
+    if(ctx->plans[i].last_used < lru->last_used) lru = &ctx->plans[i];
+  FFT_plan_destroy(ctx, lru);
+  
+  // Keep cached plans contiguous
+  *lru = ctx->plans[--ctx->plan_cnt];
+  if(ctx->cur == &ctx->plans[ctx->plan_cnt]) ctx->cur = lru;
+  
+  return &ctx->plans[ctx->plan_cnt];
+}
+
+FFT_Context* FFT_initialize() {
+  FFT_Context *ctx = (FFT_Context *) malloc(sizeof(FFT_Context));
+  
+  ctx->plan_cnt = 0;
+  ctx->use_cnt = 0;
+  ctx->cur = NULL;
+#if defined(RPI_GPU)
+  // Open ioctl mailbox through which ARM CPU and Videocore GPU communicate
+  ctx->mb = mbox_open();
 #endif
+  
+  return ctx;
 }
 
-void FFT_forward(float **in, float **out) {
-  int i, j;
-  float re, im;
+void FFT_prepare(FFT_Context *ctx, int log2_N, int batchsize) {
+  int i;
+  FFT_Plan *p;
+  
+  // Reuse cached plan
+  for(i=0; i<ctx->plan_cnt; ++i) {
+    if(ctx->plans[i].log2_N == log2_N && ctx->plans[i].batchsize == batchsize) {
+      ctx->cur = &ctx->plans[i];
+      ctx->cur->last_used = ++ctx->use_cnt;
+      return;
+    }
+  }
+  
+  // Create new plan, evict least recently used plans when out of memory
+  p = (ctx->plan_cnt < FFT_PLAN_CACHE_SIZE) ? &ctx->plans[ctx->plan_cnt] : FFT_plan_evict(ctx);
+  while(FFT_plan_create(ctx, p, log2_N, batchsize) < 0) {
+    if(ctx->plan_cnt == 0) {
+      fprintf(stderr, "Out of memory. Try a smaller batch or increase GPU memory.\n");
+      exit(1);
+    }
+    p = FFT_plan_evict(ctx);
+  }
+  ++ctx->plan_cnt;
+  ctx->cur = p;
+  ctx->cur->last_used = ++ctx->use_cnt;
+}
+
+/*
+ * FFT_execute - forward FFT of n jobs, the shifted outputs are either converted to dB or their
+ * magnitudes squared are accumulated
+ */
+static void FFT_execute(FFT_Context *ctx, float **in, float **out, int n, int accumulate) {
+  int i;
+  
+  FFT_Plan *cur = ctx->cur;
+  const int N = cur->N;
   
 #if defined(RPI_GPU)
+  int j;
   struct GPU_FFT_COMPLEX *base;
   
   // Prepare FFT input
-  for(i=0; i<_BATCHSIZE; ++i) {
-    base = gpu_fft->in + i*gpu_fft->step;
-    for(j=0; j<_N; ++j) {
+  for(i=0; i<n; ++i) {
+    base = cur->gpu_fft->in + i*cur->gpu_fft->step;
+    for(j=0; j<N; ++j) {
 //       base[j].re = in[i][2*j]; // / 255.f;
 //       base[j].im = in[i][2*j+1]; // / 255.f;
       base[j].re = in[i][2*j] / 128.0f;
@@ -90,55 +265,75 @@ void FFT_forward(float **in, float **out) {
     }
   }
   
-  // Perform forward FFT
-  gpu_fft_execute(gpu_fft);
-  
-  // Scale, shift and convert to magnitude squared (dB)
-  for(i=0; i<_BATCHSIZE; ++i) {
-    base = gpu_fft->out + i*gpu_fft->step;
-    for(j=0; j<_N; ++j) {
-      // Scale and shift
-      if(j < _N/2) {
-	re = base[_N/2+j].re / _N;
-	im = base[_N/2+j].im / _N;
-      } else {
-	re = base[j-_N/2].re / _N;
-	im = base[j-_N/2].im / _N;
-      }
-//       // Magnitude squared (dB)
-//       out[i][j] = 10.f * log10(re*re + im*im);
-      // TODO: Magnitude [dB] and lower limit enforcement
-      out[i][j] = MAX(10.0f * log10(re*re + im*im), -100);
-    }
+  // Perform forward FFT, unused jobs of a partial batch are computed but ignored. Executions
+  // poll the shared V3D registers and a concurrent release disables the QPUs, serialize them.
+  pthread_mutex_lock(&planner_mut);
+  gpu_fft_execute(cur->gpu_fft);
+  pthread_mutex_unlock(&planner_mut);
+  
+  // Shift, scale and convert to magnitude squared (dB), or accumulate magnitude squared
+  for(i=0; i<n; ++i) {
+    if(accumulate)
+      DSP_power_accumulate(out[i], (const float *) (cur->gpu_fft->out + i*cur->gpu_fft->step), N);
+    else
+      DSP_power_db(out[i], (const float *) (cur->gpu_fft->out + i*cur->gpu_fft->step), N);
+  }
+  
+#elif defined(FFTW3)
+  
+  // Prepare FFT input
+  for(i=0; i<n; ++i) memcpy(cur->in + i*N, in[i], N*sizeof(fftwf_complex));
+  
+  // Perform batched forward FFT, unused jobs of a partial batch are computed but ignored
+  fftwf_execute(cur->plan);
+  
+  // Shift, scale and convert to magnitude squared (dB), or accumulate magnitude squared
+  for(i=0; i<n; ++i) {
+    if(accumulate)
+      DSP_power_accumulate(out[i], (const float *) (cur->out + i*N), N);
+    else
+      DSP_power_db(out[i], (const float *) (cur->out + i*N), N);
+  }
+  
+#elif defined(BUILTIN_FFT)
+  
+  // Prepare FFT input
+  for(i=0; i<n; ++i) memcpy(cur->plan->in + 2*i*N, in[i], 2*N*sizeof(float));
+  
+  // Perform forward FFT on the used jobs only
+  R4F_forward(cur->plan, n);
+  
+  // Shift, scale and convert to magnitude squared (dB), or accumulate magnitude squared
+  for(i=0; i<n; ++i) {
+    if(accumulate)
+      DSP_power_accumulate(out[i], cur->plan->out + 2*i*N, N);
+    else
+      DSP_power_db(out[i], cur->plan->out + 2*i*N, N);
   }
   
 #else
+  int j;
   
-  for(i=0; i<_BATCHSIZE; ++i) {
+  for(i=0; i<n; ++i) {
     
     // Prepare FFT input
-    for(j=0; j<_N; ++j) {
-      fftw_in[j].re = in[i][2*j];
-      fftw_in[j].im = in[i][2*j+1];
+    for(j=0; j<N; ++j) {
+      cur->in[j].re = in[i][2*j];
+      cur->in[j].im = in[i][2*j+1];
     }
     
     // Perform forward FFT
-    fftw_one(plan, fftw_in, fftw_out);
+    fftw_one(cur->plan, cur->in, cur->out);
     
-    // Scale, shift and convert to magnitude squared (dB)
-    for(j=0; j<_N; ++j) {
-      // Scale and shift
-      if(j < _N/2) {
-	re = fftw_out[_N/2+j].re / _N;
-	im = fftw_out[_N/2+j].im / _N;
-      } else {
-	re = fftw_out[j-_N/2].re / _N;
-	im = fftw_out[j-_N/2].im / _N;
-      }
-//       out[i][j] = 10.0f * log10(re*re + im*im);
-      // TODO: Magnitude [dB] and lower limit enforcement
-      out[i][j] = MAX(10.0f * log10(re*re + im*im), -100);
+    // Shift, scale and convert to magnitude squared (dB), or accumulate magnitude squared
+    for(j=0; j<N; ++j) {
+      cur->X[2*j] = cur->out[j].re;
+      cur->X[2*j+1] = cur->out[j].im;
     }
+    if(accumulate)
+      DSP_power_accumulate(out[i], cur->X, N);
+    else
+      DSP_power_db(out[i], cur->X, N);
     
   }
   
@@ -146,14 +341,47 @@ void FFT_forward(float **in, float **out) {
   
 }
 
-void FFT_release() {
+void FFT_forward_n(FFT_Context *ctx, float **in, float **out, int n) {
+  FFT_execute(ctx, in, out, n, 0);
+}
+
+void FFT_forward(FFT_Context *ctx, float **in, float **out) {
+  FFT_execute(ctx, in, out, ctx->cur->batchsize, 0);
+}
+
+void FFT_accumulate_n(FFT_Context *ctx, float **in, float **acc, int n) {
+  FFT_execute(ctx, in, acc, n, 1);
+}
+
+void FFT_release(FFT_Context *ctx) {
+  // Release all cached plans
+  while(ctx->plan_cnt > 0) FFT_plan_destroy(ctx, &ctx->plans[--ctx->plan_cnt]);
+#if defined(RPI_GPU)
+  mbox_close(ctx->mb);
+#endif
+  free(ctx);
+}
+
+const char* FFT_backend() {
 #if defined(RPI_GPU)
-  if(gpu_fft == NULL) return;
-  gpu_fft_release(gpu_fft);
-  mbox_close(_IOCTL_MB);
+  return "gpu_fft";
+#elif defined(FFTW3)
+  return "fftw3";
+#elif defined(BUILTIN_FFT)
+  return "builtin";
+#else
+  return "fftw";
+#endif
+}
+
+void FFT_load_wisdom(const char *file_name) {
+#if defined(FFTW3)
+  // Wisdom makes thorough planning affordable, it is only done once per FFT size and batch size
+  wisdom_file = strdup(file_name);
+  planner_flags = FFTW_PATIENT;
+  if(!fftwf_import_wisdom_from_filename(wisdom_file))
+    fprintf(stderr, "WARNING: No FFT wisdom loaded from %s, plans will be added.\n", wisdom_file);
 #else
-  if(fftw_in != NULL) free(fftw_in);
-  if(fftw_out != NULL) free(fftw_out);
-  if(plan != NULL) fftw_destroy_plan(plan);
+  fprintf(stderr, "WARNING: FFT wisdom is only supported by the FFTW3 backend.\n");
 #endif
 }
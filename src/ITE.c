@@ -19,6 +19,64 @@
 
 #include "include/ITE.h"
 
+/* ITE_pool_class - Size class of a sample buffer of size bytes, -1 if not pooled */
+static int ITE_pool_class(size_t size) {
+  size_t n = size / sizeof(float);
+  int c = 0;
+  
+  // Free blocks hold the link to the next block
+  if(size % sizeof(float) != 0 || size < sizeof(void *) || (n & (n-1)) != 0) return -1;
+  while((n >>= 1) > 0) ++c;
+  
+  return (c < ITE_POOL_CLASSES) ? c : -1;
+}
+
+/* ITE_pool_get - Pop block from the free list, NULL if empty */
+static void* ITE_pool_get(PoolList *l) {
+  void *b;
+  
+  pthread_mutex_lock(&l->mut);
+  if(l->local == NULL) l->local = atomic_exchange_explicit(&l->returned, NULL, memory_order_acquire);
+  b = l->local;
+  if(b != NULL) l->local = *(void **) b;
+  pthread_mutex_unlock(&l->mut);
+  
+  return b;
+}
+
+/* ITE_pool_put - Push block onto the free list, lock-free */
+static void ITE_pool_put(PoolList *l, void *b) {
+  void *head = atomic_load_explicit(&l->returned, memory_order_relaxed);
+  
+  // Blocks are only ever taken off as a whole, so the head can't be recycled in between (no ABA)
+  do {
+    *(void **) b = head;
+  } while(!atomic_compare_exchange_weak_explicit(&l->returned, &head, b,
+						 memory_order_release, memory_order_relaxed));
+}
+
+/* ITE_pool_list_init - Initialize empty free list */
+static void ITE_pool_list_init(PoolList *l) {
+  pthread_mutex_init(&l->mut, NULL);
+  l->local = NULL;
+  atomic_init(&l->returned, NULL);
+}
+
+/* ITE_pool_list_release - Free all blocks of the free list */
+static void ITE_pool_list_release(PoolList *l) {
+  void *b, *next;
+  
+  for(b=l->local; b!=NULL; b=next) {
+    next = *(void **) b;
+    free(b);
+  }
+  for(b=atomic_load(&l->returned); b!=NULL; b=next) {
+    next = *(void **) b;
+    free(b);
+  }
+  pthread_mutex_destroy(&l->mut);
+}
+
 Item* ITE_init() {
   Item *it = NULL;
 
@@ -29,6 +87,14 @@ Item* ITE_init() {
   it->data = NULL;
   it->samples_size = 0;
   it->samples = NULL;
+  it->iq_buf = NULL;
+  it->iq_offset = 0;
+  it->iq_size = 0;
+  it->seq = 0;
+  it->log2_decim = 0;
+  it->zoom_shift = 0;
+  it->pool = NULL;
+  atomic_init(&it->refcnt, 1);
 
   return it;
 }
@@ -39,9 +105,10 @@ Item* ITE_copy(const Item *it) {
   size_t data_size = it->data_size;
   size_t samples_size = it->samples_size;
   
-  iout = ITE_init();
+  iout = ITE_pool_item(it->pool);
   if(iout == NULL) return NULL;
   memcpy(iout, it, sizeof(Item));
+  atomic_init(&iout->refcnt, 1);
   
   if(data_size > 0) {
     iout->data = (void *) malloc(data_size);
@@ -49,15 +116,148 @@ Item* ITE_copy(const Item *it) {
   }
   
   if(samples_size > 0) {
-    iout->samples = (float *) malloc(samples_size);
+    iout->samples = ITE_pool_samples(it->pool, samples_size);
     memcpy(iout->samples, it->samples, samples_size);
   }
   
+  // Share I/Q stream
+  if(it->iq_buf != NULL) ITE_buffer_retain(it->iq_buf);
+  
   return iout;
 }
 
 void  ITE_free(Item *it) {
+  int c;
+  
+  // Last reference, make all prior accesses by other threads visible before freeing
+  if(atomic_fetch_sub_explicit(&it->refcnt, 1, memory_order_acq_rel) != 1) return;
+  
   if(it->data_size > 0 && it->data != NULL) free(it->data);
-  if(it->samples_size > 0 && it->samples != NULL) free(it->samples);
-  free(it);
+  if(it->iq_buf != NULL) ITE_buffer_release(it->iq_buf);
+  
+  if(it->pool == NULL) {
+    if(it->samples_size > 0 && it->samples != NULL) free(it->samples);
+    free(it);
+    return;
+  }
+  
+  // Return item and samples to the pool
+  if(it->samples_size > 0 && it->samples != NULL) {
+    c = ITE_pool_class(it->samples_size);
+    if(c >= 0) ITE_pool_put(&it->pool->samples[c], it->samples);
+    else free(it->samples);
+  }
+  ITE_pool_put(&it->pool->items, it);
+}
+
+Item* ITE_retain(Item *it, int cnt) {
+  atomic_fetch_add_explicit(&it->refcnt, cnt, memory_order_relaxed);
+  return it;
+}
+
+Item* ITE_unshare(Item *it) {
+  Item *iout = NULL;
+  
+  if(atomic_load_explicit(&it->refcnt, memory_order_acquire) == 1) return it;
+  
+  iout = ITE_copy(it);
+  ITE_free(it);
+  
+  return iout;
+}
+
+Pool* ITE_pool_init() {
+  Pool *pool = NULL;
+  int c;
+  
+  pool = (Pool *) malloc(sizeof(Pool));
+  if(pool == NULL) return NULL;
+  
+  ITE_pool_list_init(&pool->items);
+  for(c=0; c<ITE_POOL_CLASSES; ++c) ITE_pool_list_init(&pool->samples[c]);
+  atomic_init(&pool->allocs, 0);
+  atomic_init(&pool->saved, 0);
+  
+  return pool;
+}
+
+Item* ITE_pool_item(Pool *pool) {
+  Item *it = NULL;
+  
+  if(pool == NULL) return ITE_init();
+  
+  atomic_fetch_add_explicit(&pool->allocs, 1, memory_order_relaxed);
+  it = (Item *) ITE_pool_get(&pool->items);
+  if(it == NULL) {
+    it = ITE_init();
+    if(it == NULL) return NULL;
+  } else {
+    atomic_fetch_add_explicit(&pool->saved, 1, memory_order_relaxed);
+    memset(it, 0, sizeof(Item));
+  }
+  it->pool = pool;
+  atomic_init(&it->refcnt, 1);
+  
+  return it;
+}
+
+float* ITE_pool_samples(Pool *pool, size_t size) {
+  float *samples = NULL;
+  int c = ITE_pool_class(size);
+  
+  if(pool == NULL || c < 0) return (float *) malloc(size);
+  
+  atomic_fetch_add_explicit(&pool->allocs, 1, memory_order_relaxed);
+  samples = (float *) ITE_pool_get(&pool->samples[c]);
+  if(samples == NULL) return (float *) malloc(size);
+  atomic_fetch_add_explicit(&pool->saved, 1, memory_order_relaxed);
+  
+  return samples;
+}
+
+void ITE_pool_release(Pool *pool) {
+  int c;
+  
+  ITE_pool_list_release(&pool->items);
+  for(c=0; c<ITE_POOL_CLASSES; ++c) ITE_pool_list_release(&pool->samples[c]);
+  free(pool);
+}
+
+Buffer* ITE_buffer_init(void *data, size_t size) {
+  Buffer *buf = NULL;
+  
+  buf = (Buffer *) malloc(sizeof(Buffer));
+  if(buf == NULL) return NULL;
+  
+  buf->data = data;
+  buf->size = size;
+  atomic_init(&buf->refcnt, 1);
+  buf->release = NULL;
+  buf->owner = NULL;
+  
+  return buf;
+}
+
+Buffer* ITE_buffer_init_owned(void *data, size_t size, void (*release)(Buffer *buf), void *owner) {
+  Buffer *buf = ITE_buffer_init(data, size);
+  
+  if(buf == NULL) return NULL;
+  buf->release = release;
+  buf->owner = owner;
+  
+  return buf;
+}
+
+Buffer* ITE_buffer_retain(Buffer *buf) {
+  atomic_fetch_add_explicit(&buf->refcnt, 1, memory_order_relaxed);
+  return buf;
+}
+
+void ITE_buffer_release(Buffer *buf) {
+  // Last reference, make all prior accesses by other threads visible before freeing
+  if(atomic_fetch_sub_explicit(&buf->refcnt, 1, memory_order_acq_rel) == 1) {
+    if(buf->release != NULL) buf->release(buf);
+    else free(buf->data);
+    free(buf);
+  }
 }
\ No newline at end of file
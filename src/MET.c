@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "include/THR.h"
+#include "include/MET.h"
+
+// Registry, only locked to register metrics and to write snapshots
+static pthread_mutex_t MET_mut = PTHREAD_MUTEX_INITIALIZER;
+static Counter *MET_counters[MET_MAX];
+static Histogram *MET_histograms[MET_MAX];
+static unsigned int MET_counter_cnt = 0, MET_histogram_cnt = 0;
+
+// Periodic snapshots
+static Thread *MET_thread = NULL;
+static FILE *MET_file = NULL;
+static unsigned int MET_period = 0;
+
+/* MET_bucket - Bucket of value v */
+static unsigned int MET_bucket(uint64_t v) {
+  unsigned int e;
+  
+  if(v < MET_SUB_CNT) return v;
+  // Position of the most significant bit, then the next MET_SUB_BITS bits select the sub-bucket
+  e = 63 - __builtin_clzll(v);
+  return ((e-MET_SUB_BITS+1) << MET_SUB_BITS) + ((v >> (e-MET_SUB_BITS)) & (MET_SUB_CNT-1));
+}
+
+/* MET_midpoint - Midpoint of bucket b */
+static uint64_t MET_midpoint(unsigned int b) {
+  unsigned int e;
+  
+  if(b < MET_SUB_CNT) return b;
+  e = (b >> MET_SUB_BITS) + MET_SUB_BITS-1;
+  return ((uint64_t) (MET_SUB_CNT + (b & (MET_SUB_CNT-1))) << (e-MET_SUB_BITS)) +
+    (((uint64_t) 1 << (e-MET_SUB_BITS)) >> 1);
+}
+
+Counter* MET_counter(const char *name) {
+  Counter *c = NULL;
+  unsigned int i;
+  
+  pthread_mutex_lock(&MET_mut);
+  for(i=0; i<MET_counter_cnt; ++i)
+    if(strcmp(MET_counters[i]->name, name) == 0) c = MET_counters[i];
+  if(c == NULL && MET_counter_cnt < MET_MAX) {
+    c = (Counter *) malloc(sizeof(Counter));
+    c->name = name;
+    atomic_init(&c->value, 0);
+    MET_counters[MET_counter_cnt++] = c;
+  }
+  pthread_mutex_unlock(&MET_mut);
+  
+  return c;
+}
+
+Histogram* MET_histogram(const char *name) {
+  Histogram *h = NULL;
+  unsigned int i;
+  
+  pthread_mutex_lock(&MET_mut);
+  for(i=0; i<MET_histogram_cnt; ++i)
+    if(strcmp(MET_histograms[i]->name, name) == 0) h = MET_histograms[i];
+  if(h == NULL && MET_histogram_cnt < MET_MAX) {
+    h = (Histogram *) malloc(sizeof(Histogram));
+    h->name = name;
+    atomic_init(&h->count, 0);
+    atomic_init(&h->sum, 0);
+    atomic_init(&h->max, 0);
+    for(i=0; i<MET_BUCKETS; ++i) atomic_init(&h->buckets[i], 0);
+    MET_histograms[MET_histogram_cnt++] = h;
+  }
+  pthread_mutex_unlock(&MET_mut);
+  
+  return h;
+}
+
+void MET_add(Counter *c, uint64_t v) {
+  if(c == NULL) return;
+  atomic_fetch_add_explicit(&c->value, v, memory_order_relaxed);
+}
+
+void MET_record(Histogram *h, uint64_t v) {
+  unsigned long long m;
+  
+  if(h == NULL) return;
+  atomic_fetch_add_explicit(&h->buckets[MET_bucket(v)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum, v, memory_order_relaxed);
+  m = atomic_load_explicit(&h->max, memory_order_relaxed);
+  while(v > m && !atomic_compare_exchange_weak_explicit(&h->max, &m, v, memory_order_relaxed,
+							 memory_order_relaxed));
+}
+
+uint64_t MET_now() {
+  struct timespec t;
+  
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+uint64_t MET_quantile(Histogram *h, double p) {
+  unsigned long long n = 0, cnt, rank;
+  unsigned int b;
+  
+  // Buckets are summed up instead of using count, which may be ahead of the buckets
+  for(b=0; b<MET_BUCKETS; ++b) n += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+  if(n == 0) return 0;
+  
+  rank = (unsigned long long) (p*n);
+  if(rank >= n) rank = n-1;
+  for(b=0, cnt=0; b<MET_BUCKETS; ++b) {
+    cnt += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+    if(cnt > rank) break;
+  }
+  
+  return (b < MET_BUCKETS) ? MET_midpoint(b) : atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+void MET_snapshot(FILE *f) {
+  struct timeval tv;
+  unsigned int i;
+  Histogram *h;
+  
+  gettimeofday(&tv, NULL);
+  pthread_mutex_lock(&MET_mut);
+  fprintf(f, "T %li.%06li\n", (long int) tv.tv_sec, (long int) tv.tv_usec);
+  for(i=0; i<MET_counter_cnt; ++i)
+    fprintf(f, "C %s %llu\n", MET_counters[i]->name, atomic_load(&MET_counters[i]->value));
+  for(i=0; i<MET_histogram_cnt; ++i) {
+    h = MET_histograms[i];
+    fprintf(f, "H %s %llu %llu %llu %llu %llu %llu\n", h->name, atomic_load(&h->count),
+	    atomic_load(&h->sum), atomic_load(&h->max), (unsigned long long) MET_quantile(h, .5),
+	    (unsigned long long) MET_quantile(h, .9), (unsigned long long) MET_quantile(h, .99));
+  }
+  fflush(f);
+  pthread_mutex_unlock(&MET_mut);
+}
+
+/* MET_snapshots - Write a snapshot every MET_period seconds until asked to terminate */
+static void* MET_snapshots(void *args) {
+  struct timespec deadline;
+  
+  pthread_mutex_lock(MET_thread->lock);
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  while(MET_thread->is_running) {
+    deadline.tv_sec += MET_period;
+    while(MET_thread->is_running &&
+	  pthread_cond_timedwait(MET_thread->awake, MET_thread->lock, &deadline) != ETIMEDOUT);
+    if(MET_thread->is_running) MET_snapshot(MET_file);
+  }
+  pthread_mutex_unlock(MET_thread->lock);
+  
+  pthread_exit(NULL);
+}
+
+void MET_start(FILE *f, unsigned int period) {
+  MET_file = f;
+  MET_period = period;
+  if(period == 0) return;
+  
+  THR_initialize(&MET_thread, 0);
+  pthread_create(MET_thread->fd, NULL, MET_snapshots, NULL);
+}
+
+void MET_stop() {
+  if(MET_thread != NULL) {
+    pthread_mutex_lock(MET_thread->lock);
+    MET_thread->is_running = 0;
+    pthread_cond_signal(MET_thread->awake);
+    pthread_mutex_unlock(MET_thread->lock);
+    pthread_join(*(MET_thread->fd), NULL);
+    THR_release(MET_thread);
+    MET_thread = NULL;
+  }
+  if(MET_file != NULL) MET_snapshot(MET_file);
+  MET_file = NULL;
+}
+
+void MET_release() {
+  pthread_mutex_lock(&MET_mut);
+  while(MET_counter_cnt > 0) free(MET_counters[--MET_counter_cnt]);
+  while(MET_histogram_cnt > 0) free(MET_histograms[--MET_histogram_cnt]);
+  pthread_mutex_unlock(&MET_mut);
+}
\ No newline at end of file
@@ -18,22 +18,146 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #include "include/QUE.h"
 
-Queue* QUE_initialize(int size) {
+// Hint to the CPU that we are busy waiting
+#if defined(__x86_64__) || defined(__i386__)
+#define QUE_PAUSE() __builtin_ia32_pause()
+#elif defined(__aarch64__) || (defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+#define QUE_PAUSE() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define QUE_PAUSE()
+#endif
+
+// Add to a counter written by one thread at a time, i.e. the producer, the consumer or under the lock
+#define QUE_ADD(c, v) \
+  atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (v), memory_order_relaxed)
+
+/* QUE_allocate - Allocate queue with slots item pointers, cache line aligned */
+static Queue* QUE_allocate(int size, int slots) {
   Queue *q = NULL;
   
-  q = (Queue *) malloc(sizeof(Queue));
-  if(q == NULL) return NULL;
-
-  q->buf = (void **) malloc(size * sizeof(void *));
+  if(posix_memalign((void **) &q, QUE_CACHE_LINE, sizeof(Queue)) != 0) return NULL;
+  
+  q->buf = (void **) malloc(slots * sizeof(void *));
   q->head = 0;
   q->tail = 0;
   q->full = 0;
   q->empty = 1;
   q->exit = 0;
   q->size = size;
+  q->mut = NULL;
+  q->notFull = NULL;
+  q->notEmpty = NULL;
+  
+  q->spsc = 0;
+  atomic_init(&q->rd, 0);
+  q->rd_wr = 0;
+  q->rd_spin = QUE_MIN_SPIN;
+  atomic_init(&q->wr, 0);
+  q->wr_rd = 0;
+  q->wr_spin = QUE_MIN_SPIN;
+  atomic_init(&q->rd_sleeping, 0);
+  atomic_init(&q->wr_sleeping, 0);
+  atomic_init(&q->rd_event, 0);
+  atomic_init(&q->wr_event, 0);
+  atomic_init(&q->closed, 0);
+  
+  atomic_init(&q->in_cnt, 0);
+  atomic_init(&q->full_waits, 0);
+  atomic_init(&q->full_ns, 0);
+  atomic_init(&q->occ_sum, 0);
+  atomic_init(&q->occ_cnt, 0);
+  atomic_init(&q->high, 0);
+  atomic_init(&q->out_cnt, 0);
+  atomic_init(&q->empty_waits, 0);
+  atomic_init(&q->empty_ns, 0);
+  
+  return q;
+}
+
+/* QUE_now - Monotonic time in nanoseconds */
+static uint64_t QUE_now() {
+  struct timespec t;
+  
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+/* QUE_count_in - Count cnt inserted items, leaving occ items in the queue */
+static void QUE_count_in(Queue *q, unsigned int cnt, unsigned int occ) {
+  QUE_ADD(q->in_cnt, cnt);
+  QUE_ADD(q->occ_sum, occ);
+  QUE_ADD(q->occ_cnt, 1);
+  if(occ > atomic_load_explicit(&q->high, memory_order_relaxed))
+    atomic_store_explicit(&q->high, occ, memory_order_relaxed);
+}
+
+/* QUE_sleep - Sleep until the futex word event is changed from val */
+static void QUE_sleep(atomic_uint *event, unsigned int val) {
+#if defined(__linux__)
+  syscall(SYS_futex, (unsigned int *) event, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+  if(atomic_load(event) == val) sched_yield();
+#endif
+}
+
+/* QUE_wake - Change the futex word event and wake its sleeper */
+static void QUE_wake(atomic_uint *event) {
+  atomic_fetch_add(event, 1);
+#if defined(__linux__)
+  syscall(SYS_futex, (unsigned int *) event, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/* QUE_wait - Wait for the index idx to move on from busy, or for the queue being closed if closable
+ * 
+ * Spins first, doubling the spinning budget whenever spinning pays off and halving it otherwise. Then
+ * announces itself in sleeping and sleeps on event. The store to sleeping and the reload of idx are
+ * sequentially consistent, as are the other side's update of the index and its check of sleeping, so
+ * either we see the update or the other side sees us sleeping. Returns the last value of idx.
+ */
+static unsigned int QUE_wait(Queue *q, atomic_uint *idx, unsigned int busy, unsigned int *spin,
+			     atomic_uint *sleeping, atomic_uint *event, int closable) {
+  unsigned int i, v, e;
+  
+  for(i=0; i<*spin; ++i) {
+    v = atomic_load_explicit(idx, memory_order_acquire);
+    if(v != busy || (closable && atomic_load_explicit(&q->closed, memory_order_acquire))) {
+      if(*spin < QUE_MAX_SPIN) *spin *= 2;
+      return v;
+    }
+    QUE_PAUSE();
+  }
+  if(*spin > QUE_MIN_SPIN) *spin /= 2;
+  
+  while(1) {
+    e = atomic_load(event);
+    atomic_store(sleeping, 1);
+    v = atomic_load(idx);
+    if(v != busy || (closable && atomic_load(&q->closed))) break;
+    QUE_sleep(event, e);
+  }
+  atomic_store_explicit(sleeping, 0, memory_order_relaxed);
+  
+  return v;
+}
+
+Queue* QUE_initialize(int size) {
+  Queue *q = NULL;
+  
+  q = QUE_allocate(size, size);
+  if(q == NULL) return NULL;
+  
   q->mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
   pthread_mutex_init(q->mut, NULL);
   q->notFull = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
@@ -44,33 +168,203 @@ Queue* QUE_initialize(int size) {
   return q;
 }
 
+Queue* QUE_initialize_spsc(int size) {
+  Queue *q = NULL;
+  
+  // One slot stays free to tell a full from an empty ring
+  q = QUE_allocate(size, size+1);
+  if(q == NULL) return NULL;
+  
+  q->spsc = 1;
+  
+  return q;
+}
+
 void QUE_insert(Queue *q, void *in) {
-  q->buf[q->tail] = in;
-  ++q->tail;
-  if(q->tail == q->size) q->tail = 0;
-  if(q->tail == q->head) q->full = 1;
-  q->empty = 0;
+  QUE_insert_many(q, &in, 1);
+}
+
+void QUE_insert_many(Queue *q, void **in, int cnt) {
+  unsigned int t, n, m, j;
+  int i, was_empty;
+  uint64_t t0;
+  
+  if(q->spsc) {
+    t = atomic_load_explicit(&q->wr, memory_order_relaxed);
+    while(cnt > 0) {
+      n = (t == q->size) ? 0 : t+1;
+      // Full while the consumer hasn't moved on from the next slot
+      if(n == q->wr_rd) {
+	q->wr_rd = atomic_load_explicit(&q->rd, memory_order_acquire);
+	if(n == q->wr_rd) {
+	  t0 = QUE_now();
+	  q->wr_rd = QUE_wait(q, &q->rd, n, &q->wr_spin, &q->wr_sleeping, &q->wr_event, 0);
+	  QUE_ADD(q->full_ns, QUE_now()-t0);
+	  QUE_ADD(q->full_waits, 1);
+	}
+      }
+      // Free slots up to the one before the consumer's
+      m = (q->wr_rd + q->size - t) % (q->size+1);
+      if(m > cnt) m = cnt;
+      for(j=0; j<m; ++j) {
+	q->buf[t] = *in++;
+	t = (t == q->size) ? 0 : t+1;
+      }
+      cnt -= m;
+      // Publish all items at once
+      atomic_store(&q->wr, t);
+      if(atomic_load(&q->rd_sleeping)) QUE_wake(&q->rd_event);
+      // Occupancy right after publishing, refreshes the last seen rd as well
+      q->wr_rd = atomic_load_explicit(&q->rd, memory_order_acquire);
+      QUE_count_in(q, m, (t + q->size+1 - q->wr_rd) % (q->size+1));
+    }
+    return;
+  }
+  
+  pthread_mutex_lock(q->mut);
+  while(cnt > 0) {
+    if(q->full) {
+      t0 = QUE_now();
+      while(q->full) pthread_cond_wait(q->notFull, q->mut);
+      QUE_ADD(q->full_ns, QUE_now()-t0);
+      QUE_ADD(q->full_waits, 1);
+    }
+    was_empty = q->empty;
+    for(i=0; i<cnt && !q->full; ++i) {
+      q->buf[q->tail] = *in++;
+      ++q->tail;
+      if(q->tail == q->size) q->tail = 0;
+      if(q->tail == q->head) q->full = 1;
+    }
+    cnt -= i;
+    q->empty = 0;
+    QUE_count_in(q, i, q->full ? q->size : (q->tail + q->size - q->head) % q->size);
+    // Consumers only wait on an empty queue
+    if(was_empty) pthread_cond_broadcast(q->notEmpty);
+  }
+  pthread_mutex_unlock(q->mut);
 }
 
 void* QUE_remove(Queue *q) {
   void *i;
   
-  i = q->buf[q->head];
-  ++q->head;
-  if(q->head == q->size) q->head = 0;
-  if(q->head == q->tail) q->empty = 1;
-  q->full = 0;
+  return (QUE_remove_many(q, &i, 1) == 1) ? i : NULL;
+}
+
+int QUE_remove_many(Queue *q, void **out, int max) {
+  unsigned int h, m, j;
+  int i, was_full;
+  uint64_t t0;
+  
+  if(q->spsc) {
+    h = atomic_load_explicit(&q->rd, memory_order_relaxed);
+    // Empty while the producer hasn't moved on from our slot
+    if(h == q->rd_wr) {
+      q->rd_wr = atomic_load_explicit(&q->wr, memory_order_acquire);
+      if(h == q->rd_wr) {
+	t0 = QUE_now();
+	q->rd_wr = QUE_wait(q, &q->wr, h, &q->rd_spin, &q->rd_sleeping, &q->rd_event, 1);
+	QUE_ADD(q->empty_ns, QUE_now()-t0);
+	QUE_ADD(q->empty_waits, 1);
+	// Closed, but items inserted before closing are still to be removed
+	if(h == q->rd_wr) {
+	  q->rd_wr = atomic_load_explicit(&q->wr, memory_order_acquire);
+	  if(h == q->rd_wr) return 0;
+	}
+      }
+    }
+    // Items up to the producer's slot
+    m = (q->rd_wr + q->size+1 - h) % (q->size+1);
+    if(m > max) m = max;
+    for(j=0; j<m; ++j) {
+      *out++ = q->buf[h];
+      h = (h == q->size) ? 0 : h+1;
+    }
+    // Release all slots at once
+    atomic_store(&q->rd, h);
+    if(atomic_load(&q->wr_sleeping)) QUE_wake(&q->wr_event);
+    QUE_ADD(q->out_cnt, m);
+    return m;
+  }
+  
+  pthread_mutex_lock(q->mut);
+  if(q->empty && !q->exit) {
+    t0 = QUE_now();
+    while(q->empty && !q->exit) pthread_cond_wait(q->notEmpty, q->mut);
+    QUE_ADD(q->empty_ns, QUE_now()-t0);
+    QUE_ADD(q->empty_waits, 1);
+  }
+  was_full = q->full;
+  for(i=0; i<max && !q->empty; ++i) {
+    *out++ = q->buf[q->head];
+    ++q->head;
+    if(q->head == q->size) q->head = 0;
+    if(q->head == q->tail) q->empty = 1;
+  }
+  if(i > 0) q->full = 0;
+  QUE_ADD(q->out_cnt, i);
+  // Producers only wait on a full queue
+  if(was_full && i > 0) pthread_cond_broadcast(q->notFull);
+  pthread_mutex_unlock(q->mut);
   
+  // None once the queue is closed and empty
   return i;
 }
 
+void QUE_close(Queue *q) {
+  if(q->spsc) {
+    atomic_store(&q->closed, 1);
+    QUE_wake(&q->rd_event);
+    return;
+  }
+  
+  pthread_mutex_lock(q->mut);
+  q->exit = 1;
+  // Wake all consumers
+  pthread_cond_broadcast(q->notEmpty);
+  pthread_mutex_unlock(q->mut);
+}
+
+void QUE_stats(Queue *q, QueueStats *s) {
+  unsigned long occ_cnt;
+  
+  if(q->spsc) {
+    s->occupancy = (atomic_load(&q->wr) + q->size+1 - atomic_load(&q->rd)) % (q->size+1);
+  } else {
+    pthread_mutex_lock(q->mut);
+    s->occupancy = q->full ? q->size : (q->tail + q->size - q->head) % q->size;
+    pthread_mutex_unlock(q->mut);
+  }
+  s->items_in = atomic_load_explicit(&q->in_cnt, memory_order_relaxed);
+  s->items_out = atomic_load_explicit(&q->out_cnt, memory_order_relaxed);
+  s->high = atomic_load_explicit(&q->high, memory_order_relaxed);
+  occ_cnt = atomic_load_explicit(&q->occ_cnt, memory_order_relaxed);
+  s->avg_occupancy = (occ_cnt > 0) ?
+    (double) atomic_load_explicit(&q->occ_sum, memory_order_relaxed) / occ_cnt : 0.;
+  s->full_waits = atomic_load_explicit(&q->full_waits, memory_order_relaxed);
+  s->empty_waits = atomic_load_explicit(&q->empty_waits, memory_order_relaxed);
+  s->full_s = atomic_load_explicit(&q->full_ns, memory_order_relaxed) * 1e-9;
+  s->empty_s = atomic_load_explicit(&q->empty_ns, memory_order_relaxed) * 1e-9;
+}
+
+void QUE_print_stats(Queue *q, const char *name, FILE *f) {
+  QueueStats s;
+  
+  QUE_stats(q, &s);
+  fprintf(f, "[%s] Items in/out: %lu/%lu, occupancy: %u/%d (avg %.1f, high %u), blocked full: %.3f s "
+	  "(%lu), blocked empty: %.3f s (%lu).\n", name, s.items_in, s.items_out, s.occupancy, q->size,
+	  s.avg_occupancy, s.high, s.full_s, s.full_waits, s.empty_s, s.empty_waits);
+}
+
 void QUE_release(Queue *q) {
   free(q->buf);
-  pthread_mutex_destroy(q->mut);
-  free(q->mut);	
-  pthread_cond_destroy(q->notFull);
-  free(q->notFull);
-  pthread_cond_destroy(q->notEmpty);
-  free(q->notEmpty);
+  if(!q->spsc) {
+    pthread_mutex_destroy(q->mut);
+    free(q->mut);	
+    pthread_cond_destroy(q->notFull);
+    free(q->notFull);
+    pthread_cond_destroy(q->notEmpty);
+    free(q->notEmpty);
+  }
   free(q);
-}
\ No newline at end of file
+}
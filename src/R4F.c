@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "include/R4F.h"
+
+// Largest sub-transform (log2) that is computed stage by stage, 2^12 complex floats occupy 32 KiB
+#define R4F_BLOCK_LOG2 12
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define R4F_NEON
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#define R4F_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define R4F_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Vectors of R4F_VLEN interleaved complex floats: load, store, add, subtract, multiply by -i and
+ * multiply by interleaved twiddle factors
+ */
+#if defined(R4F_NEON)
+#define R4F_VLEN 2
+typedef float32x4_t R4F_Vec;
+static inline R4F_Vec R4F_load(const float *x) { return vld1q_f32(x); }
+static inline void R4F_store(float *x, R4F_Vec a) { vst1q_f32(x, a); }
+static inline R4F_Vec R4F_add(R4F_Vec a, R4F_Vec b) { return vaddq_f32(a, b); }
+static inline R4F_Vec R4F_sub(R4F_Vec a, R4F_Vec b) { return vsubq_f32(a, b); }
+static inline R4F_Vec R4F_mul_nj(R4F_Vec a) {
+  const float32x4_t sign = {1.f, -1.f, 1.f, -1.f};
+  return vmulq_f32(vrev64q_f32(a), sign);
+}
+static inline R4F_Vec R4F_mul(R4F_Vec a, const float *w) {
+  const float32x4_t sign = {-1.f, 1.f, -1.f, 1.f};
+  float32x4_t t = vld1q_f32(w);
+  float32x4x2_t d = vtrnq_f32(t, t);
+  return vmlaq_f32(vmulq_f32(a, d.val[0]), vrev64q_f32(a), vmulq_f32(d.val[1], sign));
+}
+#elif defined(R4F_AVX2)
+#define R4F_VLEN 4
+typedef __m256 R4F_Vec;
+static inline R4F_Vec R4F_load(const float *x) { return _mm256_loadu_ps(x); }
+static inline void R4F_store(float *x, R4F_Vec a) { _mm256_storeu_ps(x, a); }
+static inline R4F_Vec R4F_add(R4F_Vec a, R4F_Vec b) { return _mm256_add_ps(a, b); }
+static inline R4F_Vec R4F_sub(R4F_Vec a, R4F_Vec b) { return _mm256_sub_ps(a, b); }
+static inline R4F_Vec R4F_mul_nj(R4F_Vec a) {
+  return _mm256_xor_ps(_mm256_permute_ps(a, 0xB1), _mm256_setr_ps(0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f));
+}
+static inline R4F_Vec R4F_mul(R4F_Vec a, const float *w) {
+  __m256 t = _mm256_loadu_ps(w);
+  __m256 im = _mm256_mul_ps(_mm256_permute_ps(a, 0xB1), _mm256_movehdup_ps(t));
+#if defined(__FMA__)
+  return _mm256_fmaddsub_ps(a, _mm256_moveldup_ps(t), im);
+#else
+  return _mm256_addsub_ps(_mm256_mul_ps(a, _mm256_moveldup_ps(t)), im);
+#endif
+}
+#elif defined(R4F_SSE2)
+#define R4F_VLEN 2
+typedef __m128 R4F_Vec;
+static inline R4F_Vec R4F_load(const float *x) { return _mm_loadu_ps(x); }
+static inline void R4F_store(float *x, R4F_Vec a) { _mm_storeu_ps(x, a); }
+static inline R4F_Vec R4F_add(R4F_Vec a, R4F_Vec b) { return _mm_add_ps(a, b); }
+static inline R4F_Vec R4F_sub(R4F_Vec a, R4F_Vec b) { return _mm_sub_ps(a, b); }
+static inline R4F_Vec R4F_mul_nj(R4F_Vec a) {
+  return _mm_xor_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1)), _mm_setr_ps(0.f, -0.f, 0.f, -0.f));
+}
+static inline R4F_Vec R4F_mul(R4F_Vec a, const float *w) {
+  __m128 t = _mm_loadu_ps(w);
+  __m128 re = _mm_mul_ps(a, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2,2,0,0)));
+  __m128 im = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1)), _mm_shuffle_ps(t, t, _MM_SHUFFLE(3,3,1,1)));
+  return _mm_add_ps(re, _mm_xor_ps(im, _mm_setr_ps(-0.f, 0.f, -0.f, 0.f)));
+}
+#endif
+
+/*
+ * R4F_radix4 - radix-4 decimation-in-frequency stage of a sub-transform of size L = 2^l, quarter r
+ * of the sub-transform is replaced by the input of the sub-transform for outputs 4k+r
+ */
+static void R4F_radix4(float *x, int l, const float *tw) {
+  const unsigned int q = 1u<<(l-2);
+  float *x0 = x, *x1 = x + 2*q, *x2 = x + 4*q, *x3 = x + 6*q;
+  const float *w1 = tw, *w2 = tw + 2*q, *w3 = tw + 4*q;
+  unsigned int j = 0;
+  
+#if defined(R4F_VLEN)
+  R4F_Vec a0, a1, a2, a3, b0, b1, b2, b3;
+  if(q >= R4F_VLEN) {
+    for(; j<q; j=j+R4F_VLEN) {
+      a0 = R4F_load(x0+2*j); a1 = R4F_load(x1+2*j); a2 = R4F_load(x2+2*j); a3 = R4F_load(x3+2*j);
+      b0 = R4F_add(a0, a2); b1 = R4F_sub(a0, a2);
+      b2 = R4F_add(a1, a3); b3 = R4F_mul_nj(R4F_sub(a1, a3));
+      R4F_store(x0+2*j, R4F_add(b0, b2));
+      R4F_store(x1+2*j, R4F_mul(R4F_add(b1, b3), w1+2*j));
+      R4F_store(x2+2*j, R4F_mul(R4F_sub(b0, b2), w2+2*j));
+      R4F_store(x3+2*j, R4F_mul(R4F_sub(b1, b3), w3+2*j));
+    }
+  }
+#endif
+  
+  // Scalar fallback and short stages
+  float b0r, b0i, b1r, b1i, b2r, b2i, b3r, b3i, yr, yi;
+  for(; j<q; ++j) {
+    b0r = x0[2*j] + x2[2*j];     b0i = x0[2*j+1] + x2[2*j+1];
+    b1r = x0[2*j] - x2[2*j];     b1i = x0[2*j+1] - x2[2*j+1];
+    b2r = x1[2*j] + x3[2*j];     b2i = x1[2*j+1] + x3[2*j+1];
+    b3r = x1[2*j+1] - x3[2*j+1]; b3i = x3[2*j] - x1[2*j];
+    x0[2*j] = b0r + b2r;
+    x0[2*j+1] = b0i + b2i;
+    yr = b1r + b3r; yi = b1i + b3i;
+    x1[2*j] = yr*w1[2*j] - yi*w1[2*j+1];
+    x1[2*j+1] = yr*w1[2*j+1] + yi*w1[2*j];
+    yr = b0r - b2r; yi = b0i - b2i;
+    x2[2*j] = yr*w2[2*j] - yi*w2[2*j+1];
+    x2[2*j+1] = yr*w2[2*j+1] + yi*w2[2*j];
+    yr = b1r - b3r; yi = b1i - b3i;
+    x3[2*j] = yr*w3[2*j] - yi*w3[2*j+1];
+    x3[2*j+1] = yr*w3[2*j+1] + yi*w3[2*j];
+  }
+}
+
+/*
+ * R4F_radix4_last - last radix-4 stage of L complex samples, i.e. 4-point DFTs without twiddles
+ */
+static void R4F_radix4_last(float *x, unsigned int L) {
+  unsigned int j;
+  float b0r, b0i, b1r, b1i, b2r, b2i, b3r, b3i;
+  
+  for(j=0; j<2*L; j=j+8) {
+    b0r = x[j] + x[j+4];   b0i = x[j+1] + x[j+5];
+    b1r = x[j] - x[j+4];   b1i = x[j+1] - x[j+5];
+    b2r = x[j+2] + x[j+6]; b2i = x[j+3] + x[j+7];
+    b3r = x[j+3] - x[j+7]; b3i = x[j+6] - x[j+2];
+    x[j] = b0r + b2r;   x[j+1] = b0i + b2i;
+    x[j+2] = b1r + b3r; x[j+3] = b1i + b3i;
+    x[j+4] = b0r - b2r; x[j+5] = b0i - b2i;
+    x[j+6] = b1r - b3r; x[j+7] = b1i - b3i;
+  }
+}
+
+/*
+ * R4F_radix2_last - last radix-2 stage of L complex samples, i.e. 2-point DFTs
+ */
+static void R4F_radix2_last(float *x, unsigned int L) {
+  unsigned int j;
+  float t;
+  
+  for(j=0; j<2*L; j=j+4) {
+    t = x[j];   x[j] = t + x[j+2];   x[j+2] = t - x[j+2];
+    t = x[j+1]; x[j+1] = t + x[j+3]; x[j+3] = t - x[j+3];
+  }
+}
+
+/*
+ * R4F_transform - in-place sub-transform of size 2^l with outputs in digit-reversed order
+ */
+static void R4F_transform(const R4F_Plan *p, float *x, int l) {
+  int s;
+  unsigned int b, L = 1u<<l;
+  
+  // Depth-first until the sub-transforms fit into the cache
+  if(l > R4F_BLOCK_LOG2) {
+    R4F_radix4(x, l, p->tw[l]);
+    for(b=0; b<4; ++b) R4F_transform(p, x + b*(L/2), l-2);
+    return;
+  }
+  
+  // Stage by stage within the block
+  for(s=l; s>2; s=s-2)
+    for(b=0; b<L; b=b+(1u<<s)) R4F_radix4(x + 2*b, s, p->tw[s]);
+  if(s == 2) R4F_radix4_last(x, L);
+  else if(s == 1) R4F_radix2_last(x, L);
+}
+
+/*
+ * R4F_permutation - record input positions of the outputs base + stride*k of the sub-transform of
+ * size 2^l that is computed in place at position pos
+ */
+static void R4F_permutation(unsigned int *perm, unsigned int pos, int l, unsigned int stride,
+			    unsigned int base) {
+  unsigned int r;
+  
+  if(l == 0) {
+    perm[base] = pos;
+  } else if(l == 1) {
+    perm[base] = pos;
+    perm[base+stride] = pos+1;
+  } else {
+    for(r=0; r<4; ++r)
+      R4F_permutation(perm, pos + r*(1u<<(l-2)), l-2, 4*stride, base + r*stride);
+  }
+}
+
+R4F_Plan* R4F_initialize(int log2_N, int batchsize) {
+  int l, m;
+  unsigned int j, q, size = 0;
+  float *tw;
+  R4F_Plan *p;
+  
+  if(log2_N < R4F_MIN_LOG2_N || log2_N > R4F_MAX_LOG2_N) return NULL;
+  
+  p = (R4F_Plan *) calloc(1, sizeof(R4F_Plan));
+  if(p == NULL) return NULL;
+  p->log2_N = log2_N;
+  p->N = 1<<log2_N;
+  p->batchsize = batchsize;
+  
+  // Buffers, twiddle tables of all stages with twiddles and output permutation
+  for(l=log2_N; l>2; l=l-2) size += 6*(1u<<(l-2));
+  if(posix_memalign((void **) &p->in, 64, 2*p->N*batchsize*sizeof(float)) ||
+     posix_memalign((void **) &p->out, 64, 2*p->N*batchsize*sizeof(float)) ||
+     posix_memalign((void **) &p->twiddles, 64, size*sizeof(float)) ||
+     (p->perm = (unsigned int *) malloc(p->N*sizeof(unsigned int))) == NULL) {
+    R4F_release(p);
+    return NULL;
+  }
+  
+  // Stage with sub-transform size L = 2^l uses w^(m*j) for quarter m, w = exp(-2*pi*i/L)
+  tw = p->twiddles;
+  for(l=log2_N; l>2; l=l-2) {
+    q = 1u<<(l-2);
+    p->tw[l] = tw;
+    for(m=1; m<=3; ++m) {
+      for(j=0; j<q; ++j) {
+	tw[2*j] = cos(-2*M_PI*m*j / (4.0*q));
+	tw[2*j+1] = sin(-2*M_PI*m*j / (4.0*q));
+      }
+      tw += 2*q;
+    }
+  }
+  
+  R4F_permutation(p->perm, 0, log2_N, 1, 0);
+  
+  return p;
+}
+
+void R4F_forward(R4F_Plan *p, int n) {
+  int i;
+  unsigned int k;
+  float *x, *X;
+  
+  for(i=0; i<n; ++i) {
+    x = p->in + 2*i*p->N;
+    X = p->out + 2*i*p->N;
+    R4F_transform(p, x, p->log2_N);
+    // Restore natural order
+    for(k=0; k<p->N; ++k) memcpy(X + 2*k, x + 2*p->perm[k], 2*sizeof(float));
+  }
+}
+
+void R4F_release(R4F_Plan *p) {
+  free(p->in);
+  free(p->out);
+  free(p->twiddles);
+  free(p->perm);
+  free(p);
+}
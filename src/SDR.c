@@ -17,109 +17,814 @@
  * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "include/SDR.h"
 
+#define SDR_STREAM_BUF_NUM 4		// USB transfers of a stream
+#define SDR_STREAM_BUF_LEN 16384	// Bytes per USB transfer, ~3.4ms at 2.4MS/s
+#define SDR_STREAM_SETTLE  8192		// Bytes taken while the tuner settles
+#define SDR_STREAM_DROP    (2*SDR_STREAM_BUF_LEN + SDR_STREAM_SETTLE)	// Bytes dropped after a retune
+#define SDR_STREAM_IDLE_MS 500		// Idle time after which a stream is stopped
+
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+typedef struct {
+  uint8_t *data;
+  size_t  size;
+  size_t  offset;
+} SDR_File;
+
+/*
+ * RTL-SDR BACKEND
+ */
+
 /*
- * SDR_initialize - allocate memory and initialize device
+ * SDR_rtlsdr_open - allocate memory and initialize device
  */
- void SDR_initialize(rtlsdr_dev_t **dev, int dev_index) {
-  int r, dev_count;
+static int SDR_rtlsdr_open(SDR_Source *src, const char *arg) {
+  int r, dev_count, dev_index;
+  rtlsdr_dev_t *dev;
+  
+  dev_index = atoi(arg);
   
   // Count RTL-SDR devices
   dev_count = rtlsdr_get_device_count();
   if(dev_count <= 0) {
     fprintf(stderr, "No supported devices found\n");
-    exit(1);
+    return -1;
   }
   
   // Open RTL-SDR device
-  r = rtlsdr_open(dev, dev_index);
+  r = rtlsdr_open(&dev, dev_index);
   if(r < 0) {
     fprintf(stderr, "Failed to open rtlsdr device #%d\n", dev_index);
-    exit(1);
+    return -1;
   }
+  src->dev = dev;
+  
+  return 0;
 }
 
 /*
- * SDR_set_sample_rate - set device's sampling rate
+ * SDR_rtlsdr_set_sample_rate - set device's sampling rate
  */
-void SDR_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate) {
+static void SDR_rtlsdr_set_sample_rate(SDR_Source *src, uint32_t samp_rate) {
   int r;
   
   // Set sample rate
-  r = rtlsdr_set_sample_rate(dev, samp_rate);
+  r = rtlsdr_set_sample_rate(src->dev, samp_rate);
   if(r < 0) {
     fprintf(stderr, "WARNING: Failed to set sample rate to %d MHz\n", samp_rate / 1000000);
   }
 }
 
 /*
- * SDR_set_gain - set device's gain
+ * SDR_rtlsdr_set_gain - set device's gain
  */
-void SDR_set_gain(rtlsdr_dev_t *dev, float gain) {
+static void SDR_rtlsdr_set_gain(SDR_Source *src, float gain) {
   int r;
   
   // Enable automatic gain
   if(gain < 0) {
-    r = rtlsdr_set_tuner_gain_mode(dev, 0);
+    r = rtlsdr_set_tuner_gain_mode(src->dev, 0);
     if(r < 0) {
       fprintf(stderr, "WARNING: Failed to enable automatic gain mode\n");
     }
   }
   // Enable manual gain
   else {
-    r = rtlsdr_set_tuner_gain_mode(dev, 1);
+    r = rtlsdr_set_tuner_gain_mode(src->dev, 1);
     if(r < 0) {
       fprintf(stderr, "WARNING: Failed to enable manual gain mode\n");
     }
-    r = rtlsdr_set_tuner_gain(dev, 10*gain);
+    r = rtlsdr_set_tuner_gain(src->dev, 10*gain);
     if(r < 0) {
       fprintf(stderr, "WARNING: Failed to set manual tuner gain\n");
     }
   }
 }
 
-void SDR_set_freq_correction(rtlsdr_dev_t *dev, int ppm_error) {
+static void SDR_rtlsdr_set_freq_correction(SDR_Source *src, int ppm_error) {
   int r;
 
-  r = rtlsdr_set_freq_correction(dev, ppm_error);
+  r = rtlsdr_set_freq_correction(src->dev, ppm_error);
   if(r < 0 && r != -2) fprintf(stderr, "WARNING: Failed to set ppm error %d\n", ppm_error);
 }
 
 /*
- * SDR_retune - set device's center frequency
+ * SDR_rtlsdr_retune - set device's center frequency
  */
-void SDR_retune(rtlsdr_dev_t *dev, uint32_t freq) {
+static void SDR_rtlsdr_retune(SDR_Source *src, uint32_t freq) {
   int r;
   uint32_t actual_freq;
   
   // Set center frequency of device 'dev' to 'freq'
-  r = rtlsdr_set_center_freq(dev, freq);
+  r = rtlsdr_set_center_freq(src->dev, freq);
   if(r < 0) fprintf(stderr, "WARNING: Failed to set center frequency to %d Hz\n", freq);
   
   // Get actual center frequency
-  actual_freq = rtlsdr_get_center_freq(dev);
+  actual_freq = rtlsdr_get_center_freq(src->dev);
   if(freq != actual_freq)
     fprintf(stderr, "WARNING: Theoretical / actual center frequency:\t%d / %dHz\n",
 	    freq, actual_freq);
   
-  // Flush buffer
-  r = rtlsdr_reset_buffer(dev);
+  // Flush buffer, a running stream drops the samples of the previous frequency instead
+  if(src->streaming) return;
+  r = rtlsdr_reset_buffer(src->dev);
   if(r != 0) fprintf(stderr, "WARNING: Flushing buffer failed.\n");
 }
 
-void SDR_read(rtlsdr_dev_t *dev, uint8_t *iq_buf, int N) {
+static void SDR_rtlsdr_read(SDR_Source *src, uint8_t *iq_buf, int N) {
   int r, n_read;
   
   // Read N-point interleaved I/Q stream from device
-  r = rtlsdr_read_sync(dev, iq_buf, N, &n_read);
+  r = rtlsdr_read_sync(src->dev, iq_buf, N, &n_read);
   if(r != 0 || n_read != N) fprintf(stderr, "WARNING: Synchronous read failed.\n");
 }
 
 /*
- * SDR_release
+ * SDR_rtlsdr_stream - stream interleaved I/Q samples to cb until cancelled
  */
-void SDR_release(rtlsdr_dev_t *dev) {
+static int SDR_rtlsdr_stream(SDR_Source *src, SDR_StreamCallback cb, void *ctx) {
+  int r;
+  
+  r = rtlsdr_reset_buffer(src->dev);
+  if(r != 0) fprintf(stderr, "WARNING: Flushing buffer failed.\n");
+  
+  return rtlsdr_read_async(src->dev, cb, ctx, SDR_STREAM_BUF_NUM, SDR_STREAM_BUF_LEN);
+}
+
+static void SDR_rtlsdr_cancel(SDR_Source *src) {
+  rtlsdr_cancel_async(src->dev);
+}
+
+static void SDR_rtlsdr_close(SDR_Source *src) {
   // Close device
-  rtlsdr_close(dev);
-}
\ No newline at end of file
+  rtlsdr_close(src->dev);
+}
+
+const SDR_Backend SDR_RTLSDR_BACKEND = {
+  "rtlsdr",
+  SDR_rtlsdr_open,
+  SDR_rtlsdr_set_sample_rate,
+  SDR_rtlsdr_set_gain,
+  SDR_rtlsdr_set_freq_correction,
+  SDR_rtlsdr_retune,
+  SDR_rtlsdr_read,
+  SDR_rtlsdr_stream,
+  SDR_rtlsdr_cancel,
+  SDR_rtlsdr_close
+};
+
+/*
+ * RECORDED I/Q FILE BACKEND
+ */
+
+/*
+ * SDR_file_open - memory-map recorded I/Q file
+ */
+static int SDR_file_open(SDR_Source *src, const char *arg) {
+  int fd;
+  struct stat st;
+  SDR_File *f;
+  
+  fd = open(arg, O_RDONLY);
+  if(fd < 0) {
+    fprintf(stderr, "Failed to open I/Q file %s\n", arg);
+    return -1;
+  }
+  if(fstat(fd, &st) < 0 || st.st_size < 2) {
+    fprintf(stderr, "I/Q file %s is empty\n", arg);
+    close(fd);
+    return -1;
+  }
+  
+  f = (SDR_File *) malloc(sizeof(SDR_File));
+  if(f == NULL) {
+    fprintf(stderr, "Out of memory opening I/Q file %s\n", arg);
+    close(fd);
+    return -1;
+  }
+  // Replay complete I/Q pairs only
+  f->size = st.st_size & ~((size_t) 1);
+  f->offset = 0;
+  f->data = (uint8_t *) mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(f->data == MAP_FAILED) {
+    fprintf(stderr, "Failed to map I/Q file %s\n", arg);
+    free(f);
+    return -1;
+  }
+  madvise(f->data, f->size, MADV_SEQUENTIAL);
+  src->dev = f;
+  
+  return 0;
+}
+
+/*
+ * SDR_file_read - read N-point interleaved I/Q stream, wrapping around at the end of the file
+ */
+static void SDR_file_read(SDR_Source *src, uint8_t *iq_buf, int N) {
+  size_t n;
+  SDR_File *f = (SDR_File *) src->dev;
+  
+  while(N > 0) {
+    n = MIN(N, f->size - f->offset);
+    memcpy(iq_buf, f->data + f->offset, n);
+    iq_buf += n;
+    N -= n;
+    f->offset += n;
+    if(f->offset >= f->size) f->offset = 0;
+  }
+}
+
+static void SDR_file_close(SDR_Source *src) {
+  SDR_File *f = (SDR_File *) src->dev;
+  
+  munmap(f->data, f->size);
+  free(f);
+}
+
+const SDR_Backend SDR_FILE_BACKEND = {
+  "file",
+  SDR_file_open,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  SDR_file_read,
+  NULL,
+  NULL,
+  SDR_file_close
+};
+
+/*
+ * SAMPLE SOURCE
+ */
+
+/*
+ * SDR_initialize - allocate memory and open sample source
+ */
+SDR_Source* SDR_initialize(const SDR_Backend *backend, const char *arg) {
+  SDR_Source *src = NULL;
+  
+  src = (SDR_Source *) malloc(sizeof(SDR_Source));
+  if(src == NULL) return NULL;
+  
+  src->backend = backend;
+  src->dev = NULL;
+  src->streaming = 0;
+  src->settings = 0;
+  src->mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+  if(src->mut == NULL) {
+    free(src);
+    return NULL;
+  }
+  if(backend->open(src, arg) < 0) {
+    free(src->mut);
+    free(src);
+    return NULL;
+  }
+  pthread_mutex_init(src->mut, NULL);
+  src->m_samp_rate = MET_histogram("sdr_set_sample_rate_ns");
+  src->m_retune = MET_histogram("sdr_retune_ns");
+  src->m_read = MET_histogram("sdr_read_ns");
+  
+  return src;
+}
+
+void SDR_set_sample_rate(SDR_Source *src, uint32_t samp_rate) {
+  uint64_t t0 = MET_now();
+  
+  if(src->backend->set_sample_rate != NULL) src->backend->set_sample_rate(src, samp_rate);
+  MET_record(src->m_samp_rate, MET_now()-t0);
+}
+
+void SDR_set_gain(SDR_Source *src, float gain) {
+  if(src->backend->set_gain != NULL) src->backend->set_gain(src, gain);
+  ++src->settings;
+}
+
+void SDR_set_freq_correction(SDR_Source *src, int ppm_error) {
+  if(src->backend->set_freq_correction != NULL) src->backend->set_freq_correction(src, ppm_error);
+  ++src->settings;
+}
+
+void SDR_retune(SDR_Source *src, uint32_t freq) {
+  uint64_t t0 = MET_now();
+  
+  if(src->backend->retune != NULL) src->backend->retune(src, freq);
+  MET_record(src->m_retune, MET_now()-t0);
+}
+
+void SDR_read(SDR_Source *src, uint8_t *iq_buf, int N) {
+  uint64_t t0 = MET_now();
+  
+  src->backend->read(src, iq_buf, N);
+  MET_record(src->m_read, MET_now()-t0);
+}
+
+/*
+ * SDR_release
+ */
+void SDR_release(SDR_Source *src) {
+  src->backend->close(src);
+  pthread_mutex_destroy(src->mut);
+  free(src->mut);
+  free(src);
+}
+
+/*
+ * SDR_buffers_free - release free list and all buffers on it
+ */
+static void SDR_buffers_free(SDR_Buffers *b) {
+  int i;
+  
+  for(i=0; i<b->cnt; ++i) free(b->spares[i].buf);
+  free(b->spares);
+  pthread_mutex_destroy(b->mut);
+  free(b->mut);
+  free(b);
+}
+
+/*
+ * SDR_buffers_return - put a buffer back on the free list, called by its last reference
+ */
+static void SDR_buffers_return(Buffer *buf) {
+  int last;
+  SDR_Spare *spares;
+  SDR_Buffers *b = (SDR_Buffers *) buf->owner;
+  
+  pthread_mutex_lock(b->mut);
+  if(!b->released && b->cnt == b->cap) {
+    spares = (SDR_Spare *) realloc(b->spares, 2*b->cap*sizeof(SDR_Spare));
+    if(spares != NULL) {
+      b->spares = spares;
+      b->cap *= 2;
+    }
+  }
+  if(!b->released && b->cnt < b->cap) {
+    b->spares[b->cnt].buf = (uint8_t *) buf->data;
+    b->spares[b->cnt].size = buf->size;
+    ++b->cnt;
+  } else
+    free(buf->data);
+  last = (--b->out == 0 && b->released);
+  pthread_mutex_unlock(b->mut);
+  
+  // Free list was released while this buffer was in use
+  if(last) SDR_buffers_free(b);
+}
+
+/*
+ * SDR_buffers_take - remove a buffer of at least N bytes from the free list, or allocate one
+ */
+static uint8_t* SDR_buffers_take(SDR_Buffers *b, int N, int *size) {
+  uint8_t *data = NULL, *resized;
+  int data_size = 0;
+  
+  pthread_mutex_lock(b->mut);
+  if(b->cnt > 0) {
+    --b->cnt;
+    data = b->spares[b->cnt].buf;
+    data_size = b->spares[b->cnt].size;
+  }
+  pthread_mutex_unlock(b->mut);
+  
+  if(data_size < N) {
+    resized = (uint8_t *) realloc(data, N*sizeof(uint8_t));
+    if(resized == NULL) {
+      free(data);
+      return NULL;
+    }
+    data = resized;
+    data_size = N;
+  }
+  *size = data_size;
+  
+  return data;
+}
+
+/*
+ * SDR_buffers_wrap - hand data out as a buffer that returns to the free list
+ */
+static Buffer* SDR_buffers_wrap(SDR_Buffers *b, uint8_t *data, int N) {
+  Buffer *buf = ITE_buffer_init_owned(data, N, SDR_buffers_return, b);
+  
+  if(buf == NULL) return NULL;
+  pthread_mutex_lock(b->mut);
+  ++b->out;
+  pthread_mutex_unlock(b->mut);
+  
+  return buf;
+}
+
+SDR_Buffers* SDR_buffers_initialize() {
+  SDR_Buffers *b = NULL;
+  
+  b = (SDR_Buffers *) malloc(sizeof(SDR_Buffers));
+  if(b == NULL) return NULL;
+  
+  b->cnt = 0;
+  b->cap = 4;
+  b->out = 0;
+  b->released = 0;
+  b->spares = (SDR_Spare *) malloc(b->cap*sizeof(SDR_Spare));
+  b->mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+  if(b->spares == NULL || b->mut == NULL) {
+    free(b->spares);
+    free(b->mut);
+    free(b);
+    return NULL;
+  }
+  pthread_mutex_init(b->mut, NULL);
+  
+  return b;
+}
+
+Buffer* SDR_buffers_get(SDR_Buffers *b, int N) {
+  Buffer *buf;
+  uint8_t *data;
+  int size;
+  
+  data = SDR_buffers_take(b, N, &size);
+  if(data == NULL) return NULL;
+  buf = SDR_buffers_wrap(b, data, N);
+  if(buf == NULL) free(data);
+  
+  return buf;
+}
+
+void SDR_buffers_release(SDR_Buffers *b) {
+  int i, last;
+  
+  // Buffers still in use free the free list when the last one is returned
+  pthread_mutex_lock(b->mut);
+  for(i=0; i<b->cnt; ++i) free(b->spares[i].buf);
+  b->cnt = 0;
+  b->released = 1;
+  last = (b->out == 0);
+  pthread_mutex_unlock(b->mut);
+  
+  if(last) SDR_buffers_free(b);
+}
+
+/*
+ * SDR_async_deadline - absolute time ms milliseconds from now
+ */
+static void SDR_async_deadline(struct timespec *ts, long ms) {
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (ms % 1000) * 1000000;
+  if(ts->tv_nsec >= 1000000000) {
+    ++ts->tv_sec;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+/*
+ * SDR_async_stream_callback - drop samples until the hop's frequency has settled, then copy them
+ * into the hop buffer, discard samples while no hop is being filled
+ */
+static void SDR_async_stream_callback(unsigned char *buf, uint32_t len, void *ctx) {
+  int n;
+  SDR_Hop *hop;
+  SDR_Async *a = (SDR_Async *) ctx;
+  
+  pthread_mutex_lock(a->mut);
+  hop = a->fill_hop;
+  if(hop != NULL) {
+    n = MIN((int) len, a->drop);
+    a->drop -= n;
+    buf += n;
+    len -= n;
+    
+    n = MIN((int) len, hop->len - a->fill);
+    memcpy(hop->buf + a->fill, buf, n);
+    a->fill += n;
+    if(a->fill >= hop->len) {
+      a->fill_hop = NULL;
+      pthread_cond_broadcast(a->filled);
+    }
+  }
+  pthread_mutex_unlock(a->mut);
+}
+
+/*
+ * SDR_async_stream_thread - run the source's stream until it is cancelled
+ */
+static void* SDR_async_stream_thread(void *args) {
+  int r;
+  SDR_Async *a = (SDR_Async *) args;
+  
+  r = a->src->backend->stream(a->src, SDR_async_stream_callback, a);
+  if(r != 0) fprintf(stderr, "WARNING: Streaming failed.\n");
+  
+  pthread_mutex_lock(a->mut);
+  a->stream_done = 1;
+  pthread_cond_broadcast(a->filled);
+  pthread_mutex_unlock(a->mut);
+  
+  pthread_exit(NULL);
+}
+
+/*
+ * SDR_async_start - start streaming, the source must be tuned and its buffer flushed
+ */
+static void SDR_async_start(SDR_Async *a) {
+  a->fill_hop = NULL;
+  a->stream_done = 0;
+  a->src->streaming = 1;
+  if(pthread_create(a->stream_fd, NULL, SDR_async_stream_thread, a) != 0) {
+    fprintf(stderr, "WARNING: Failed to start stream, reading synchronously.\n");
+    a->src->streaming = 0;
+  }
+}
+
+/*
+ * SDR_async_stop - cancel stream and wait for it to return
+ */
+static void SDR_async_stop(SDR_Async *a) {
+  struct timespec deadline;
+  
+  if(!a->src->streaming) return;
+  
+  // Cancelling a stream that did not start yet has no effect, hence repeat until it returned
+  pthread_mutex_lock(a->mut);
+  while(!a->stream_done) {
+    a->src->backend->cancel(a->src);
+    SDR_async_deadline(&deadline, 10);
+    pthread_cond_timedwait(a->filled, a->mut, &deadline);
+  }
+  pthread_mutex_unlock(a->mut);
+  pthread_join(*(a->stream_fd), NULL);
+  a->src->streaming = 0;
+}
+
+/*
+ * SDR_async_fill - have the stream fill the hop after dropping drop bytes
+ * 
+ * \return 0 on success, -1 when the stream returned before the hop was filled
+ */
+static int SDR_async_fill(SDR_Async *a, SDR_Hop *hop, int drop) {
+  int r;
+  
+  pthread_mutex_lock(a->mut);
+  a->fill = 0;
+  a->drop = drop;
+  a->fill_hop = hop;
+  while(a->fill_hop != NULL && !a->stream_done) pthread_cond_wait(a->filled, a->mut);
+  r = (a->fill_hop == NULL) ? 0 : -1;
+  a->fill_hop = NULL;
+  pthread_mutex_unlock(a->mut);
+  
+  return r;
+}
+
+/*
+ * SDR_async_thread - acquire submitted hops in order
+ */
+static void* SDR_async_thread(void *args) {
+  SDR_Hop *hop;
+  SDR_Async *a = (SDR_Async *) args;
+  struct timespec deadline;
+  uint64_t t0;
+  int retune, drop;
+  
+  pthread_mutex_lock(a->mut);
+  while(1) {
+    // Await submitted hops, stop the stream once no hop was submitted for a while
+    while(a->pending <= 0 && !a->exit) {
+      if(!a->src->streaming) {
+	pthread_cond_wait(a->submitted, a->mut);
+	continue;
+      }
+      SDR_async_deadline(&deadline, SDR_STREAM_IDLE_MS);
+      if(pthread_cond_timedwait(a->submitted, a->mut, &deadline) == ETIMEDOUT && a->pending <= 0) {
+	pthread_mutex_unlock(a->mut);
+	SDR_async_stop(a);
+	pthread_mutex_lock(a->mut);
+      }
+    }
+    if(a->exit) break;
+    hop = &a->hops[a->acquire];
+    pthread_mutex_unlock(a->mut);
+    
+    // Tune hop, the sampling rate can only be changed while not streaming
+    if(hop->samp_rate != a->samp_rate) {
+      SDR_async_stop(a);
+      SDR_set_sample_rate(a->src, hop->samp_rate);
+      a->samp_rate = hop->samp_rate;
+    }
+    retune = (hop->center_freq != a->center_freq);
+    if(a->src->streaming) {
+      // Drop the transfers still in flight and the samples taken while the tuner settles
+      drop = (retune || a->settings != a->src->settings) ? SDR_STREAM_DROP : 0;
+      if(retune) SDR_retune(a->src, hop->center_freq);
+    } else {
+      if(retune) SDR_retune(a->src, hop->center_freq);
+      drop = SDR_STREAM_SETTLE;
+      if(a->src->backend->stream != NULL) SDR_async_start(a);
+    }
+    a->center_freq = hop->center_freq;
+    a->settings = a->src->settings;
+    
+    // Read hop
+    if(a->src->streaming) {
+      t0 = MET_now();
+      if(SDR_async_fill(a, hop, drop) != 0) {
+	fprintf(stderr, "WARNING: Asynchronous read failed.\n");
+	SDR_async_stop(a);
+      }
+      MET_record(a->src->m_read, MET_now()-t0);
+    } else
+      SDR_read(a->src, hop->buf, hop->len);
+    gettimeofday(&hop->tv, NULL);
+    
+    // Hand hop over to consumer
+    pthread_mutex_lock(a->mut);
+    if(++a->acquire == a->size) a->acquire = 0;
+    --a->pending;
+    ++a->ready;
+    pthread_cond_signal(a->acquired);
+  }
+  pthread_mutex_unlock(a->mut);
+  SDR_async_stop(a);
+  
+  pthread_exit(NULL);
+}
+
+/*
+ * SDR_async_free - release engine resources
+ */
+static void SDR_async_free(SDR_Async *a) {
+  free(a->hops);
+  free(a->fd);
+  free(a->stream_fd);
+  pthread_cond_destroy(a->filled);
+  free(a->filled);
+  pthread_cond_destroy(a->recycled);
+  free(a->recycled);
+  pthread_cond_destroy(a->acquired);
+  free(a->acquired);
+  pthread_cond_destroy(a->submitted);
+  free(a->submitted);
+  pthread_mutex_destroy(a->mut);
+  free(a->mut);
+  free(a);
+}
+
+SDR_Async* SDR_async_initialize(SDR_Source *src, int buf_cnt) {
+  SDR_Async *a = NULL;
+  
+  a = (SDR_Async *) malloc(sizeof(SDR_Async));
+  if(a == NULL) return NULL;
+  
+  a->src = src;
+  a->size = buf_cnt;
+  a->submit = 0;
+  a->acquire = 0;
+  a->consume = 0;
+  a->pending = 0;
+  a->ready = 0;
+  a->used = 0;
+  a->exit = 0;
+  a->samp_rate = 0;
+  a->center_freq = 0;
+  a->settings = src->settings;
+  a->fill_hop = NULL;
+  a->fill = 0;
+  a->drop = 0;
+  a->stream_done = 1;
+  a->hops = (SDR_Hop *) calloc(buf_cnt, sizeof(SDR_Hop));
+  a->bufs = SDR_buffers_initialize();
+  a->mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+  a->submitted = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
+  a->acquired = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
+  a->recycled = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
+  a->filled = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
+  a->fd = (pthread_t *) malloc(sizeof(pthread_t));
+  a->stream_fd = (pthread_t *) malloc(sizeof(pthread_t));
+  if(a->hops == NULL || a->bufs == NULL || a->mut == NULL || a->submitted == NULL ||
+     a->acquired == NULL || a->recycled == NULL || a->filled == NULL || a->fd == NULL ||
+     a->stream_fd == NULL) {
+    free(a->hops);
+    if(a->bufs != NULL) SDR_buffers_release(a->bufs);
+    free(a->mut);
+    free(a->submitted);
+    free(a->acquired);
+    free(a->recycled);
+    free(a->filled);
+    free(a->fd);
+    free(a->stream_fd);
+    free(a);
+    return NULL;
+  }
+  pthread_mutex_init(a->mut, NULL);
+  pthread_cond_init(a->submitted, NULL);
+  pthread_cond_init(a->acquired, NULL);
+  pthread_cond_init(a->recycled, NULL);
+  pthread_cond_init(a->filled, NULL);
+  if(pthread_create(a->fd, NULL, SDR_async_thread, a) != 0) {
+    SDR_buffers_release(a->bufs);
+    SDR_async_free(a);
+    return NULL;
+  }
+  
+  return a;
+}
+
+int SDR_async_submit(SDR_Async *a, uint32_t samp_rate, uint32_t center_freq, int N) {
+  SDR_Hop *hop;
+  uint8_t *resized;
+  
+  // Wait for a free hop buffer
+  pthread_mutex_lock(a->mut);
+  while(a->used >= a->size) pthread_cond_wait(a->recycled, a->mut);
+  hop = &a->hops[a->submit];
+  pthread_mutex_unlock(a->mut);
+  
+  // The hop buffer is owned by the caller until it is marked pending, a detached slot is refilled
+  // from the free list
+  if(hop->buf == NULL) {
+    hop->buf = SDR_buffers_take(a->bufs, N, &hop->size);
+    if(hop->buf == NULL) {
+      hop->size = 0;
+      return -1;
+    }
+  } else if(hop->size < N) {
+    resized = (uint8_t *) realloc(hop->buf, N*sizeof(uint8_t));
+    if(resized == NULL) return -1;
+    hop->buf = resized;
+    hop->size = N;
+  }
+  hop->len = N;
+  hop->samp_rate = samp_rate;
+  hop->center_freq = center_freq;
+  
+  pthread_mutex_lock(a->mut);
+  if(++a->submit == a->size) a->submit = 0;
+  ++a->used;
+  ++a->pending;
+  pthread_cond_signal(a->submitted);
+  pthread_mutex_unlock(a->mut);
+  
+  return 0;
+}
+
+SDR_Hop* SDR_async_wait(SDR_Async *a) {
+  SDR_Hop *hop;
+  
+  pthread_mutex_lock(a->mut);
+  while(a->ready <= 0) pthread_cond_wait(a->acquired, a->mut);
+  hop = &a->hops[a->consume];
+  pthread_mutex_unlock(a->mut);
+  
+  return hop;
+}
+
+Buffer* SDR_async_detach(SDR_Async *a) {
+  Buffer *buf;
+  SDR_Hop *hop;
+  
+  // The consumed hop is owned by the caller until it is recycled
+  hop = &a->hops[a->consume];
+  buf = SDR_buffers_wrap(a->bufs, hop->buf, hop->len);
+  if(buf == NULL) return NULL;
+  hop->buf = NULL;
+  hop->size = 0;
+  
+  return buf;
+}
+
+void SDR_async_recycle(SDR_Async *a) {
+  pthread_mutex_lock(a->mut);
+  if(++a->consume == a->size) a->consume = 0;
+  --a->ready;
+  --a->used;
+  pthread_cond_signal(a->recycled);
+  pthread_mutex_unlock(a->mut);
+}
+
+void SDR_async_release(SDR_Async *a) {
+  int i;
+  
+  // Stop acquisition thread
+  pthread_mutex_lock(a->mut);
+  a->exit = 1;
+  pthread_cond_signal(a->submitted);
+  pthread_mutex_unlock(a->mut);
+  pthread_join(*(a->fd), NULL);
+  
+  // Detached buffers still in use release the free list when the last one is returned
+  for(i=0; i<a->size; ++i) free(a->hops[i].buf);
+  SDR_buffers_release(a->bufs);
+  SDR_async_free(a);
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "include/STG.h"
+
+/* STG_now - Monotonic time in nanoseconds */
+static uint64_t STG_now() {
+  struct timespec t;
+  
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+/* STG_worker - Remove items from the input queue and process them until the queue is closed */
+static void* STG_worker(void *args) {
+  Stage *stg = (Stage *) args;
+  Item **its;
+  void *state = NULL;
+  unsigned int w;
+  size_t k;
+  int cnt, last;
+  uint64_t t0, t1;
+  
+  pthread_mutex_lock(stg->mut);
+  w = stg->started++;
+  pthread_mutex_unlock(stg->mut);
+  
+  // Pin worker to its CPU and set its scheduling policy
+  THR_sched_apply(&stg->sched, w, stg->name);
+  
+#if defined(VERBOSE) || defined(TID)
+  fprintf(stderr, "[%s] Started worker %u.\n", stg->name, w);
+#endif
+  
+  its = (Item **) malloc(stg->batchlen*sizeof(Item *));
+  if(stg->init != NULL) state = stg->init(stg);
+  
+  t0 = STG_now();
+  while(1) {
+    // Read up to a batch of items from input queue, waits while the queue is empty
+    cnt = QUE_remove_many(stg->qin, (void **) its, stg->batchlen);
+    t1 = STG_now();
+    atomic_fetch_add_explicit(&stg->idle_ns, t1-t0, memory_order_relaxed);
+    // No more input is coming to this queue
+    if(cnt == 0) break;
+  
+    stg->process(stg, state, its, cnt);
+  
+    t0 = STG_now();
+    atomic_fetch_add_explicit(&stg->busy_ns, t0-t1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stg->items_in, cnt, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stg->calls, 1, memory_order_relaxed);
+  }
+  
+  // Process remaining items held by the worker
+  t1 = STG_now();
+  if(stg->flush != NULL) stg->flush(stg, state);
+  atomic_fetch_add_explicit(&stg->busy_ns, STG_now()-t1, memory_order_relaxed);
+  if(stg->release != NULL) stg->release(stg, state);
+  free(its);
+  
+  // Once all workers are done, signal that no further items will appear in the queues
+  pthread_mutex_lock(stg->mut);
+  last = (--stg->running == 0);
+  pthread_mutex_unlock(stg->mut);
+  for(k=0; last && k<stg->qsout_cnt; ++k) QUE_close(stg->qsout[k]);
+  
+#if defined(VERBOSE)
+  fprintf(stderr, "[%s] Terminated worker %u.\n", stg->name, w);
+#endif
+  
+  pthread_exit(NULL);
+}
+
+Stage* STG_initialize(const char *name, unsigned int id, unsigned int workers,
+		      unsigned int batchlen) {
+  Stage *stg = NULL;
+  unsigned int w;
+  
+  stg = (Stage *) malloc(sizeof(Stage));
+  if(stg == NULL) return NULL;
+  
+  stg->name = name;
+  stg->id = id;
+  stg->ctx = NULL;
+  stg->init = NULL;
+  stg->process = NULL;
+  stg->flush = NULL;
+  stg->release = NULL;
+  stg->qin = NULL;
+  stg->qsout = NULL;
+  stg->qsout_cnt = 0;
+  stg->workers = (workers > 0) ? workers : 1;
+  stg->batchlen = (batchlen > 0) ? batchlen : 1;
+  THR_sched_initialize(&stg->sched);
+  stg->threads = (Thread **) malloc(stg->workers*sizeof(Thread *));
+  for(w=0; w<stg->workers; ++w) THR_initialize(&(stg->threads[w]), id);
+  stg->mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(stg->mut, NULL);
+  stg->started = 0;
+  stg->running = 0;
+  atomic_init(&stg->items_in, 0);
+  atomic_init(&stg->items_out, 0);
+  atomic_init(&stg->calls, 0);
+  atomic_init(&stg->busy_ns, 0);
+  atomic_init(&stg->idle_ns, 0);
+  
+  return stg;
+}
+
+void STG_output(Stage *stg, Queue *q) {
+  stg->qsout = (Queue **) realloc(stg->qsout, (stg->qsout_cnt+1)*sizeof(Queue *));
+  stg->qsout[stg->qsout_cnt++] = q;
+}
+
+void STG_start(Stage *stg) {
+  unsigned int w;
+  
+  stg->running = stg->workers;
+  for(w=0; w<stg->workers; ++w) pthread_create(stg->threads[w]->fd, NULL, STG_worker, stg);
+}
+
+void STG_join(Stage *stg) {
+  unsigned int w;
+  
+  for(w=0; w<stg->workers; ++w) pthread_join(*(stg->threads[w]->fd), NULL);
+}
+
+void STG_push(Stage *stg, Item *it) {
+  STG_push_many(stg, &it, 1);
+}
+
+void STG_push_many(Stage *stg, Item **its, int cnt) {
+  size_t k;
+  int i;
+  
+  // Sink
+  if(stg->qsout_cnt == 0) {
+    for(i=0; i<cnt; ++i) ITE_free(its[i]);
+    return;
+  }
+  
+  // Share items with the output queues, one reference per queue
+  if(stg->qsout_cnt > 1)
+    for(i=0; i<cnt; ++i) ITE_retain(its[i], stg->qsout_cnt-1);
+  
+  atomic_fetch_add_explicit(&stg->items_out, cnt, memory_order_relaxed);
+  for(k=0; k<stg->qsout_cnt; ++k) {
+    // Write items to output queue, waits while the queue is full
+    QUE_insert_many(stg->qsout[k], (void **) its, cnt);
+  }
+}
+
+void STG_print_stats(Stage *stg, FILE *f) {
+  unsigned long in = atomic_load(&stg->items_in), out = atomic_load(&stg->items_out);
+  double busy = atomic_load(&stg->busy_ns) * 1e-9, idle = atomic_load(&stg->idle_ns) * 1e-9;
+  
+  fprintf(f, "[%s] Items in/out: %lu/%lu, busy: %.3f s, idle: %.3f s, %.1f us per item, %.1f items "
+	  "per call.\n", stg->name, in, out, busy, idle, (in > 0) ? busy*1e6/in : 0.,
+	  (atomic_load(&stg->calls) > 0) ? (double) in / atomic_load(&stg->calls) : 0.);
+}
+
+void STG_release(Stage *stg) {
+  unsigned int w;
+  
+  for(w=0; w<stg->workers; ++w) THR_release(stg->threads[w]);
+  free(stg->threads);
+  pthread_mutex_destroy(stg->mut);
+  free(stg->mut);
+  free(stg->qsout);
+  free(stg);
+}
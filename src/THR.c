@@ -17,6 +17,11 @@
  * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
 #include "include/THR.h"
 
 void THR_initialize(Thread **t, unsigned int id) {
@@ -30,6 +35,7 @@ void THR_initialize(Thread **t, unsigned int id) {
   pthread_mutex_init((*t)->lock, NULL);
   (*t)->awake = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
   pthread_cond_init((*t)->awake, NULL);
+  THR_sched_initialize(&((*t)->sched));
 }
 
 void THR_release(Thread *t) {
@@ -39,4 +45,73 @@ void THR_release(Thread *t) {
   free(t->lock);
   free(t->fd);
   free(t);
+}
+
+void THR_sched_initialize(ThreadSched *s) {
+  s->cpu = -1;
+  s->policy = SCHED_OTHER;
+  s->priority = 0;
+}
+
+int THR_sched_parse(ThreadSched *s, const char *str) {
+  char *end;
+  long cpu, priority;
+  
+  cpu = strtol(str, &end, 10);
+  if(end == str || cpu < -1 || cpu >= CPU_SETSIZE) return -1;
+  s->cpu = cpu;
+  if(*end == '\0') return 0;
+  if(*end++ != ':') return -1;
+  
+  if(strncmp(end, "other", 5) == 0) {
+    s->policy = SCHED_OTHER;
+    end += 5;
+  } else if(strncmp(end, "fifo", 4) == 0) {
+    s->policy = SCHED_FIFO;
+    end += 4;
+  } else if(strncmp(end, "rr", 2) == 0) {
+    s->policy = SCHED_RR;
+    end += 2;
+  } else
+    return -1;
+  s->priority = sched_get_priority_min(s->policy);
+  if(*end == '\0') return 0;
+  if(*end++ != ':') return -1;
+  
+  priority = strtol(end, &end, 10);
+  if(*end != '\0' || priority < sched_get_priority_min(s->policy) ||
+     priority > sched_get_priority_max(s->policy)) return -1;
+  s->priority = priority;
+  
+  return 0;
+}
+
+int THR_sched_apply(const ThreadSched *s, unsigned int k, const char *name) {
+  int r, ret = 0;
+  struct sched_param param;
+  
+#if defined(__linux__)
+  // Pin thread to its CPU
+  if(s->cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(s->cpu+k, &cpus);
+    r = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    fprintf(stderr, "[%s] CPU %u: %s%s.\n", name, s->cpu+k, (r == 0) ? "applied" : "failed, ",
+	    (r == 0) ? "" : strerror(r));
+    if(r != 0) ret = -1;
+  }
+#endif
+  
+  // Set scheduling policy and priority
+  if(s->policy != SCHED_OTHER || s->priority != 0) {
+    param.sched_priority = s->priority;
+    r = pthread_setschedparam(pthread_self(), s->policy, &param);
+    fprintf(stderr, "[%s] %s priority %i: %s%s.\n", name,
+	    (s->policy == SCHED_FIFO) ? "SCHED_FIFO" : (s->policy == SCHED_RR) ? "SCHED_RR" : "SCHED_OTHER",
+	    s->priority, (r == 0) ? "applied" : "failed, ", (r == 0) ? "" : strerror(r));
+    if(r != 0) ret = -1;
+  }
+  
+  return ret;
 }
\ No newline at end of file
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../include/DSP.h"
+
+#define LOG2_FFT_SIZE_MIN 1
+#define LOG2_FFT_SIZE_MAX 22
+#define AVG_FACTOR 16
+#define MIN_BENCH_TIME 0.2
+
+typedef void (*bench_fun_ptr_t)(float **, const uint8_t *, const float *, unsigned int);
+typedef void (*post_fun_ptr_t)(float *, const float *, unsigned int);
+
+/*
+ * elapsed - seconds between two time stamps
+ */
+static double elapsed(const struct timespec *tstart, const struct timespec *tend) {
+  return ((double)tend->tv_sec + 1.0e-9*tend->tv_nsec) - ((double)tstart->tv_sec + 1.0e-9*tstart->tv_nsec);
+}
+
+static float ref_means[2*AVG_FACTOR], dsp_means[2*AVG_FACTOR];
+static float **ref_conv;	// Converted segments windowed by reference_window
+
+/*
+ * reference_means - first pass as previously done by sampling_windowing, i.e. conversion of the
+ * segments and their I/Q means
+ */
+static void reference_means(float **out, const uint8_t *iq_buf, const float *window, unsigned int N) {
+  int j, l;
+  unsigned int soverlap = N/2;
+  float i_val, q_val, i_mean, q_mean;
+  
+  for(j=0; j<AVG_FACTOR; ++j) {
+    i_mean = 0;
+    q_mean = 0;
+    for(l=0; l<N*2; l=l+2) {
+      i_val = (float) iq_buf[l+j*(N-soverlap)*2];
+      q_val = (float) iq_buf[l+1+j*(N-soverlap)*2];
+      i_mean += i_val;
+      q_mean += q_val;
+      out[j][l] = i_val;
+      out[j][l+1] = q_val;
+    }
+    ref_means[2*j] = i_mean / N;
+    ref_means[2*j+1] = q_mean / N;
+  }
+}
+
+/*
+ * reference_apply - second pass as previously done by sampling_windowing, i.e. DC removal and
+ * windowing of the converted segments in
+ */
+static void reference_apply(float **out, float **in, const float *window, unsigned int N) {
+  int j, l;
+  
+  for(j=0; j<AVG_FACTOR; ++j) {
+    for(l=0; l<N*2; l=l+2) {
+      out[j][l] = (in[j][l] - ref_means[2*j])*window[l];
+      out[j][l+1] = (in[j][l+1] - ref_means[2*j+1])*window[l+1];
+    }
+  }
+}
+
+/*
+ * reference_window - second pass out of place, so that repeated runs see the same input
+ */
+static void reference_window(float **out, const uint8_t *iq_buf, const float *window,
+			     unsigned int N) {
+  reference_apply(out, ref_conv, window, N);
+}
+
+/*
+ * reference_hop - segmentation, DC removal and windowing as previously done by sampling_windowing,
+ * i.e. two scalar passes per segment
+ */
+static void reference_hop(float **out, const uint8_t *iq_buf, const float *window, unsigned int N) {
+  reference_means(out, iq_buf, window, N);
+  reference_apply(out, out, window, N);
+}
+
+/*
+ * kernel_means - first pass using the DSP kernels, i.e. sliding-sum I/Q means of the segments
+ */
+static void kernel_means(float **out, const uint8_t *iq_buf, const float *window, unsigned int N) {
+  DSP_segment_means(dsp_means, iq_buf, N, N-N/2, AVG_FACTOR);
+}
+
+/*
+ * kernel_window - second pass using the DSP kernels, i.e. conversion, DC removal and windowing
+ */
+static void kernel_window(float **out, const uint8_t *iq_buf, const float *window, unsigned int N) {
+  int j;
+  unsigned int soverlap = N/2;
+  
+  for(j=0; j<AVG_FACTOR; ++j)
+    DSP_window_segment(out[j], iq_buf+j*(N-soverlap)*2, window, N, 1, dsp_means+2*j);
+}
+
+/*
+ * kernel_hop - segmentation, DC removal and windowing using the DSP kernels
+ */
+static void kernel_hop(float **out, const uint8_t *iq_buf, const float *window, unsigned int N) {
+  kernel_means(out, iq_buf, window, N);
+  kernel_window(out, iq_buf, window, N);
+}
+
+/*
+ * reference_post - shift, scaling and dB conversion as previously done by FFT_forward, i.e. a
+ * branch and two divisions per bin and a double-precision logarithm
+ */
+static void reference_post(float *out, const float *X, unsigned int N) {
+  unsigned int j;
+  float re, im, dB;
+  
+  for(j=0; j<N; ++j) {
+    if(j < N/2) {
+      re = X[2*(N/2+j)] / N;
+      im = X[2*(N/2+j)+1] / N;
+    } else {
+      re = X[2*(j-N/2)] / N;
+      im = X[2*(j-N/2)+1] / N;
+    }
+    dB = 10.0f * log10(re*re + im*im);
+    out[j] = (dB > -100) ? dB : -100;
+  }
+}
+
+/*
+ * bench - average run time of one hop in seconds
+ */
+static double bench(bench_fun_ptr_t fun, float **out, const uint8_t *iq_buf, const float *window,
+		    unsigned int N) {
+  long runs, r;
+  struct timespec tstart, tend;
+  
+  // Double the number of runs until the minimum benchmark time is reached
+  for(runs=1; ; runs=runs*2) {
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+    for(r=0; r<runs; ++r) fun(out, iq_buf, window, N);
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+    if(elapsed(&tstart, &tend) >= MIN_BENCH_TIME) break;
+  }
+  
+  return elapsed(&tstart, &tend) / runs;
+}
+
+/*
+ * bench_post - average run time of post-processing one FFT output in seconds
+ */
+static double bench_post(post_fun_ptr_t fun, float *out, const float *X, unsigned int N) {
+  long runs, r;
+  struct timespec tstart, tend;
+  
+  // Double the number of runs until the minimum benchmark time is reached
+  for(runs=1; ; runs=runs*2) {
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+    for(r=0; r<runs; ++r) fun(out, X, N);
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+    if(elapsed(&tstart, &tend) >= MIN_BENCH_TIME) break;
+  }
+  
+  return elapsed(&tstart, &tend) / runs;
+}
+
+int main(int argc, char *argv[]) {
+  int j, log2_N;
+  unsigned int l, N, len;
+  uint8_t *iq_buf;
+  float *X, *post_ref, *post_dsp;
+  float *out_ref[AVG_FACTOR], *out_dsp[AVG_FACTOR];
+  const float *window;
+  double t_ref, t_dsp, t_ref1, t_dsp1, t_ref2, t_dsp2, err, max_err;
+  
+  fprintf(stdout, "Segmentation, DC removal and windowing of one hop, %d segments, 50%% overlap\n",
+	  AVG_FACTOR);
+  fprintf(stdout, "Pass 1: DC bias of the segments, pass 2: DC removal and windowing\n");
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  fprintf(stdout, "Kernel: NEON\n");
+#elif defined(__AVX2__)
+  fprintf(stdout, "Kernel: AVX2\n");
+#elif defined(__SSE2__)
+  fprintf(stdout, "Kernel: SSE2\n");
+#else
+  fprintf(stdout, "Kernel: scalar\n");
+#endif
+  fprintf(stdout, "%8s %14s %14s %14s %14s %14s %14s %9s %12s\n",
+	  "N", "ref_1[ns]", "kernel_1[ns]", "ref_2[ns]", "kernel_2[ns]", "reference[ns]",
+	  "kernel[ns]", "speedup", "max_error");
+  
+  for(log2_N=LOG2_FFT_SIZE_MIN; log2_N<=LOG2_FFT_SIZE_MAX; ++log2_N) {
+    N = 1<<log2_N;
+    
+    // Random hop
+    len = ((N-N/2)*AVG_FACTOR+N/2)*2;
+    iq_buf = (uint8_t *) malloc(len);
+    for(l=0; l<len; ++l) iq_buf[l] = (uint8_t) (rand() & 0xff);
+    for(j=0; j<AVG_FACTOR; ++j) {
+      out_ref[j] = (float *) malloc(2*N*sizeof(float));
+      out_dsp[j] = (float *) malloc(2*N*sizeof(float));
+    }
+    window = DSP_window_table(HANNING_WINDOW, N);
+    
+    // Passes on their own, the reference's second pass windows the segments converted into out_dsp
+    ref_conv = out_dsp;
+    t_ref1 = bench(reference_means, out_dsp, iq_buf, window, N);
+    t_ref2 = bench(reference_window, out_ref, iq_buf, window, N);
+    t_dsp1 = bench(kernel_means, out_dsp, iq_buf, window, N);
+    t_dsp2 = bench(kernel_window, out_dsp, iq_buf, window, N);
+    
+    t_ref = bench(reference_hop, out_ref, iq_buf, window, N);
+    t_dsp = bench(kernel_hop, out_dsp, iq_buf, window, N);
+    
+    // Compare results
+    max_err = 0;
+    for(j=0; j<AVG_FACTOR; ++j) {
+      for(l=0; l<2*N; ++l) {
+	err = fabs(out_ref[j][l] - out_dsp[j][l]);
+	if(err > max_err) max_err = err;
+      }
+    }
+    
+    fprintf(stdout, "%8u %14.1f %14.1f %14.1f %14.1f %14.1f %14.1f %9.2f %12.3e\n",
+	    N, 1.0e9*t_ref1, 1.0e9*t_dsp1, 1.0e9*t_ref2, 1.0e9*t_dsp2, 1.0e9*t_ref, 1.0e9*t_dsp,
+	    t_ref/t_dsp, max_err);
+    
+    for(j=0; j<AVG_FACTOR; ++j) {
+      free(out_ref[j]);
+      free(out_dsp[j]);
+    }
+    free(iq_buf);
+  }
+  
+  fprintf(stdout, "\nShift, scaling and dB conversion of one FFT output\n");
+  fprintf(stdout, "%8s %14s %14s %9s %12s\n",
+	  "N", "reference[ns]", "kernel[ns]", "speedup", "max_error");
+  
+  for(log2_N=LOG2_FFT_SIZE_MIN; log2_N<=LOG2_FFT_SIZE_MAX; ++log2_N) {
+    N = 1<<log2_N;
+    
+    // Random spectrum, magnitudes spanning the dB range including the lower limit
+    X = (float *) malloc(2*N*sizeof(float));
+    for(l=0; l<2*N; ++l)
+      X[l] = N * ((rand() & 1) ? 1 : -1) * powf(10.f, -6.f * rand() / RAND_MAX) * rand() / RAND_MAX;
+    post_ref = (float *) malloc(N*sizeof(float));
+    post_dsp = (float *) malloc(N*sizeof(float));
+    
+    t_ref = bench_post(reference_post, post_ref, X, N);
+    t_dsp = bench_post(DSP_power_db, post_dsp, X, N);
+    
+    // Compare results
+    max_err = 0;
+    for(l=0; l<N; ++l) {
+      err = fabs(post_ref[l] - post_dsp[l]);
+      if(err > max_err) max_err = err;
+    }
+    
+    fprintf(stdout, "%8u %14.1f %14.1f %9.2f %12.3e\n",
+	    N, 1.0e9*t_ref, 1.0e9*t_dsp, t_ref/t_dsp, max_err);
+    
+    free(X);
+    free(post_ref);
+    free(post_dsp);
+  }
+  
+  DSP_release_windows();
+  
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/FFT.h"
+#include "../include/DSP.h"
+
+#define LOG2_FFT_SIZE_MIN 8
+#define LOG2_FFT_SIZE_MAX 20
+#define BATCHSIZE_MAX 64
+#define MAX_BATCH_SAMPLES (1<<22)
+#define MIN_BENCH_TIME 0.1
+
+/*
+ * elapsed - seconds between two time stamps
+ */
+static double elapsed(const struct timespec *tstart, const struct timespec *tend) {
+  return ((double)tend->tv_sec + 1.0e-9*tend->tv_nsec) - ((double)tstart->tv_sec + 1.0e-9*tstart->tv_nsec);
+}
+
+/*
+ * bench_forward - average run time of one batch of forward FFTs in seconds, including input
+ * preparation and post-processing
+ */
+static double bench_forward(FFT_Context *ctx, float **in, float **out) {
+  long runs, r;
+  struct timespec tstart, tend;
+  
+  // Double the number of runs until the minimum benchmark time is reached
+  for(runs=1; ; runs=runs*2) {
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+    for(r=0; r<runs; ++r) FFT_forward(ctx, in, out);
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+    if(elapsed(&tstart, &tend) >= MIN_BENCH_TIME) break;
+  }
+  
+  return elapsed(&tstart, &tend) / runs;
+}
+
+/*
+ * bench_post - average run time of post-processing one FFT output in seconds, i.e. the share of
+ * FFT_forward spent on shift, scaling and dB conversion
+ */
+static double bench_post(float *out, const float *X, unsigned int N) {
+  long runs, r;
+  struct timespec tstart, tend;
+  
+  // Double the number of runs until the minimum benchmark time is reached
+  for(runs=1; ; runs=runs*2) {
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+    for(r=0; r<runs; ++r) DSP_power_db(out, X, N);
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+    if(elapsed(&tstart, &tend) >= MIN_BENCH_TIME) break;
+  }
+  
+  return elapsed(&tstart, &tend) / runs;
+}
+
+int main(int argc, char *argv[]) {
+  int i, log2_N, batchsize;
+  unsigned int l, N;
+  float *in[BATCHSIZE_MAX], *out[BATCHSIZE_MAX];
+  double t_fwd, t_post;
+  FFT_Context *ctx;
+  
+  fprintf(stdout, "Forward FFT including input preparation and post-processing, backend: %s\n",
+	  FFT_backend());
+  fprintf(stdout, "Batches of more than %d samples are skipped\n", MAX_BATCH_SAMPLES);
+  fprintf(stdout, "%8s %6s %16s %10s %14s %14s\n",
+	  "N", "batch", "transform[ns]", "MS/s", "fft[ns]", "post[ns]");
+  
+  for(log2_N=LOG2_FFT_SIZE_MIN; log2_N<=LOG2_FFT_SIZE_MAX; ++log2_N) {
+    N = 1<<log2_N;
+    
+    // Random windowed segments
+    for(i=0; i<BATCHSIZE_MAX; ++i) {
+      in[i] = (float *) malloc(2*N*sizeof(float));
+      out[i] = (float *) malloc(N*sizeof(float));
+      for(l=0; l<2*N; ++l) in[i][l] = (rand() & 0xff) - 127.5f;
+    }
+    
+    // Post-processing cost per transform, independent of the batch size
+    t_post = bench_post(out[0], in[0], N);
+    
+    for(batchsize=1; batchsize<=BATCHSIZE_MAX && N*batchsize<=MAX_BATCH_SAMPLES; batchsize=2*batchsize) {
+      // Fresh context per batch size, so that only one plan is held at a time
+      ctx = FFT_initialize();
+      FFT_prepare(ctx, log2_N, batchsize);
+      t_fwd = bench_forward(ctx, in, out) / batchsize;
+      FFT_release(ctx);
+      fprintf(stdout, "%8u %6d %16.1f %10.2f %14.1f %14.1f\n",
+	      N, batchsize, 1.0e9*t_fwd, 1.0e-6*N/t_fwd, 1.0e9*(t_fwd-t_post), 1.0e9*t_post);
+    }
+    
+    for(i=0; i<BATCHSIZE_MAX; ++i) {
+      free(in[i]);
+      free(out[i]);
+    }
+  }
+  
+  return 0;
+}
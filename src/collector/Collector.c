@@ -28,6 +28,8 @@
 #include <assert.h>
 #include <unistd.h>
 #include <math.h>
+#include <time.h>
+#include <errno.h>
 
 #include "../include/UTI.h"
 #include "../include/THR.h"
@@ -38,6 +40,7 @@
 #define DEFAULT_THREAD_POOL_SIZE 25
 #define DEFAULT_FILE_TIME 3600
 #define DEFAULT_FILE_PATH_STR "dat/"
+#define DEFAULT_STATS_PERIOD 0
 
 #define THR_COLLECTOR 0
 #define THR_RECEPTION 1
@@ -51,6 +54,7 @@ typedef struct {
   unsigned int portnumber;
   unsigned int thread_pool_size;
   unsigned int file_time;
+  unsigned int stats_period;
   char         *file_path_str;
 } CollectorCTX;
 
@@ -58,6 +62,7 @@ typedef struct {
   Thread         *thread;
   TCP_Connection *tcp_c;
   unsigned int   file_time;
+  unsigned int   stats_period;		// Seconds between dumps of the queue counters
   char           *file_path_str;
 } ReceptionCTX;
 
@@ -150,7 +155,7 @@ int main(int argc, char *argv[]) {
   // Parse arguments and options
   void parse_args(int argc, char *argv[]) {
     int opt;
-    const char *options = "hp:t:f:";
+    const char *options = "hp:t:f:P:";
     
     // Option arguments
     while((opt = getopt(argc, argv, options)) != -1) {
@@ -166,6 +171,9 @@ int main(int argc, char *argv[]) {
 	case 'f':
 	  coll_ctx->file_path_str = optarg;
 	  break;
+	case 'P':
+	  coll_ctx->stats_period = atol(optarg);
+	  break;
 	default:
 	  goto usage;
       }
@@ -180,6 +188,7 @@ int main(int argc, char *argv[]) {
 	"  [-h]\n"
 	"  [-p <thread_pool_size>]\n"
 	"  [-t <file_time>] [-f <file_path>]\n"
+	"  [-P <stats_period>]\n"
 #if defined(APACHE_KAFKA)
 	"  [-m] <hostname1>:<portnumber1>,...,<hostnameN>:<portnumberN>[#bandwidth]\n"
 	"  [-u] <topic>\n"
@@ -193,11 +202,15 @@ int main(int argc, char *argv[]) {
 	"  -p <thread_pool_size>    Maximal number of simultaneous connections [default=%u]\n"
 	"  -t <file_time>           Time in seconds after which to split files [default=%u]\n"
 	"  -f <file_path>           Path to folder where collected data can be stored [default=%s]\n"
+	"  -P <stats_period>        Period in seconds to print queue counters per connection [default=%u]\n"
+	"                             i.e. items in/out, occupancy and time blocked per queue\n"
+	"                             0 for no periodic counters\n"
 	"",
 	argv[0],
 	coll_ctx->thread_pool_size,
 	coll_ctx->file_time,
-	coll_ctx->file_path_str);
+	coll_ctx->file_path_str,
+	coll_ctx->stats_period);
       exit(1);
     } else {
       coll_ctx->portnumber = atol(argv[optind]);
@@ -209,6 +222,7 @@ int main(int argc, char *argv[]) {
   coll_ctx->thread_pool_size = DEFAULT_THREAD_POOL_SIZE;
   coll_ctx->file_time = DEFAULT_FILE_TIME;
   coll_ctx->file_path_str = DEFAULT_FILE_PATH_STR;
+  coll_ctx->stats_period = DEFAULT_STATS_PERIOD;
   parse_args(argc, argv);
   coll_ctx->thread_pool = QUE_initialize(coll_ctx->thread_pool_size);
   THR_initialize(&(coll_ctx->thread), THR_COLLECTOR);
@@ -221,6 +235,7 @@ int main(int argc, char *argv[]) {
     recp_ctx[i]->tcp_c = NULL;
     recp_ctx[i]->file_time = coll_ctx->file_time;
     recp_ctx[i]->file_path_str = coll_ctx->file_path_str;
+    recp_ctx[i]->stats_period = coll_ctx->stats_period;
     THR_initialize(&(recp_ctx[i]->thread), THR_RECEPTION+i);
     // Initialize reception arguments
     recp_arg = (ReceptionARG *) malloc(sizeof(ReceptionARG));
@@ -252,15 +267,8 @@ int main(int argc, char *argv[]) {
   signal(SIGINT, terminate);
   
   while(1) {
-    // Wait for thread pool not being empty
-    pthread_mutex_lock(coll_ctx->thread_pool->mut);
-    while(coll_ctx->thread_pool->empty) {
-      pthread_cond_wait(coll_ctx->thread_pool->notEmpty, coll_ctx->thread_pool->mut);
-    }
-    // Pull thread out of the pool
+    // Pull thread out of the pool, waits while all threads are serving requests
     r_ctx = (ReceptionCTX *) QUE_remove(coll_ctx->thread_pool);
-    pthread_mutex_unlock(coll_ctx->thread_pool->mut);
-    pthread_cond_signal(coll_ctx->thread_pool->notFull);
     
     // Accept incoming TCP connections
 #if defined(VERBOSE)
@@ -299,6 +307,31 @@ static void* reception(void *args) {
   StoringCTX           *stor_ctx;
   StoringARG           *stor_arg;
   
+  Thread               *stats_thread = NULL;
+  char                 q_decmpr_name[STR_LEN], q_stor_name[STR_LEN];
+  
+  /*! Print the counters of the data processing queues every stats_period seconds until asked to
+   *  terminate
+   */
+  void* statistics(void *args) {
+    struct timespec deadline;
+    
+    pthread_mutex_lock(stats_thread->lock);
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    while(stats_thread->is_running) {
+      deadline.tv_sec += recp_ctx->stats_period;
+      while(stats_thread->is_running &&
+	    pthread_cond_timedwait(stats_thread->awake, stats_thread->lock, &deadline) != ETIMEDOUT);
+      if(stats_thread->is_running) {
+	QUE_print_stats(q_decmpr, q_decmpr_name, stderr);
+	QUE_print_stats(q_stor, q_stor_name, stderr);
+      }
+    }
+    pthread_mutex_unlock(stats_thread->lock);
+    
+    pthread_exit(NULL);
+  }
+  
   // Parse arguments
   recp_arg = (ReceptionARG *) args;
   coll_ctx = (CollectorCTX *) recp_arg->coll_ctx;
@@ -325,8 +358,8 @@ static void* reception(void *args) {
     
     // Initialize data processing queues
     q_size = 1000;
-    q_decmpr = QUE_initialize(q_size);
-    q_stor = QUE_initialize(q_size);
+    q_decmpr = QUE_initialize_spsc(q_size);
+    q_stor = QUE_initialize_spsc(q_size);
     
     // Initialize data processing contexts
     decmpr_ctx = (DecompressionCTX *) malloc(sizeof(DecompressionCTX));
@@ -356,6 +389,12 @@ static void* reception(void *args) {
     // Start data processing threads
     pthread_create(decmpr_ctx->thread->fd, NULL, decompression, decmpr_arg);
     pthread_create(stor_ctx->thread->fd, NULL, storing, stor_arg);
+    if(recp_ctx->stats_period > 0) {
+      snprintf(q_decmpr_name, STR_LEN, "q_decmpr %u", recp_ctx->thread->id);
+      snprintf(q_stor_name, STR_LEN, "q_stor %u", recp_ctx->thread->id);
+      THR_initialize(&stats_thread, recp_ctx->thread->id);
+      pthread_create(stats_thread->fd, NULL, statistics, NULL);
+    }
     
     
     // Serve request
@@ -395,18 +434,8 @@ static void* reception(void *args) {
       iout->data_size = data_size;
       iout->data = payload_buf;
       
-      // Wait for output queue not being full
-      pthread_mutex_lock(q_decmpr->mut);
-      while(q_decmpr->full) {
-	pthread_cond_wait(q_decmpr->notFull, q_decmpr->mut);
-#if defined(VERBOSE) || defined(VERBOSE_RECP)
-	fprintf(stderr, "[RECP] ID:\t%u\t QA full.\n", recp_ctx->thread->id);
-#endif
-      }
-      // Write item to output queue
+      // Write item to output queue, waits while the queue is full
       QUE_insert(q_decmpr, iout);
-      pthread_mutex_unlock(q_decmpr->mut);
-      pthread_cond_signal(q_decmpr->notEmpty);
 #if defined(VERBOSE) || defined(VERBOSE_RECP)
       fprintf(stderr, "[RECP] ID:\t%u\t Push item.\n", recp_ctx->thread->id);
 #endif
@@ -415,16 +444,25 @@ static void* reception(void *args) {
     }
     
     // Signal that we are done and no further items will appear in the queue
-    pthread_mutex_lock(q_decmpr->mut);
-    q_decmpr->exit = 1;
-    pthread_cond_signal(q_decmpr->notEmpty);
-    pthread_cond_signal(q_decmpr->notFull);
-    pthread_mutex_unlock(q_decmpr->mut);
+    QUE_close(q_decmpr);
     
     // Join data processing threads
     pthread_join(*(decmpr_ctx->thread->fd), NULL);
     pthread_join(*(stor_ctx->thread->fd), NULL);
     
+    // Terminate statistics thread and print the final counters
+    if(stats_thread != NULL) {
+      pthread_mutex_lock(stats_thread->lock);
+      stats_thread->is_running = 0;
+      pthread_cond_signal(stats_thread->awake);
+      pthread_mutex_unlock(stats_thread->lock);
+      pthread_join(*(stats_thread->fd), NULL);
+      THR_release(stats_thread);
+      stats_thread = NULL;
+      QUE_print_stats(q_decmpr, q_decmpr_name, stderr);
+      QUE_print_stats(q_stor, q_stor_name, stderr);
+    }
+    
     // Free output queues
     free(decmpr_arg->qsout);
     free(stor_arg->qsout);
@@ -459,18 +497,8 @@ static void* reception(void *args) {
     
     // END SERVING REQUEST
 
-    // Wait for thread pool not being full
-    pthread_mutex_lock(coll_ctx->thread_pool->mut);
-    while(coll_ctx->thread_pool->full) {
-#if defined(VERBOSE) || defined(VERBOSE_RECP)
-      fprintf(stderr, "[RECP] ID:\t%u\t Thread poll full.\n", recp_ctx->thread->id);
-#endif
-      pthread_cond_wait(coll_ctx->thread_pool->notFull, coll_ctx->thread_pool->mut);
-    }
     // Reinsert thread to pool
     QUE_insert(coll_ctx->thread_pool, recp_ctx);
-    pthread_mutex_unlock(coll_ctx->thread_pool->mut);
-    pthread_cond_signal(coll_ctx->thread_pool->notEmpty);    
   }
 
 #if defined(VERBOSE) || defined(VERBOSE_RECP)
@@ -504,7 +532,7 @@ static void* decompression(void *args) {
   
   size_t k, qsout_cnt;
   Queue *qin, **qsout;
-  Item *iin, *iout, *nout;
+  Item *iin, *iout;
   
   // Parse arguments
   decmpr_arg = (DecompressionARG *) args;
@@ -514,22 +542,10 @@ static void* decompression(void *args) {
   qsout_cnt = decmpr_arg->qsout_cnt;
   
   while(1) {
-    // Wait for input queue not being empty
-    pthread_mutex_lock(qin->mut);
-    while(qin->empty) {
-      // No more input is coming to this queue
-      if(qin->exit) {
-	pthread_mutex_unlock(qin->mut);
-	goto EXIT;
-      }
-      // Wait for more input coming to this queue
-      pthread_cond_wait(qin->notEmpty, qin->mut);
-    }
-    
-    // Read item from input queue
+    // Read item from input queue, waits while the queue is empty
     iin = (Item *) QUE_remove(qin);
-    pthread_mutex_unlock(qin->mut);
-    pthread_cond_signal(qin->notFull);
+    // No more input is coming to this queue
+    if(iin == NULL) goto EXIT;
     
     reduced_fft_size = iin->reduced_fft_size;
     
@@ -570,51 +586,36 @@ static void* decompression(void *args) {
     
     // Unmarshalling data
     iout = iin;
+    iout->data_size = 0;
+    iout->data = NULL;
     iout->Fc = ntohl(dst_buf[0]);
     iout->Ts_sec = ntohl(dst_buf[1]);
     iout->Ts_usec = ntohl(dst_buf[2]);
     iout->freq_res = unpack754_32(ntohl(dst_buf[3]));
     
-    iout->samples = (float *) malloc(reduced_fft_size*sizeof(float));
+    iout->samples_size = reduced_fft_size*sizeof(float);
+    iout->samples = (float *) malloc(iout->samples_size);
     for(i=0; i<reduced_fft_size; ++i) iout->samples[i] = unpack754_32(ntohl(dst_buf[4+i]));
     
     // Single output queue
     if(qsout_cnt == 1) {
-      // Wait for output queue not being full
-      pthread_mutex_lock(qsout[0]->mut);
-      while(qsout[0]->full) pthread_cond_wait(qsout[0]->notFull, qsout[0]->mut);
-      // Write item to output queue
+      // Write item to output queue, waits while the queue is full
       QUE_insert(qsout[0], iout);
-      pthread_mutex_unlock(qsout[0]->mut);
-      pthread_cond_signal(qsout[0]->notEmpty);
     }
     // Multiple output queues
     else {
-      // Put item to output queues
+      // Share item with the output queues, one reference per queue
+      ITE_retain(iout, qsout_cnt-1);
       for(k=0; k<qsout_cnt; ++k) {
-	// Wait for output queue not being full
-	pthread_mutex_lock(qsout[k]->mut);
-	while(qsout[k]->full) pthread_cond_wait(qsout[k]->notFull, qsout[k]->mut);
-	nout = ITE_copy(iout);
-	// Write item to output queue
-	QUE_insert(qsout[k], nout);
-	pthread_mutex_unlock(qsout[k]->mut);
-	pthread_cond_signal(qsout[k]->notEmpty);
+	// Write item to output queue, waits while the queue is full
+	QUE_insert(qsout[k], iout);
       }
-      // Release item
-      ITE_free(iout);
     }
   }
 EXIT:
   
   // Signal that we are done and no further items will appear in the queues
-  for(k=0; k<qsout_cnt; ++k) {
-    pthread_mutex_lock(qsout[k]->mut);
-    qsout[k]->exit = 1;
-    pthread_cond_signal(qsout[k]->notEmpty);
-    pthread_cond_signal(qsout[k]->notFull);
-    pthread_mutex_unlock(qsout[k]->mut);
-  }
+  for(k=0; k<qsout_cnt; ++k) QUE_close(qsout[k]);
   
   if(dst_buf != NULL) free(dst_buf);
   
@@ -669,22 +670,10 @@ static void* storing(void *args) {
   
   // Store full plain-text data to file
   while(1) {
-    // Wait for input queue not being empty
-    pthread_mutex_lock(qin->mut);
-    while(qin->empty) {
-      // No more input is coming to this queue
-      if(qin->exit) {
-	pthread_mutex_unlock(qin->mut);
-	goto EXIT;
-      }
-      // Wait for more input coming to this queue
-      pthread_cond_wait(qin->notEmpty, qin->mut);
-    }
-    
-    // Read item from input queue
+    // Read item from input queue, waits while the queue is empty
     iin = (Item *) QUE_remove(qin);
-    pthread_mutex_unlock(qin->mut);
-    pthread_cond_signal(qin->notFull);
+    // No more input is coming to this queue
+    if(iin == NULL) goto EXIT;
     
     center_freq = iin->Fc;
     reduced_fft_size = iin->reduced_fft_size;
@@ -734,8 +723,7 @@ static void* storing(void *args) {
     }
     
     // Release item
-    free(samples);
-    free(iin);
+    ITE_free(iin);
 
   }
   
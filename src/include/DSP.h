@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_H /* Digital Signal Processing */
+#define DSP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define RECTANGULAR_WINDOW              0
+#define HANNING_WINDOW                  1
+#define BLACKMAN_HARRIS_WINDOW          2
+#define PFB_WINDOW                      3
+
+// Number of polyphase filter bank taps per FFT bin
+#define DSP_PFB_TAPS                    4
+
+// Zoom: maximal decimation (log2) and passband edge in cycles per sample before the final
+// decimation by two, i.e. the inner 4*DSP_ZOOM_PASSBAND of the zoomed band are free of aliases
+#define DSP_ZOOM_MAX_LOG2_DECIM         12
+#define DSP_ZOOM_PASSBAND               0.2
+
+/*!
+ * Get number of taps of a windowing function, i.e. a windowed segment of an N-point FFT spans
+ * taps*N samples
+ * 
+ * Plain windows have a single tap. The polyphase filter bank (PFB_WINDOW) weights DSP_PFB_TAPS*N
+ * samples with a windowed sinc prototype filter and folds them into N samples, which gives flatter
+ * bin responses and much lower spectral leakage than a window of the same FFT size.
+ * 
+ * \param window_fun_id Windowing function
+ * \return Number of taps
+ */
+unsigned int DSP_window_taps(int window_fun_id);
+
+/*!
+ * Get window coefficient table
+ * 
+ * The table is computed on first use and cached for subsequent calls with the same windowing
+ * function and length. Coefficients are interleaved to match I/Q streams, i.e. the table has length
+ * 2*taps*N and entries 2n and 2n+1 both hold the coefficient for sample n.
+ * 
+ * \param window_fun_id Windowing function
+ * \param N Number of complex samples per tap, i.e. the FFT size
+ * \return Window coefficient table, valid until DSP_release_windows is called
+ */
+const float* DSP_window_table(int window_fun_id, unsigned int N);
+
+/*!
+ * Estimate DC bias of overlapping segments
+ * 
+ * Segment j starts at complex sample j*step and has length N. Overlapping segments are handled with
+ * a sliding sum, so that the I/Q stream is read about once, independent of the overlap.
+ * 
+ * \param means Buffer to store 2*cnt interleaved I/Q means
+ * \param iq Interleaved 8-bit I/Q stream
+ * \param N Number of complex samples per segment
+ * \param step Number of complex samples between the starts of consecutive segments
+ * \param cnt Number of segments
+ */
+void DSP_segment_means(float *means, const uint8_t *iq, unsigned int N, unsigned int step,
+		       unsigned int cnt);
+
+/*!
+ * Convert, remove DC bias and apply window to an interleaved I/Q segment of taps*N samples, and
+ * fold the taps into N samples, i.e. out[n] = sum_p (iq[n+p*N]-mean)*window[n+p*N]
+ * 
+ * One pass over the segment given its mean, which takes a separate pass over the hop, e.g. with
+ * DSP_segment_means. Vectorized with NEON, AVX2 or SSE2 where available.
+ * 
+ * \param out Buffer to store the 2N windowed floats
+ * \param iq Interleaved 8-bit I/Q stream
+ * \param window Window coefficient table as returned by DSP_window_table
+ * \param N Number of complex samples per tap, i.e. the FFT size
+ * \param taps Number of taps as returned by DSP_window_taps
+ * \param mean Interleaved I/Q mean of the segment, e.g. as estimated by DSP_segment_means
+ */
+void DSP_window_segment(float *out, const uint8_t *iq, const float *window, unsigned int N,
+			unsigned int taps, const float *mean);
+
+/*!
+ * Shift, scale and convert an N-point FFT output to magnitudes squared on a dB scale
+ * 
+ * Computes out[j] = max(10*log10(|X[(j+N/2) mod N]|^2 / N^2), -100) in a single pass, vectorized
+ * with NEON, AVX2 or SSE2 where available. The logarithm approximation contributes an absolute
+ * error below 6e-6 dB. Including single-precision rounding, outputs are within 5e-5 dB of the
+ * exact value (the benchmark reports the observed error).
+ * 
+ * \param out Buffer to store the N dB values
+ * \param X N interleaved complex FFT outputs
+ * \param N FFT size
+ */
+void DSP_power_db(float *out, const float *X, unsigned int N);
+
+/*!
+ * Shift an N-point FFT output and add its magnitudes squared to an accumulator, e.g. to average the
+ * linear power of several segments (Welch's method)
+ * 
+ * Computes acc[j] += |X[(j+N/2) mod N]|^2, vectorized with NEON, AVX2 or SSE2 where available.
+ * 
+ * \param acc N accumulated magnitudes squared
+ * \param X N interleaved complex FFT outputs
+ * \param N FFT size
+ */
+void DSP_power_accumulate(float *acc, const float *X, unsigned int N);
+
+/*!
+ * Scale and convert linear power to a dB scale
+ * 
+ * Computes out[j] = max(10*log10(scale*P[j]), -100) with the same accuracy as DSP_power_db.
+ * 
+ * \param out Buffer to store the N dB values, may be P
+ * \param P N linear power values, e.g. as accumulated by DSP_power_accumulate
+ * \param N Number of values
+ * \param scale Scaling factor, e.g. 1/(N^2*cnt) for the mean of cnt accumulated FFT outputs
+ */
+void DSP_db(float *out, const float *P, unsigned int N, float scale);
+
+/*!
+ * Number of output samples DSP_zoom produces from n input samples
+ * 
+ * \param n Number of complex input samples
+ * \param log2_decim Binary logarithm of the decimation factor, 1 to DSP_ZOOM_MAX_LOG2_DECIM
+ * \return Number of complex output samples
+ */
+unsigned int DSP_zoom_length(unsigned int n, unsigned int log2_decim);
+
+/*!
+ * Number of input samples DSP_zoom needs to produce M output samples
+ * 
+ * \param M Number of complex output samples, at least one
+ * \param log2_decim Binary logarithm of the decimation factor, 1 to DSP_ZOOM_MAX_LOG2_DECIM
+ * \return Number of complex input samples
+ */
+unsigned int DSP_zoom_input(unsigned int M, unsigned int log2_decim);
+
+/*!
+ * Size of the scratch buffer DSP_zoom needs for n input samples
+ * 
+ * \param n Number of complex input samples
+ * \param log2_decim Binary logarithm of the decimation factor, 1 to DSP_ZOOM_MAX_LOG2_DECIM
+ * \return Number of floats
+ */
+unsigned int DSP_zoom_scratch(unsigned int n, unsigned int log2_decim);
+
+/*!
+ * Zoom into a sub-band of an interleaved I/Q stream (decimating channelizer)
+ * 
+ * Removes the DC bias, mixes the sub-band centered at 'shift' down to zero and decimates by
+ * D = 2^log2_decim: a CIC decimator of order 4 decimates by D/2 in fixed-point arithmetic, a 63-tap
+ * FIR filter compensates its passband droop and decimates by another factor of two. The first
+ * outputs, which depend on samples before the start of the stream, are dropped. The FIR taps are
+ * computed on first use and cached with the window tables.
+ * 
+ * \param out Buffer to store the 2*DSP_zoom_length(n, log2_decim) interleaved output floats
+ * \param scratch Buffer of DSP_zoom_scratch(n, log2_decim) floats for the CIC decimator outputs
+ * \param iq Interleaved 8-bit I/Q stream
+ * \param n Number of complex input samples
+ * \param mean Interleaved I/Q mean of the stream
+ * \param shift Center of the sub-band in cycles per input sample, -0.5 to 0.5
+ * \param log2_decim Binary logarithm of the decimation factor, 1 to DSP_ZOOM_MAX_LOG2_DECIM
+ * \return Number of complex output samples
+ */
+unsigned int DSP_zoom(float *out, float *scratch, const uint8_t *iq, unsigned int n,
+		      const float *mean, double shift, unsigned int log2_decim);
+
+/*!
+ * Apply window to an interleaved complex segment of taps*N samples and fold the taps into N
+ * samples, e.g. to window the output of DSP_zoom
+ * 
+ * \param out Buffer to store the 2N windowed floats
+ * \param x 2*taps*N interleaved floats
+ * \param window Window coefficient table as returned by DSP_window_table
+ * \param N Number of complex samples per tap, i.e. the FFT size
+ * \param taps Number of taps as returned by DSP_window_taps
+ */
+void DSP_window_samples(float *out, const float *x, const float *window, unsigned int N,
+			unsigned int taps);
+
+/*!
+ * Release all cached window coefficient tables and zoom filters
+ */
+void DSP_release_windows();
+
+#endif /* DSP_H */
@@ -23,12 +23,30 @@
 #include <stdint.h>
 
 /*!
- * Initialize FFT resources
+ * FFT context
+ * 
+ * A context owns the FFT resources (plans, buffers, GPU memory) prepared for a set of FFT sizes and
+ * batch sizes. Contexts are independent of each other, so each thread can run forward transforms on
+ * its own context in parallel. A single context must not be used by multiple threads at once.
+ */
+typedef struct FFT_Context FFT_Context;
+
+/*!
+ * Create FFT context without any prepared resources
+ * 
+ * \return FFT context
+ */
+FFT_Context* FFT_initialize();
+
+/*!
+ * Prepare FFT resources for subsequent forward transforms, or reuse them if already prepared for
+ * the same FFT size and batch size. Prepared resources are kept in a small cache until the context
+ * is released, so switching back and forth between FFT sizes does not replan.
  * 
  * \param log2_N Binary logarithm of the FFT size N
  * \param batchsize Number of FFT jobs to process as batch
  */
-void FFT_initialize(int log2_N, int batchsize);
+void FFT_prepare(FFT_Context *ctx, int log2_N, int batchsize);
 
 /*!
  * Perform forward FFT. The outputs are scaled with factor 1/N and given as magnitudes squared on a
@@ -41,11 +59,49 @@ void FFT_initialize(int log2_N, int batchsize);
  * 	      provide space for storing N output values. The frequency-domain values are shifted
  * 	      and converted to a dB scale.
  */
-void FFT_forward(float **in, float **out);
+void FFT_forward(FFT_Context *ctx, float **in, float **out);
+
+/*!
+ * Perform forward FFT on a partial batch, using the resources of the full batch size. Outputs
+ * are computed as in FFT_forward.
+ * 
+ * \param in An array of references pointing to n input buffers
+ * \param out An array of references pointing to n output buffers
+ * \param n Number of FFT jobs, at most BATCHSIZE
+ */
+void FFT_forward_n(FFT_Context *ctx, float **in, float **out, int n);
 
 /*!
- * Release FFT resources
+ * Perform forward FFT on a partial batch and accumulate the outputs' linear power instead of
+ * converting them to dB. The outputs are shifted but not scaled, i.e. |X|^2 is added to the
+ * accumulators.
+ * 
+ * \param in An array of references pointing to n input buffers
+ * \param acc An array of references pointing to n accumulators of N values each. References may
+ * 	      point to the same accumulator, e.g. to sum up the segments of a hop.
+ * \param n Number of FFT jobs, at most BATCHSIZE
+ */
+void FFT_accumulate_n(FFT_Context *ctx, float **in, float **acc, int n);
+
+/*!
+ * Release FFT context and all its resources
+ */
+void FFT_release(FFT_Context *ctx);
+
+/*!
+ * Name of the FFT backend the module was built with
+ * 
+ * \return Backend name, e.g. "fftw3"
+ */
+const char* FFT_backend();
+
+/*!
+ * Load FFT wisdom, i.e. previously created plans, from file. Afterwards, plans are created with
+ * thorough (patient) planning, which is only done for plans not yet in the wisdom. Newly created
+ * plans are saved back to the file. Only supported by the FFTW3 backend.
+ * 
+ * \param file_name Wisdom file, created if it does not exist
  */
-void FFT_release();
+void FFT_load_wisdom(const char *file_name);
 
 #endif /* FFT_H */
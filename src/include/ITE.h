@@ -23,7 +23,50 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
+#define ITE_POOL_CLASSES 32	// Sample buffer size classes, one per FFT size (log2)
+
+/*!
+ * Reference counted buffer, e.g. a hop's interleaved I/Q stream shared by all its segments
+ */
+typedef struct Buffer {
+  void         *data;
+  size_t       size;
+  atomic_int   refcnt;
+  void         (*release)(struct Buffer *buf);	// Returns data to its owner, NULL to free it
+  void         *owner;
+} Buffer;
+
+/*!
+ * Free list of equally sized blocks
+ * 
+ * Any thread returns blocks by pushing onto the lock-free stack returned. Allocating threads pop
+ * from local, which takes over all of returned once it runs empty.
+ */
+typedef struct {
+  pthread_mutex_t   mut;	// Serializes allocating threads
+  void              *local;
+  _Atomic(void *)   returned;
+} PoolList;
+
+/*!
+ * Pool of items and sample buffers shared by the stages of a pipeline
+ */
+typedef struct {
+  PoolList        items;
+  PoolList        samples[ITE_POOL_CLASSES];	// Buffers of 1<<c floats
+  atomic_ulong    allocs;			// Number of allocations
+  atomic_ulong    saved;			// Number of allocations served from the free lists
+} Pool;
+
+/*!
+ * Item passed between the stages of a pipeline
+ * 
+ * Stages fan an item out to several output queues by reference. A shared item is immutable, a stage
+ * that modifies items takes exclusive ownership with ITE_unshare first.
+ */
 typedef struct {
   uint32_t     Fc;
   uint32_t     Ts_sec;
@@ -44,10 +87,102 @@ typedef struct {
   size_t       samples_size;
   float        freq_res;
   float        *samples;
+  Buffer       *iq_buf;		// Interleaved I/Q stream the segment is taken from
+  size_t       iq_offset;	// Offset of the segment in bytes
+  size_t       iq_size;		// Size of the segment in bytes
+  float        iq_mean[2];	// DC bias of the segment
+  uint64_t     seq;		// Sequence number, restores the order after parallel FFT workers
+  uint32_t     log2_decim;	// Zoom band: decimation (log2) of the I/Q stream, 0 if not zoomed
+  float        zoom_shift;	// Zoom band: center relative to the hop's center in cycles per sample
+  Pool         *pool;		// Pool the item and its samples are returned to, NULL if not pooled
+  atomic_int   refcnt;		// Number of references, one per queue or stage holding the item
 } Item;
 
 Item* ITE_init();
 Item* ITE_copy(const Item *it);
+
+/*!
+ * Drop a reference to the item, the last reference frees it
+ */
 void  ITE_free(Item *it);
 
+/*!
+ * Acquire cnt additional references to the item, e.g. one per additional output queue
+ * 
+ * \return Item
+ */
+Item* ITE_retain(Item *it, int cnt);
+
+/*!
+ * Take exclusive ownership of the item before modifying it
+ * 
+ * \return The item itself if not shared, otherwise a private copy and the reference to the item is
+ *         dropped
+ */
+Item* ITE_unshare(Item *it);
+
+/*!
+ * Initialize pool with empty free lists
+ * 
+ * \return Pool
+ */
+Pool* ITE_pool_init();
+
+/*!
+ * Initialize item from the pool, behaves like ITE_init when pool is NULL
+ * 
+ * Releasing the item with ITE_free returns it and its samples to the pool.
+ * 
+ * \return Item
+ */
+Item* ITE_pool_item(Pool *pool);
+
+/*!
+ * Allocate sample buffer from the pool, behaves like malloc when pool is NULL
+ * 
+ * Only buffers of a power of two number of floats are pooled.
+ * 
+ * \param size Size of the buffer in bytes
+ * \return Buffer
+ */
+float* ITE_pool_samples(Pool *pool, size_t size);
+
+/*!
+ * Release pool and all blocks on its free lists, all items must have been returned before
+ */
+void ITE_pool_release(Pool *pool);
+
+/*!
+ * Initialize buffer with a reference count of one
+ * 
+ * \param data Heap allocated data, ownership is taken by the buffer
+ * \param size Size of data in bytes
+ * \return Buffer
+ */
+Buffer* ITE_buffer_init(void *data, size_t size);
+
+/*!
+ * Initialize buffer with a reference count of one, whose data is handed back to its owner
+ * instead of being freed
+ * 
+ * \param data Data owned by 'owner'
+ * \param size Size of data in bytes
+ * \param release Called with the buffer when the last reference is dropped
+ * \param owner Owner of data, available to 'release' as buf->owner
+ * \return Buffer
+ */
+Buffer* ITE_buffer_init_owned(void *data, size_t size, void (*release)(Buffer *buf), void *owner);
+
+/*!
+ * Acquire an additional reference to the buffer
+ * 
+ * \return Buffer
+ */
+Buffer* ITE_buffer_retain(Buffer *buf);
+
+/*!
+ * Drop a reference to the buffer, the last reference frees it or hands its data back to its owner
+ */
+void ITE_buffer_release(Buffer *buf);
+
 #endif /* ITE_H */
\ No newline at end of file
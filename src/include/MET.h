@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MET_H /* Metrics */
+#define MET_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define MET_SUB_BITS 4					// Linear sub-buckets per power of two (log2)
+#define MET_SUB_CNT  (1<<MET_SUB_BITS)
+#define MET_BUCKETS  ((64-MET_SUB_BITS+1)*MET_SUB_CNT)	// Covers all 64-bit values
+#define MET_MAX      64					// Maximal number of metrics of each kind
+
+/*!
+ * Counter, updated with relaxed atomics by any number of threads
+ */
+typedef struct {
+  const char    *name;
+  atomic_ullong value;
+} Counter;
+
+/*!
+ * Log-linear histogram, updated with relaxed atomics by any number of threads
+ *
+ * Values below MET_SUB_CNT have a bucket each. Above, each power of two is split into MET_SUB_CNT
+ * linear buckets, i.e. a bucket is at most 1/MET_SUB_CNT of its lower bound wide.
+ */
+typedef struct {
+  const char    *name;
+  atomic_ullong count, sum, max;
+  atomic_ullong buckets[MET_BUCKETS];
+} Histogram;
+
+/*!
+ * Get the counter of the given name, registers it on first use
+ *
+ * Look metrics up once, e.g. when initializing a context, and keep the pointer. Metrics live until
+ * MET_release.
+ *
+ * \param name Name, e.g. "cmpr_bytes_in", not copied
+ * \return Counter, NULL if MET_MAX counters are registered
+ */
+Counter* MET_counter(const char *name);
+
+/*!
+ * Get the histogram of the given name, registers it on first use, see MET_counter
+ */
+Histogram* MET_histogram(const char *name);
+
+/*!
+ * Add v to counter
+ */
+void MET_add(Counter *c, uint64_t v);
+
+/*!
+ * Record value v, e.g. a duration in nanoseconds
+ */
+void MET_record(Histogram *h, uint64_t v);
+
+/*!
+ * Monotonic time in nanoseconds, to measure durations recorded with MET_record
+ */
+uint64_t MET_now();
+
+/*!
+ * Estimate the p-quantile of the recorded values, i.e. the midpoint of the bucket it falls into
+ *
+ * \param p Quantile between 0 and 1
+ * \return Estimate, 0 if no values have been recorded
+ */
+uint64_t MET_quantile(Histogram *h, double p);
+
+/*!
+ * Write a snapshot of all metrics, one line per metric
+ *
+ * Lines are of the form
+ *   T <seconds since UNIX epoch>.<microseconds>
+ *   C <name> <value>
+ *   H <name> <count> <sum> <max> <p50> <p90> <p99>
+ * Values are cumulative since the start, take differences of consecutive snapshots for rates.
+ */
+void MET_snapshot(FILE *f);
+
+/*!
+ * Start writing snapshots every period seconds
+ *
+ * \param f Stream to write to
+ * \param period Seconds between snapshots, 0 for no periodic snapshots
+ */
+void MET_start(FILE *f, unsigned int period);
+
+/*!
+ * Stop writing snapshots and write a last one
+ */
+void MET_stop();
+
+void MET_release();
+
+#endif /* MET_H */
\ No newline at end of file
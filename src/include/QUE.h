@@ -20,9 +20,15 @@
 #ifndef QUE_H /* Queues */
 #define QUE_H
 
+#include <stdio.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
+#define QUE_CACHE_LINE 64	// Separates the producer's and the consumer's data of lock-free queues
+#define QUE_MIN_SPIN   16	// Adaptive spinning before sleeping on lock-free queues
+#define QUE_MAX_SPIN   4096
+
 typedef struct {
   void **buf;
   int head, tail;
@@ -30,11 +36,112 @@ typedef struct {
   int size;
   pthread_mutex_t *mut;
   pthread_cond_t *notFull, *notEmpty;
+  
+  // Lock-free single producer, single consumer ring of size+1 slots
+  int spsc;
+  // Consumer's data
+  _Alignas(QUE_CACHE_LINE) atomic_uint rd;	// Next slot to remove
+  unsigned int rd_wr;				// Last seen wr
+  unsigned int rd_spin;				// Current spinning budget
+  // Consumer's counters, written by the consumer or under the lock
+  atomic_ulong out_cnt;				// Number of removed items
+  atomic_ulong empty_waits;			// Number of waits on an empty queue
+  atomic_ullong empty_ns;			// Time spent waiting on an empty queue
+  // Producer's data
+  _Alignas(QUE_CACHE_LINE) atomic_uint wr;	// Next slot to insert
+  unsigned int wr_rd;				// Last seen rd
+  unsigned int wr_spin;				// Current spinning budget
+  // Producer's counters, written by the producer or under the lock
+  atomic_ulong in_cnt;				// Number of inserted items
+  atomic_ulong full_waits;			// Number of waits on a full queue
+  atomic_ullong full_ns;			// Time spent waiting on a full queue
+  atomic_ulong occ_sum, occ_cnt;		// Occupancy summed over the insertions
+  atomic_uint high;				// High-water mark of the occupancy
+  // Sleeping, rarely written
+  _Alignas(QUE_CACHE_LINE) atomic_uint rd_sleeping, wr_sleeping;
+  atomic_uint rd_event, wr_event;		// Futex words, incremented to wake the sleeper
+  atomic_int closed;
 } Queue;
 
+/*!
+ * Snapshot of the counters of a queue
+ */
+typedef struct {
+  unsigned long items_in, items_out;
+  unsigned int  occupancy;		// Current number of items
+  unsigned int  high;			// High-water mark of the number of items
+  double        avg_occupancy;		// Mean number of items right after an insertion
+  unsigned long full_waits, empty_waits;
+  double        full_s, empty_s;	// Time in seconds producers/consumers waited
+} QueueStats;
+
+/*!
+ * Initialize queue protected by a mutex, any number of threads may insert and remove items
+ * 
+ * \param size Number of items the queue holds
+ * \return Queue
+ */
 Queue* QUE_initialize(int size);
+
+/*!
+ * Initialize lock-free queue for a single producer and a single consumer thread
+ * 
+ * Waiting threads spin for an adaptive number of iterations before they sleep on a futex.
+ * Several producers may share the queue as long as they serialize their insertions.
+ * 
+ * \param size Number of items the queue holds
+ * \return Queue
+ */
+Queue* QUE_initialize_spsc(int size);
+
+/*!
+ * Insert item, waits while the queue is full
+ */
 void QUE_insert(Queue *q, void *in);
+
+/*!
+ * Insert cnt items, waits while the queue is full
+ * 
+ * Items are moved in as many runs as the queue has free slots for, each run under a single lock or
+ * atomic publish. Consumers are woken when the queue was empty.
+ */
+void QUE_insert_many(Queue *q, void **in, int cnt);
+
+/*!
+ * Remove item, waits while the queue is empty
+ * 
+ * \return Item, NULL once the queue is closed and all items have been removed
+ */
 void* QUE_remove(Queue *q);
+
+/*!
+ * Remove up to max items, waits while the queue is empty
+ * 
+ * Removes whatever is available, under a single lock or atomic release. Producers are woken when
+ * the queue was full.
+ * 
+ * \return Number of items, 0 once the queue is closed and all items have been removed
+ */
+int QUE_remove_many(Queue *q, void **out, int max);
+
+/*!
+ * Signal that no further items will be inserted, wakes all waiting consumers
+ */
+void QUE_close(Queue *q);
+
+/*!
+ * Read the counters of the queue, safe while other threads use the queue
+ *
+ * Counters are updated with relaxed atomics and are only consistent with each other once the
+ * queue is idle.
+ */
+void QUE_stats(Queue *q, QueueStats *s);
+
+/*!
+ * Print the counters of the queue, i.e. throughput, occupancy and time blocked
+ */
+void QUE_print_stats(Queue *q, const char *name, FILE *f);
+
 void QUE_release(Queue *q);
 
 #endif /* QUE_H */
\ No newline at end of file
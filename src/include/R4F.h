@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef R4F_H /* Radix-4 Fast Fourier Transform */
+#define R4F_H
+
+#define R4F_MIN_LOG2_N 8
+#define R4F_MAX_LOG2_N 20
+
+/*!
+ * Built-in FFT plan
+ * 
+ * Holds the twiddle tables, the output permutation and the buffers for a batch of forward transforms
+ * of a given size. Job i reads its N interleaved complex inputs from in + 2*i*N and writes its
+ * outputs in natural order to out + 2*i*N. The input buffer is used as workspace and overwritten.
+ */
+typedef struct {
+  int          log2_N;
+  int          N;
+  int          batchsize;
+  float        *in, *out;
+  float        *twiddles;	// Twiddle factors of all radix-4 stages
+  float        *tw[R4F_MAX_LOG2_N+1];	// Twiddle factors of the stage with sub-transform size 2^l
+  unsigned int *perm;		// Input position of output n
+} R4F_Plan;
+
+/*!
+ * Create plan for forward transforms of size N = 2^log2_N
+ * 
+ * The transform is a decimation-in-frequency radix-4 FFT (with a single radix-2 stage if log2_N
+ * is odd). Sub-transforms are computed depth-first until they fit into the cache, the remaining
+ * stages are then computed block by block. Butterflies are vectorized with NEON, AVX2 or SSE2
+ * where available.
+ * 
+ * \param log2_N Binary logarithm of the FFT size, R4F_MIN_LOG2_N to R4F_MAX_LOG2_N
+ * \param batchsize Number of FFT jobs per batch
+ * \return Plan, or NULL if log2_N is not supported or memory is exhausted
+ */
+R4F_Plan* R4F_initialize(int log2_N, int batchsize);
+
+/*!
+ * Perform forward FFT on the first n jobs of the batch, X[k] = sum_j x[j]*exp(-2*pi*i*j*k/N)
+ * 
+ * \param p Plan
+ * \param n Number of FFT jobs, at most batchsize
+ */
+void R4F_forward(R4F_Plan *p, int n);
+
+/*!
+ * Release plan and its buffers
+ */
+void R4F_release(R4F_Plan *p);
+
+#endif /* R4F_H */
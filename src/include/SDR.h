@@ -23,13 +23,153 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <rtl-sdr.h>
 
-void SDR_initialize(rtlsdr_dev_t **dev, int dev_index);
-void SDR_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate);
-void SDR_set_gain(rtlsdr_dev_t *dev, float gain);
-void SDR_set_freq_correction(rtlsdr_dev_t *dev, int ppm_error);
-void SDR_retune(rtlsdr_dev_t *dev, uint32_t freq);
+#include "ITE.h"
+#include "MET.h"
+
+typedef struct SDR_Source SDR_Source;
+
+/*!
+ * Receives the samples of a stream, buf is only valid during the call
+ */
+typedef void (*SDR_StreamCallback)(unsigned char *buf, uint32_t len, void *ctx);
+
+/*!
+ * Sample source backend
+ * 
+ * A backend provides interleaved 8-bit I/Q streams, e.g. read from an RTL-SDR device or replayed
+ * from a recorded file. Operations that are not supported by a backend are silently ignored.
+ */
+typedef struct {
+  const char *name;
+  int        (*open)(SDR_Source *src, const char *arg);
+  void       (*set_sample_rate)(SDR_Source *src, uint32_t samp_rate);
+  void       (*set_gain)(SDR_Source *src, float gain);
+  void       (*set_freq_correction)(SDR_Source *src, int ppm_error);
+  void       (*retune)(SDR_Source *src, uint32_t freq);
+  void       (*read)(SDR_Source *src, uint8_t *iq_buf, int N);
+  int        (*stream)(SDR_Source *src, SDR_StreamCallback cb, void *ctx);	// Optional, until
+										// cancelled
+  void       (*cancel)(SDR_Source *src);	// Stops the stream, called from another thread
+  void       (*close)(SDR_Source *src);
+} SDR_Backend;
+
+/*! Sample Source
+ * 
+ * NOTE: Make sure to acquire the lock 'mut' before accessing the source. This guarantees mutual
+ * exclusive usage of the underlying device. Release the lock when finished.
+ */
+struct SDR_Source {
+  const SDR_Backend *backend;
+  void              *dev;
+  pthread_mutex_t   *mut;
+  int               streaming;	// Stream running, retuning must not flush the device buffer
+  unsigned int      settings;	// Changes of gain and frequency correction
+  Histogram         *m_samp_rate, *m_retune, *m_read;	// Time per operation, shared by all sources
+};
+
+/*!
+ * RTL-SDR backend. The open argument is the device index.
+ */
+extern const SDR_Backend SDR_RTLSDR_BACKEND;
+
+/*!
+ * Recorded I/Q file backend. The open argument is the path to a raw, interleaved 8-bit I/Q file
+ * (e.g. as recorded with rtl_sdr). The file is memory-mapped and replayed in a loop, ignoring
+ * tuning, as fast as it is read.
+ */
+extern const SDR_Backend SDR_FILE_BACKEND;
+
+/*!
+ * Hop acquired by the asynchronous acquisition engine
+ */
+typedef struct {
+  uint8_t        *buf;		// Interleaved I/Q stream
+  int            size;		// Allocated buffer size
+  int            len;		// Requested length of interleaved I/Q stream
+  uint32_t       samp_rate;	// Sampling rate in Hz
+  uint32_t       center_freq;	// Center frequency in Hz
+  struct timeval tv;		// Time stamp when acquisition completed
+} SDR_Hop;
+
+/*!
+ * Hop buffer returned by its consumers
+ */
+typedef struct {
+  uint8_t        *buf;
+  int            size;		// Usable buffer size
+} SDR_Spare;
+
+/*!
+ * Free list of hop buffers
+ * 
+ * Buffers handed out return to the free list when their last reference is dropped, so that hops of
+ * the same length reuse the same memory. Buffers may outlive SDR_buffers_release, the last returned
+ * buffer then frees the free list.
+ */
+typedef struct {
+  SDR_Spare       *spares;
+  int             cnt, cap;
+  int             out;		// Number of buffers handed out and not yet returned
+  int             released;
+  pthread_mutex_t *mut;
+} SDR_Buffers;
+
+/*!
+ * Asynchronous acquisition engine
+ * 
+ * A dedicated acquisition thread retunes the source and reads the submitted hops into a ring of
+ * pre-allocated buffers. This allows the caller to process hop N while hop N+1 is being
+ * transferred. Hops are acquired and handed out in the order they were submitted. Detached hop
+ * buffers return to a free list when their last reference is dropped and are reused by later
+ * submissions.
+ * 
+ * Backends that stream (rtlsdr_read_async) keep a single stream with a fixed set of USB transfers
+ * running across the sweep, on a thread of its own. The acquisition thread retunes while the
+ * stream runs and hands the next hop to the stream callback, which drops the samples still in
+ * flight or taken while the tuner settles, and copies the following ones into the hop buffer.
+ * The stream is stopped to change the sampling rate and when no hop was submitted for a while.
+ */
+typedef struct {
+  SDR_Source      *src;
+  SDR_Hop         *hops;
+  int             size;		// Number of hop buffers in the ring
+  int             submit;	// Index of next hop to submit
+  int             acquire;	// Index of next hop to acquire
+  int             consume;	// Index of next hop to consume
+  int             pending;	// Number of hops submitted but not yet acquired
+  int             ready;	// Number of hops acquired but not yet consumed
+  int             used;		// Number of hops submitted but not yet recycled
+  int             exit;
+  SDR_Buffers     *bufs;	// Free list the detached hop buffers return to
+  uint32_t        samp_rate;	// Current sampling rate of the source
+  uint32_t        center_freq;	// Current center frequency of the source
+  unsigned int    settings;	// Settings of the source the stream was tuned with
+  SDR_Hop         *fill_hop;	// Hop filled by the stream, NULL while samples are discarded
+  int             fill;		// Bytes of fill_hop filled so far
+  int             drop;		// Bytes to drop before filling fill_hop
+  int             stream_done;	// Stream returned, i.e. cancelled or failed
+  pthread_t       *fd, *stream_fd;
+  pthread_mutex_t *mut;
+  pthread_cond_t  *submitted, *acquired, *recycled;
+  pthread_cond_t  *filled;	// Signals fill_hop completion and stream termination
+} SDR_Async;
+
+/*!
+ * Open sample source
+ * 
+ * \param backend Sample source backend
+ * \param arg Backend specific argument, e.g. device index or file path
+ * \return Sample source, NULL when it cannot be opened or when out of memory
+ */
+SDR_Source* SDR_initialize(const SDR_Backend *backend, const char *arg);
+void SDR_set_sample_rate(SDR_Source *src, uint32_t samp_rate);
+void SDR_set_gain(SDR_Source *src, float gain);
+void SDR_set_freq_correction(SDR_Source *src, int ppm_error);
+void SDR_retune(SDR_Source *src, uint32_t freq);
 
 /*!
  * Read N-point interleaved I/Q stream from device
@@ -37,7 +177,77 @@ void SDR_retune(rtlsdr_dev_t *dev, uint32_t freq);
  * \param iq_buf buffer to store the N-point interleaved I/Q stream
  * \param N length of interleaved I/Q stream
  */
-void SDR_read(rtlsdr_dev_t *dev, uint8_t *iq_buf, int N);
-void SDR_release(rtlsdr_dev_t *dev);
+void SDR_read(SDR_Source *src, uint8_t *iq_buf, int N);
+void SDR_release(SDR_Source *src);
+
+/*!
+ * Initialize free list of hop buffers
+ * 
+ * \return Free list, NULL when out of memory
+ */
+SDR_Buffers* SDR_buffers_initialize();
+
+/*!
+ * Get a buffer from the free list, or allocate one when the free list is empty
+ * 
+ * \param N Length of interleaved I/Q stream
+ * \return Buffer with a reference count of one, NULL when out of memory
+ */
+Buffer* SDR_buffers_get(SDR_Buffers *b, int N);
+
+/*!
+ * Release free list, buffers still in use are freed when they are returned
+ */
+void SDR_buffers_release(SDR_Buffers *b);
+
+/*!
+ * Start asynchronous acquisition engine
+ * 
+ * NOTE: While hops are submitted, the acquisition thread exclusively uses the source. Source
+ * settings other than sampling rate and center frequency must only be changed when all submitted
+ * hops have been recycled.
+ * 
+ * \param src Sample source
+ * \param buf_cnt Number of hop buffers in the ring
+ * \return Asynchronous acquisition engine, NULL when out of memory
+ */
+SDR_Async* SDR_async_initialize(SDR_Source *src, int buf_cnt);
+
+/*!
+ * Submit hop for acquisition. Blocks while all hop buffers are in use.
+ * 
+ * \param samp_rate Sampling rate in Hz
+ * \param center_freq Center frequency in Hz
+ * \param N Length of interleaved I/Q stream to read, must be a multiple of 512
+ * \return 0 on success, -1 when the hop buffer could not be allocated
+ */
+int SDR_async_submit(SDR_Async *a, uint32_t samp_rate, uint32_t center_freq, int N);
+
+/*!
+ * Wait for the oldest submitted hop to be acquired
+ * 
+ * \return Acquired hop, valid until passed to SDR_async_recycle
+ */
+SDR_Hop* SDR_async_wait(SDR_Async *a);
+
+/*!
+ * Hand the oldest acquired hop's buffer over to the caller. Dropping the last reference returns
+ * the memory to the engine's free list, the slot is refilled from it when it is submitted again.
+ * Buffers may outlive the engine. Must be called before SDR_async_recycle.
+ * 
+ * \return Interleaved I/Q stream with a reference count of one, NULL when out of memory, in
+ *         which case the hop's buffer stays in the ring
+ */
+Buffer* SDR_async_detach(SDR_Async *a);
+
+/*!
+ * Hand the oldest acquired hop's buffer back to the ring
+ */
+void SDR_async_recycle(SDR_Async *a);
+
+/*!
+ * Stop acquisition thread and release engine
+ */
+void SDR_async_release(SDR_Async *a);
 
 #endif /* SDR_H */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015 by Damian Pfammatter <pfammatterdamian@gmail.com>
+ *
+ * This file is part of RTL-spec.
+ *
+ * RTL-Spec is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * RTL-Spec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RTL-Spec.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STG_H /* Pipeline Stages */
+#define STG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "THR.h"
+#include "ITE.h"
+#include "QUE.h"
+
+/*!
+ * Pipeline stage, i.e. a process callback run by a number of workers on the items of an input queue
+ *
+ * Each worker removes up to batchlen items at a time from qin and passes them to process, which
+ * writes its results to the output queues with STG_push. Once qin is closed and drained, each
+ * worker calls flush and release, and the last worker closes the output queues.
+ */
+typedef struct Stage Stage;
+
+struct Stage {
+  const char   *name;			// Short name used in logs, e.g. "FFT "
+  unsigned int id;			// Thread identifier of the workers
+  void         *ctx;			// Stage context shared by all workers
+
+  // Callbacks, all but process are optional
+  void*        (*init)(Stage *stg);					// Worker state
+  void         (*process)(Stage *stg, void *state, Item **its, int cnt);
+  void         (*flush)(Stage *stg, void *state);			// No more input
+  void         (*release)(Stage *stg, void *state);
+
+  Queue        *qin, **qsout;
+  size_t       qsout_cnt;
+
+  unsigned int workers;
+  unsigned int batchlen;		// Maximum number of items per call to process
+  ThreadSched  sched;			// Scheduling of the workers, worker w is pinned to CPU cpu+w
+  Thread       **threads;		// One thread per worker
+
+  pthread_mutex_t *mut;
+  unsigned int started;			// Number of started workers
+  unsigned int running;			// Number of running workers
+
+  // Timing counters of all workers
+  atomic_ulong  items_in;		// Number of items removed from qin
+  atomic_ulong  items_out;		// Number of items written to the output queues
+  atomic_ulong  calls;			// Number of calls to process
+  atomic_ullong busy_ns;		// Time spent in process, including waiting on full outputs
+  atomic_ullong idle_ns;		// Time spent waiting for input
+};
+
+/*!
+ * Initialize stage without input and output queues
+ *
+ * \param name Short name used in logs
+ * \param id Thread identifier of the workers
+ * \param workers Number of workers
+ * \param batchlen Maximum number of items per call to process
+ * \return Stage
+ */
+Stage* STG_initialize(const char *name, unsigned int id, unsigned int workers,
+		      unsigned int batchlen);
+
+/*!
+ * Add output queue, the stage fans its items out to all output queues
+ */
+void STG_output(Stage *stg, Queue *q);
+
+/*!
+ * Start workers
+ */
+void STG_start(Stage *stg);
+
+/*!
+ * Wait for all workers to terminate
+ */
+void STG_join(Stage *stg);
+
+/*!
+ * Write item to the output queues, waits while a queue is full
+ *
+ * With several output queues, the item is shared by reference. The item is released when there is
+ * no output queue.
+ */
+void STG_push(Stage *stg, Item *it);
+
+/*!
+ * Write cnt items to the output queues, see STG_push
+ */
+void STG_push_many(Stage *stg, Item **its, int cnt);
+
+/*!
+ * Print timing counters, i.e. throughput and processing time per item
+ */
+void STG_print_stats(Stage *stg, FILE *f);
+
+void STG_release(Stage *stg);
+
+#endif /* STG_H */
\ No newline at end of file
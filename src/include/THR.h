@@ -22,6 +22,16 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <sched.h>
+
+/*!
+ * Scheduling of a thread role, i.e. CPU affinity, policy and priority
+ */
+typedef struct {
+  int              cpu;		// CPU the thread is pinned to, -1 if not pinned
+  int              policy;	// SCHED_OTHER, SCHED_FIFO or SCHED_RR
+  int              priority;	// Static priority, 0 with SCHED_OTHER
+} ThreadSched;
 
 typedef struct {
   unsigned int     id;
@@ -30,9 +40,38 @@ typedef struct {
   pthread_t       *fd;
   pthread_mutex_t *lock;
   pthread_cond_t  *awake;
+  ThreadSched      sched;
 } Thread;
 
 void THR_initialize(Thread **t, unsigned int id);
 void THR_release(Thread *t);
 
+/*!
+ * Initialize scheduling to not pinned, SCHED_OTHER
+ */
+void THR_sched_initialize(ThreadSched *s);
+
+/*!
+ * Parse scheduling of the form <cpu>[:<policy>[:<priority>]]
+ *
+ * \param s Scheduling to update
+ * \param str CPU, -1 if not pinned, policy other, fifo or rr, priority within the policy's range
+ *            [default=lowest]
+ * \return 0 on success, -1 on invalid scheduling
+ */
+int THR_sched_parse(ThreadSched *s, const char *str);
+
+/*!
+ * Apply scheduling to the calling thread and report whether it was applied
+ *
+ * Threads created afterwards by the calling thread inherit the scheduling. Scheduling left at its
+ * default is neither applied nor reported.
+ *
+ * \param s Scheduling
+ * \param k Index of the thread within its role, pinned to CPU cpu+k
+ * \param name Short name used in the report, e.g. "FFT "
+ * \return 0 if applied, -1 otherwise
+ */
+int THR_sched_apply(const ThreadSched *s, unsigned int k, const char *name);
+
 #endif /* THR_H */
\ No newline at end of file
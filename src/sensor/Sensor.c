@@ -31,20 +31,25 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <dirent.h>
+#include <sys/mman.h>
 
 #include "../include/UTI.h"
 #include "../include/THR.h"
 #include "../include/SDR.h"
 #include "../include/ITE.h"
 #include "../include/QUE.h"
+#include "../include/STG.h"
+#include "../include/MET.h"
 #include "../include/FFT.h"
+#include "../include/DSP.h"
 #include "../include/TCP.h"
 #include "../include/uthash.h"
 
 #define DEFAULT_LOG2_FFT_SIZE 8
 #define DEFAULT_MONITOR_TIME 0
 #define DEFAULT_MIN_TIME_RES 0
-#define DEFAULT_DEV_INDEX 0
+#define DEFAULT_DEV_INDICES "0"
+#define DEFAULT_ACQ_BUFS 2
 #define DEFAULT_CLK_OFF 0
 #define DEFAULT_CLK_CORR_PERIOD 3600
 #define DEFAULT_HOPPING_STRATEGY_STR "similarity"
@@ -53,7 +58,10 @@
 #define DEFAULT_AVG_FACTOR 5
 #define DEFAULT_SOVERLAP (1<<DEFAULT_LOG2_FFT_SIZE)/2
 #define DEFAULT_WINDOW_FUN_STR "hanning"
+#define DEFAULT_AVERAGING_STR "db"
 #define DEFAULT_FFT_BATCHLEN 10
+#define DEFAULT_FFT_WORKERS 1
+#define DEFAULT_ZOOM_LOG2_DECIM 6
 #define DEFAULT_CMPR_LEVEL 6
 #define DEFAULT_SAMP_RATE 2400000
 #define DEFAULT_TCP_HOSTS "127.0.0.1:5000"
@@ -62,9 +70,8 @@
 #define RANDOM_HOPPING_STRATEGY         1
 #define SIMILARITY_HOPPING_STRATEGY     2
 
-#define RECTANGULAR_WINDOW              0
-#define HANNING_WINDOW                  1
-#define BLACKMAN_HARRIS_WINDOW          2
+#define DB_AVERAGING                    0
+#define WELCH_AVERAGING                 1
 
 #define THR_MANAGER    0
 #define THR_FREQ_CORR  1
@@ -74,6 +81,9 @@
 #define THR_AVG        5
 #define THR_CMPR       6
 #define THR_TCP_TRNS   7
+#define THR_REORDER    8
+#define THR_STATS      9
+#define THR_CNT        10
 
 #define FLAG_FREQ_CORR 1
 #define FLAG_SPEC_MONI 2
@@ -83,10 +93,6 @@
 #define STR_LEN_LONG 512
 
 #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
-#define TICK(tstart) clock_gettime(CLOCK_MONOTONIC, &tstart)
-#define TACK(tstart, tend, file) clock_gettime(CLOCK_MONOTONIC, &tend);fprintf(file, "%.3f\n", ((double)tend.tv_sec + 1.0e-9*tend.tv_nsec) - ((double)tstart.tv_sec + 1.0e-9*tstart.tv_nsec))
-
-typedef float (*window_fun_ptr_t)(int, int);
 
 typedef struct {
   Thread       *thread;
@@ -100,20 +106,32 @@ typedef struct {
   unsigned int monitor_time;
   unsigned int min_time_res;
   unsigned int fft_batchlen;
+  unsigned int fft_workers;
   unsigned int cmpr_level;
-  int          dev_index;
-  int          clk_off;
+  unsigned int acq_bufs;
+  unsigned int stats_period;
+  int          *clk_offs;		// Clock offset per sample source
   float        gain;
   float        freq_overlap;
+  char         *clk_off_lst;
   char         *hopping_strategy_str;
   char         *window_fun_str;
+  char         *averaging_str;
   char         *tcp_hosts;
+  char         *dev_indices;
+  char         *iq_files;
+  char         *wisdom_file;
+  char         *zoom_bands;
+  char         *thread_scheds;
+  char         *metrics_file;
+  unsigned int mem_lock;
+  ThreadSched  scheds[THR_CNT];		// Scheduling per thread role, indexed by THR_*
 } ManagerCTX;
 
 typedef struct {
   Thread       *thread;
-  int          dev_index;
-  int          clk_off;
+  int          *dev_indices;		// Device index per sample source, -1 for I/Q files
+  int          *clk_offs;		// Clock offset per sample source
 } FrequencyCorrectionCTX;
 
 typedef struct {
@@ -132,14 +150,25 @@ typedef struct {
   unsigned int monitor_time;
   unsigned int min_time_res;
   unsigned int fft_batchlen;
+  unsigned int fft_workers;
   unsigned int cmpr_level;
+  unsigned int acq_bufs;
+  unsigned int stats_period;		// Seconds between dumps of the queue and stage counters
   int          hopping_strategy_id;
   int          window_fun_id;
-  int          dev_index;
-  int          clk_off;
+  int          averaging_id;
+  int          *clk_offs;		// Clock offset per sample source
   float        gain;
   float        freq_overlap;
   char         *tcp_hosts;
+  unsigned int samp_wind_cnt;		// Number of running sampling windowing threads
+  unsigned int samp_wind_done;		// Number of sampling windowing threads done with the sweep
+  pthread_mutex_t *hop_mut;		// Keeps the segments of a hop contiguous in the FFT queue
+  uint64_t     seq;			// Sequence number of the next item put to the FFT queue
+  Pool         *pool;			// Items and sample buffers recycled across the pipeline
+  unsigned int zoom_cnt;		// Number of zoom bands
+  unsigned int *zoom_freqs;		// Center frequencies of the zoom bands
+  unsigned int *zoom_log2_decims;	// Decimations (log2) of the zoom bands
 } SpectrumMonitoringCTX;
 
 typedef struct {
@@ -150,7 +179,9 @@ typedef struct {
 typedef struct {
   Thread           *thread;
   void             (*callback)(Item *);
+  SDR_Source       *src;
   unsigned int     length;
+  unsigned int     acq_bufs;
   unsigned int     *samp_rates;
   unsigned int     *log2_fft_sizes;
   unsigned int     *avg_factors;
@@ -159,10 +190,11 @@ typedef struct {
   unsigned int     *center_freqs;
   int              hopping_strategy_id;
   int              window_fun_id;
+  int              averaging_id;
   int              clk_off;
   float            gain;
   float            *freq_overlaps;
-  window_fun_ptr_t *window_funs;
+  int              *window_fun_ids;
 } SamplingWindowingCTX;
 
 typedef struct {
@@ -173,44 +205,70 @@ typedef struct {
 } SamplingWindowingARG;
 
 typedef struct {
-  Thread       *thread;
-  void         (*callback)(Item *);
-  unsigned int fft_batchlen;
+  void            (*callback)(Item *);
+  uint64_t        window;		// Number of items the reordering holds at most
+  uint64_t        next_seq;		// Sequence number of the next item to write
+  pthread_mutex_t *mut;
+  pthread_cond_t  *advanced;		// Signals the FFT workers when next_seq advances
+} ReorderingCTX;
+
+typedef struct {
+  void          (*callback)(Item *);
+  unsigned int  fft_batchlen;
+  int           averaging_id;
+  ReorderingCTX *reor_ctx;		// Reordering window of parallel workers, NULL for one worker
 } FFTCTX;
 
 typedef struct {
-  SpectrumMonitoringCTX *spec_moni_ctx;
-  FFTCTX                *fft_ctx;
-  Queue                 *qin, **qsout;
-  size_t                qsout_cnt;
-} FFTARG;
+  FFT_Context  *fft_engine;		// FFT resources owned by the worker
+  unsigned int fft_batchlen;
+  Item         **its;			// Items of the current batch
+  float        **batch_in, **batch_out;
+  unsigned int batch_cnt;
+  unsigned int prev_log2_fft_size, fft_size;
+  int          prev_window_fun_id;
+  const float  *window;
+  unsigned int taps;
+  float        *means;			// DC bias of the segments of a hop with Welch averaging
+  unsigned int means_cnt;
+  float        *zoomed;			// Decimated I/Q stream of a zoom band
+  unsigned int zoomed_cnt;
+  float        *zoom_scratch;		// CIC decimator outputs of a zoom band
+  unsigned int zoom_scratch_cnt;
+  Histogram    *m_batch;		// Time per batched FFT
+  Histogram    *m_hop;			// Time per hop with Welch averaging or zoom band
+} FFTState;
+
+typedef struct {
+  uint64_t     next_seq;
+  Item         **pending;		// Items waiting for their predecessors, indexed by sequence
+  size_t       pending_size;		// number modulo pending_size, i.e. the reordering window
+} ReorderingState;
 
 typedef struct {
-  Thread *thread;
   void (*callback)(Item *);
 } AveragingCTX;
 
 typedef struct {
-  SpectrumMonitoringCTX *spec_moni_ctx;
-  AveragingCTX          *avg_ctx;
-  Queue                 *qin, **qsout;
-  size_t                qsout_cnt;
-} AveragingARG;
+  Item         *iout;			// Item the average is accumulated in, NULL between averages
+  unsigned int avg_index;
+  unsigned int i;			// Number of items averaged so far
+} AveragingState;
 
 typedef struct {
-  Thread *thread;
   void   (*callback)(Item *);
 } CompressionCTX;
 
 typedef struct {
-  SpectrumMonitoringCTX *spec_moni_ctx;
-  CompressionCTX        *cmpr_ctx;
-  Queue                 *qin, **qsout;
-  size_t                qsout_cnt;
-} CompressionARG;
+  uint32_t     prev_reduced_fft_size;
+  size_t       src_len;
+  uint32_t     *src_buf;
+  Histogram    *m_time;			// Time per item
+  Histogram    *m_ratio;		// Compressed size per mille of the uncompressed size
+  Counter      *m_bytes_in, *m_bytes_out;
+} CompressionState;
 
 typedef struct {
-  Thread       *thread;
   void         (*callback)(Item *);
   size_t       tcp_hosts_cnt;
   char         *tcp_host_lst;
@@ -220,19 +278,28 @@ typedef struct {
 } TcpTransmissionCTX;
 
 typedef struct {
-  SpectrumMonitoringCTX *spec_moni_ctx;
-  TcpTransmissionCTX    *tcp_trns_ctx;
-  Queue                 *qin, **qsout;
-  size_t                qsout_cnt;
-} TcpTransmissionARG;
-
-/*! RTL-SDR Device Handle
+  TCP_Connection          **tcp_con;
+  UTI_BandwidthController **bcs;
+  uint32_t                *buf;
+  uint32_t                prev_data_size, packet_size;
+  int                     bytes_sent;
+  Histogram               *m_send;	// Time per item and host, including throttling
+  Counter                 *m_bytes;
+} TcpTransmissionState;
+
+/*! Sample Sources, i.e. RTL-SDR devices or recorded I/Q files
  * 
- * NOTE: Make sure to acquire the lock 'rtlsdr_mut' before accessing 'rtlsdr_dev'. This guarantees
- * mutual exclusive usage of the RTL-SDR device. Release the lock when finished.
+ * Each sample source is swept by its own sampling windowing thread.
+ * 
+ * NOTE: Make sure to acquire the lock 'sdr_srcs[i]->mut' before accessing 'sdr_srcs[i]'. This
+ * guarantees mutual exclusive usage of the underlying device. Release the lock when finished.
  */
-static rtlsdr_dev_t *rtlsdr_dev;
-static pthread_mutex_t *rtlsdr_mut;
+static SDR_Source **sdr_srcs = NULL;
+static const char *thr_roles[THR_CNT] = {
+  "manager", "freq_corr", "spec_moni", "samp_wind", "fft", "avg", "cmpr", "tcp_trns", "reorder",
+  "stats"
+};
+static unsigned int sdr_src_cnt = 0;
 
 
 static void* frequency_correction(void *args);
@@ -256,21 +323,45 @@ static void* sampling_windowing(void *args);
  * low frequent FFT sizes get delayed in the signal processing chain.
  * 
  * The output samples are in dB, i.e. envelope detection is performed as part of this signal
- * processing block.
+ * processing block. With Welch averaging, each item holds all segments of a hop, whose linear power
+ * is averaged and converted to dB once, so that a single item per hop is passed on.
+ * 
+ * NOTE: This and the following signal processing blocks are pipeline stages run by the stage
+ * runtime (STG), i.e. process callbacks called with batches of items of their input queue. Workers
+ * keep their state between calls in the state returned by the init callback.
  */
-static void* fft(void *args);
+static void* fft_init(Stage *stg);
+static void  fft(Stage *stg, void *state, Item **ins, int cnt);
+static void  fft_flush(Stage *stg, void *state);
+static void  fft_release(Stage *stg, void *state);
+
+/*! Signal Processing - Reordering
+ * 
+ * With multiple FFT workers, batches are transformed in parallel and complete out of order. Items
+ * are numbered in the order they are put to the FFT queue, and this block restores that order, i.e.
+ * the contiguous and descending order of a hop's segments required by the averaging.
+ */
+static void* reordering_init(Stage *stg);
+static void  reordering(Stage *stg, void *state, Item **ins, int cnt);
+static void  reordering_release(Stage *stg, void *state);
 
 /*! Signal Processing - Averaging
  */
-static void* averaging(void *args);
+static void* averaging_init(Stage *stg);
+static void  averaging(Stage *stg, void *state, Item **ins, int cnt);
+static void  averaging_release(Stage *stg, void *state);
 
 /*! Signal Processing - Compression
  */
-static void* compression(void *args);
+static void* compression_init(Stage *stg);
+static void  compression(Stage *stg, void *state, Item **ins, int cnt);
+static void  compression_release(Stage *stg, void *state);
 
 /*! Signal Processing - TCP Transmission
  */
-static void* tcp_transmission(void *args);
+static void* tcp_transmission_init(Stage *stg);
+static void  tcp_transmission(Stage *stg, void *state, Item **ins, int cnt);
+static void  tcp_transmission_release(Stage *stg, void *state);
 
 int main(int argc, char *argv[]) {
 
@@ -281,6 +372,14 @@ int main(int argc, char *argv[]) {
   FrequencyCorrectionARG *freq_corr_arg;
   SpectrumMonitoringARG *spec_moni_arg;
   
+  char *src_lst, *src_arg;
+  char *zoom_lst, *zoom_arg;
+  char *sched_lst, *sched_arg;
+  char *clk_lst, *clk_arg;
+  FILE *f_metrics = NULL;
+  unsigned int i;
+  size_t len;
+  
   // Ctrl-C signal catcher
   void terminate(int sig) {
     
@@ -317,10 +416,17 @@ int main(int argc, char *argv[]) {
     free(spec_moni_arg);
     free(freq_corr_arg);
     
-    // Free RTL-SDR device and associated lock
-    SDR_release(rtlsdr_dev);
-    pthread_mutex_destroy(rtlsdr_mut);
-    free(rtlsdr_mut);
+    // Free sample sources and associated locks
+    while(sdr_src_cnt > 0) SDR_release(sdr_srcs[--sdr_src_cnt]);
+    free(sdr_srcs);
+    
+    // Write last metrics snapshot and free metrics
+    MET_stop();
+    if(f_metrics != NULL && f_metrics != stderr) fclose(f_metrics);
+    MET_release();
+    
+    // Free cached window coefficient tables and zoom filters
+    DSP_release_windows();
     
     // Free sensor threads
     THR_release(spec_moni_ctx->thread);
@@ -328,8 +434,14 @@ int main(int argc, char *argv[]) {
     THR_release(manager_ctx->thread);
     
     // Free sensor contexts
+    free(spec_moni_ctx->zoom_freqs);
+    free(spec_moni_ctx->zoom_log2_decims);
+    free(spec_moni_ctx->clk_offs);
     free(spec_moni_ctx);
+    free(freq_corr_ctx->dev_indices);
+    free(freq_corr_ctx->clk_offs);
     free(freq_corr_ctx);
+    free(manager_ctx->clk_offs);
     free(manager_ctx);
     
 #if defined(VERBOSE)
@@ -343,7 +455,7 @@ int main(int argc, char *argv[]) {
   // Parse arguments and options
   void parse_args(int argc, char *argv[]) {
     int opt;
-    const char *options = "hd:c:k:g:y:s:f:b:a:o:q:t:r:w:l:m:";
+    const char *options = "hd:i:n:W:c:k:g:y:s:f:b:p:a:o:e:q:t:r:w:z:l:m:S:MP:R:";
     
     // Option arguments
     while((opt = getopt(argc, argv, options)) != -1) {
@@ -351,10 +463,19 @@ int main(int argc, char *argv[]) {
 	case 'h':
 	  goto usage;
 	case 'd':
-	  manager_ctx->dev_index = atoi(optarg);
+	  manager_ctx->dev_indices = optarg;
+	  break;
+	case 'i':
+	  manager_ctx->iq_files = optarg;
+	  break;
+	case 'n':
+	  manager_ctx->acq_bufs = atol(optarg);
+	  break;
+	case 'W':
+	  manager_ctx->wisdom_file = optarg;
 	  break;
 	case 'c':
-	  manager_ctx->clk_off = atoi(optarg);
+	  manager_ctx->clk_off_lst = optarg;
 	  break;
 	case 'k':
 	  manager_ctx->clk_corr_period = atol(optarg);
@@ -374,6 +495,10 @@ int main(int argc, char *argv[]) {
 	case 'b':
 	  manager_ctx->fft_batchlen = atol(optarg);
 	  break;
+	case 'p':
+	  manager_ctx->fft_workers = atol(optarg);
+	  if(manager_ctx->fft_workers < 1) manager_ctx->fft_workers = DEFAULT_FFT_WORKERS;
+	  break;
 	case 'a':
 	  manager_ctx->avg_factor = atol(optarg);
 	  if(manager_ctx->avg_factor < 1) manager_ctx->avg_factor = DEFAULT_AVG_FACTOR;
@@ -383,6 +508,9 @@ int main(int argc, char *argv[]) {
 	  if(manager_ctx->soverlap > (1<<manager_ctx->log2_fft_size)-1)
 	    manager_ctx->soverlap = (1<<manager_ctx->log2_fft_size)/2;
 	  break;
+	case 'e':
+	  manager_ctx->averaging_str = optarg;
+	  break;
 	case 'q':
 	  manager_ctx->freq_overlap = atof(optarg);
 	  break;
@@ -395,6 +523,9 @@ int main(int argc, char *argv[]) {
 	case 'w':
 	  manager_ctx->window_fun_str = optarg;
 	  break;
+	case 'z':
+	  manager_ctx->zoom_bands = optarg;
+	  break;
 	case 'l':
 	  manager_ctx->cmpr_level = atol(optarg);
 	  if(manager_ctx->cmpr_level > 9) manager_ctx->cmpr_level = DEFAULT_CMPR_LEVEL;
@@ -402,6 +533,18 @@ int main(int argc, char *argv[]) {
 	case 'm':
 	  manager_ctx->tcp_hosts = optarg;
 	  break;
+	case 'S':
+	  manager_ctx->thread_scheds = optarg;
+	  break;
+	case 'M':
+	  manager_ctx->mem_lock = 1;
+	  break;
+	case 'P':
+	  manager_ctx->stats_period = atol(optarg);
+	  break;
+	case 'R':
+	  manager_ctx->metrics_file = optarg;
+	  break;
 	default:
 	  goto usage;
       }
@@ -414,17 +557,20 @@ int main(int argc, char *argv[]) {
 	"Usage:\n"
 	"  %s min_freq max_freq\n"
 	"  [-h]\n"
-	"  [-d <dev_index>]\n"
-	"  [-c <clk_off>] [-k <clk_corr_period>]\n"
+	"  [-d <dev_index1>,...,<dev_indexN>] [-i <iq_file1>,...,<iq_fileN>] [-n <acq_bufs>]\n"
+	"  [-c <clk_off1>,...,<clk_offN>] [-k <clk_corr_period>]\n"
 	"  [-g <gain>]\n"
 	"  [-y <hopping_strategy>]\n"
 	"  [-s <samp_rate>]\n"
-	"  [-f <log2_fft_size>] [-b <fft_batchlen>]\n"
-	"  [-a <avg_factor>] [-o <soverlap>] [-q <freq_overlap>]\n"
+	"  [-f <log2_fft_size>] [-b <fft_batchlen>] [-p <fft_workers>] [-W <wisdom_file>]\n"
+	"  [-a <avg_factor>] [-o <soverlap>] [-e <averaging>] [-q <freq_overlap>]\n"
 	"  [-t <monitor_time>] [-r <min_time_res>]\n"
-	"  [-w <window>]\n"
+	"  [-w <window>] [-z <zoom_freq1>[:<log2_decim1>],...,<zoom_freqN>[:<log2_decimN>]]\n"
 	"  [-l <cmpr_level>]\n"
 	"  [-m <hostname1>:<portnumber1>[;<bandwidth1>],...,<hostnameN>:<portnumberN>[;bandwidthN]]\n"
+	"  [-S <role1>:<cpu1>[:<policy1>[:<priority1>]],...,<roleN>:<cpuN>[:<policyN>[:<priorityN>]]]\n"
+	"  [-M]\n"
+	"  [-P <stats_period>] [-R <metrics_file>]\n"
 	"\n"
 	"Arguments:\n"
 	"  min_freq               Lower frequency bound in Hz\n"
@@ -432,8 +578,19 @@ int main(int argc, char *argv[]) {
 	"\n"
 	"Options:\n"
 	"  -h                     Show this help\n"
-	"  -d <dev_index>         RTL-SDR device index [default=%i]\n"
-	"  -c <clk_off>           Clock offset in PPM [default=%i]\n"
+	"  -d <dev_index1>,...,<dev_indexN>\n"
+	"                         RTL-SDR device indices [default=%s]\n"
+	"                           i.e. sweep with N devices in parallel, each device covering\n"
+	"                           1/N of the hops\n"
+	"  -i <iq_file1>,...,<iq_fileN>\n"
+	"                         Replay recorded I/Q files instead of reading from RTL-SDR devices\n"
+	"                           i.e. raw interleaved 8-bit I/Q samples, e.g. from rtl_sdr\n"
+	"  -n <acq_bufs>          Number of hop buffers for asynchronous acquisition [default=%u]\n"
+	"                           i.e. read the next hops while processing the current one\n"
+	"                           0 for synchronous acquisition\n"
+	"  -c <clk_off1>,...,<clk_offN>\n"
+	"                         Clock offsets in PPM, one per device [default=%i]\n"
+	"                           i.e. a single value applies to all devices\n"
 	"  -k <clk_corr_period>   Clock correction period in seconds [default=%u]\n"
 	"                           i.e. perform frequency correction every 'clk_corr_period'\n"
 	"                           seconds\n"
@@ -449,12 +606,22 @@ int main(int argc, char *argv[]) {
 	"                           'samp_rate'/(2^'log2_fft_size')\n"
 	"  -b <fft_batchlen>      FFT batch length [default=%u]\n"
 	"                           i.e. process FFTs in batches of length 'fft_batchlen'\n"
+	"  -p <fft_workers>       Number of FFT worker threads [default=%u]\n"
+	"                           i.e. process 'fft_workers' batches in parallel\n"
+	"                           (GPU backend: always 1, the GPU executes one batch at a time)\n"
+	"  -W <wisdom_file>       FFT wisdom file, FFTW3 backend only [default=none]\n"
+	"                           i.e. plan FFTs thoroughly once and reuse the plans on restart\n"
 	"  -a <avg_factor>        Averaging factor [default=%u]\n"
 	"                           i.e. average 'avg_factor' segments\n"
 	"  -o <soverlap>          Segment overlap [default=%u]\n"
 	"                           i.e. number of samples per segment that overlap\n"
 	"                           The time to dwell in seconds at a given frequency is given by\n"
 	"                           (((1<<'log2_fft_size')-'soverlap')*'avg_factor'+'soverlap')/'samp_rate'\n"
+	"                           (longer by 3*(1<<'log2_fft_size') samples with window pfb)\n"
+	"  -e <averaging>         Averaging of segments [default=%s]\n"
+	"                           db, i.e. mean of the segments' dB values\n"
+	"                           welch, i.e. mean of the segments' linear power, converted to dB\n"
+	"                           once per hop by the FFT stage\n"
 	"  -q <freq_overlap>      Frequency overlapping factor [default=%.3f]\n"
 	"                           i.e. the frequency width is reduced from 'samp_rate' to\n"
 	"                           (1-'freq_overlap')*'samp_rate'\n"
@@ -466,29 +633,63 @@ int main(int argc, char *argv[]) {
 	"                           rectangular\n"
 	"                           hanning\n"
 	"                           blackman_harris_4\n"
+	"                           pfb, i.e. polyphase filter bank with 4 taps per bin, segments\n"
+	"                           then span 4*(1<<'log2_fft_size') samples\n"
+	"  -z <zoom_freq1>[:<log2_decim1>],...,<zoom_freqN>[:<log2_decimN>]\n"
+	"                         Zoom bands [default=none]\n"
+	"                           i.e. hops containing 'zoom_freq' additionally provide the\n"
+	"                           spectrum of the band around 'zoom_freq', decimated by\n"
+	"                           2^'log2_decim' [default=%u], resulting in the frequency\n"
+	"                           resolution 'samp_rate'/(2^'log2_decim')/(2^'log2_fft_size')\n"
+	"                           The band's spectrum is averaged over the segments that fit\n"
+	"                           into the hop, at least one and at most 'avg_factor'\n"
 	"  -l <cmpr_level>        Compression level [default=%u]\n"
 	"                           0 for no compression, fastest\n"
 	"                           9 for highest compression, slowest\n"
 	"  -m <hostname1>:<portnumber1>[;<bandwidth1>],...,<hostnameN>:<portnumberN>[;<bandwidthN>]\n"
 	"                         TCP collector hosts [default=%s]\n"
 	"                           Bandwidth limitation in Kb/s\n"
+	"  -S <role1>:<cpu1>[:<policy1>[:<priority1>]],...,<roleN>:<cpuN>[:<policyN>[:<priorityN>]]\n"
+	"                         Thread scheduling per role [default=none]\n"
+	"                           role manager, freq_corr, spec_moni, samp_wind, fft, avg, cmpr,\n"
+	"                           tcp_trns, reorder or stats\n"
+	"                           cpu to pin the role's threads to, -1 for no pinning, the k-th\n"
+	"                           thread of a role (device or FFT worker) is pinned to 'cpu'+k\n"
+	"                           policy other, fifo or rr, priority within the policy's range\n"
+	"                           [default=lowest], e.g. samp_wind:1:fifo:50,cmpr:3,tcp_trns:3\n"
+	"                           Threads of roles without scheduling inherit the scheduling of\n"
+	"                           the thread creating them, i.e. spec_moni for the pipeline\n"
+	"  -M                     Lock all memory to avoid page faults, see mlockall\n"
+	"  -P <stats_period>      Period in seconds to print queue and stage counters [default=%u]\n"
+	"                           i.e. items in/out, occupancy and time blocked per queue, busy\n"
+	"                           and idle time per stage\n"
+	"                           0 for no periodic counters\n"
+	"  -R <metrics_file>      Append metrics snapshots to 'metrics_file' [default=none]\n"
+	"                           i.e. every 'stats_period' seconds and on termination, counters\n"
+	"                           and latency histograms of retuning, reading, FFT batches,\n"
+	"                           compression and sending, '-' for stderr\n"
 	"",
 	argv[0],
-	manager_ctx->dev_index,
-	manager_ctx->clk_off, manager_ctx->clk_corr_period,
+	manager_ctx->dev_indices,
+	manager_ctx->acq_bufs,
+	DEFAULT_CLK_OFF, manager_ctx->clk_corr_period,
 	manager_ctx->gain,
 	manager_ctx->hopping_strategy_str,
 	manager_ctx->samp_rate,
 	manager_ctx->log2_fft_size,
 	manager_ctx->fft_batchlen,
+	manager_ctx->fft_workers,
 	manager_ctx->avg_factor,
 	manager_ctx->soverlap,
+	manager_ctx->averaging_str,
 	manager_ctx->freq_overlap,
 	manager_ctx->monitor_time,
 	manager_ctx->min_time_res,
 	manager_ctx->window_fun_str,
+	DEFAULT_ZOOM_LOG2_DECIM,
 	manager_ctx->cmpr_level,
-	manager_ctx->tcp_hosts);
+	manager_ctx->tcp_hosts,
+	manager_ctx->stats_period);
       exit(1);
     } else {
       manager_ctx->min_freq = atol(argv[optind]);
@@ -499,8 +700,13 @@ int main(int argc, char *argv[]) {
   
   // Initialize sensor contexts
   manager_ctx = (ManagerCTX *) malloc(sizeof(ManagerCTX));
-  manager_ctx->dev_index = DEFAULT_DEV_INDEX;
-  manager_ctx->clk_off = DEFAULT_CLK_OFF;
+  manager_ctx->dev_indices = DEFAULT_DEV_INDICES;
+  manager_ctx->acq_bufs = DEFAULT_ACQ_BUFS;
+  manager_ctx->iq_files = NULL;
+  manager_ctx->wisdom_file = NULL;
+  manager_ctx->zoom_bands = NULL;
+  manager_ctx->clk_offs = NULL;
+  manager_ctx->clk_off_lst = NULL;
   manager_ctx->clk_corr_period = DEFAULT_CLK_CORR_PERIOD;
   manager_ctx->samp_rate = DEFAULT_SAMP_RATE;
   manager_ctx->log2_fft_size = DEFAULT_LOG2_FFT_SIZE;
@@ -509,27 +715,85 @@ int main(int argc, char *argv[]) {
   manager_ctx->monitor_time = DEFAULT_MONITOR_TIME;
   manager_ctx->min_time_res = DEFAULT_MIN_TIME_RES;
   manager_ctx->fft_batchlen = DEFAULT_FFT_BATCHLEN;
+  manager_ctx->fft_workers = DEFAULT_FFT_WORKERS;
   manager_ctx->cmpr_level = DEFAULT_CMPR_LEVEL;
   manager_ctx->gain = DEFAULT_GAIN;
   manager_ctx->freq_overlap = DEFAULT_FREQ_OVERLAP;
   manager_ctx->hopping_strategy_str = DEFAULT_HOPPING_STRATEGY_STR;
   manager_ctx->window_fun_str = DEFAULT_WINDOW_FUN_STR;
+  manager_ctx->averaging_str = DEFAULT_AVERAGING_STR;
   manager_ctx->tcp_hosts = DEFAULT_TCP_HOSTS;
+  manager_ctx->thread_scheds = NULL;
+  manager_ctx->metrics_file = NULL;
+  manager_ctx->mem_lock = 0;
+  manager_ctx->stats_period = 0;
+  for(i=0; i<THR_CNT; ++i) THR_sched_initialize(&(manager_ctx->scheds[i]));
   THR_initialize(&(manager_ctx->thread), THR_MANAGER);
   
   // Parse arguments/options and update context
   parse_args(argc, argv);
   
+#if defined(RPI_GPU)
+  // The GPU executes one batch at a time, see FFT_execute, further workers would only take turns
+  if(manager_ctx->fft_workers > 1) {
+    fprintf(stderr, "[SMAN] FFT workers: using 1 instead of %u, the GPU executes one batch at a "
+	    "time.\n", manager_ctx->fft_workers);
+    manager_ctx->fft_workers = 1;
+  }
+#endif
+  
+  // Parse thread scheduling per role
+  if(manager_ctx->thread_scheds != NULL) {
+    sched_lst = strdup(manager_ctx->thread_scheds);
+    for(sched_arg = strtok(sched_lst, ","); sched_arg != NULL; sched_arg = strtok(NULL, ",")) {
+      for(i=0; i<THR_CNT; ++i) {
+	len = strlen(thr_roles[i]);
+	if(strncmp(sched_arg, thr_roles[i], len) == 0 && sched_arg[len] == ':') break;
+      }
+      if(i == THR_CNT || THR_sched_parse(&(manager_ctx->scheds[i]), sched_arg+len+1) != 0) {
+	fprintf(stderr, "ERROR: Invalid thread scheduling '%s'.\n", sched_arg);
+	exit(1);
+      }
+    }
+    free(sched_lst);
+  }
+  
+  // Lock current and future pages, e.g. sample buffers and thread stacks
+  if(manager_ctx->mem_lock) {
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      fprintf(stderr, "[SMAN] Memory locking: applied.\n");
+    else
+      fprintf(stderr, "[SMAN] Memory locking: failed, %s.\n", strerror(errno));
+  }
+  
+  // Write metrics snapshots every stats_period seconds
+  if(manager_ctx->metrics_file != NULL) {
+    if(strcmp(manager_ctx->metrics_file, "-") == 0)
+      f_metrics = stderr;
+    else if((f_metrics = fopen(manager_ctx->metrics_file, "a")) == NULL) {
+      fprintf(stderr, "ERROR: Failed opening metrics file '%s'.\n", manager_ctx->metrics_file);
+      exit(1);
+    }
+    MET_start(f_metrics, manager_ctx->stats_period);
+  }
+  
+  // Apply manager's scheduling, inherited by the threads without scheduling of their own
+  manager_ctx->thread->sched = manager_ctx->scheds[THR_MANAGER];
+  THR_sched_apply(&(manager_ctx->thread->sched), 0, "SMAN");
+  
+  // Load FFT plans
+  if(manager_ctx->wisdom_file != NULL) FFT_load_wisdom(manager_ctx->wisdom_file);
+  
   freq_corr_ctx = (FrequencyCorrectionCTX *) malloc(sizeof(FrequencyCorrectionCTX));
-  freq_corr_ctx->clk_off = manager_ctx->clk_off;
-  freq_corr_ctx->dev_index = manager_ctx->dev_index;
+  freq_corr_ctx->dev_indices = NULL;
+  freq_corr_ctx->clk_offs = NULL;
   THR_initialize(&(freq_corr_ctx->thread), THR_FREQ_CORR);
+  freq_corr_ctx->thread->sched = manager_ctx->scheds[THR_FREQ_CORR];
   
   spec_moni_ctx = (SpectrumMonitoringCTX *) malloc(sizeof(SpectrumMonitoringCTX));
   spec_moni_ctx->min_freq = manager_ctx->min_freq;
   spec_moni_ctx->max_freq = manager_ctx->max_freq;
-  spec_moni_ctx->dev_index = manager_ctx->dev_index;
-  spec_moni_ctx->clk_off = manager_ctx->clk_off;
+  spec_moni_ctx->clk_offs = NULL;
   spec_moni_ctx->samp_rate = manager_ctx->samp_rate;
   spec_moni_ctx->log2_fft_size = manager_ctx->log2_fft_size;
   spec_moni_ctx->avg_factor = manager_ctx->avg_factor;
@@ -537,7 +801,10 @@ int main(int argc, char *argv[]) {
   spec_moni_ctx->monitor_time = manager_ctx->monitor_time;
   spec_moni_ctx->min_time_res = manager_ctx->min_time_res;
   spec_moni_ctx->fft_batchlen = manager_ctx->fft_batchlen;
+  spec_moni_ctx->fft_workers = manager_ctx->fft_workers;
   spec_moni_ctx->cmpr_level = manager_ctx->cmpr_level;
+  spec_moni_ctx->acq_bufs = manager_ctx->acq_bufs;
+  spec_moni_ctx->stats_period = manager_ctx->stats_period;
   spec_moni_ctx->gain = manager_ctx->gain;
   spec_moni_ctx->freq_overlap = manager_ctx->freq_overlap;
   if(strcmp(manager_ctx->hopping_strategy_str, "random") == 0)
@@ -550,15 +817,93 @@ int main(int argc, char *argv[]) {
     spec_moni_ctx->window_fun_id = HANNING_WINDOW;
   else if(strcmp(manager_ctx->window_fun_str, "blackman_harris_4") == 0)
     spec_moni_ctx->window_fun_id = BLACKMAN_HARRIS_WINDOW;
+  else if(strcmp(manager_ctx->window_fun_str, "pfb") == 0)
+    spec_moni_ctx->window_fun_id = PFB_WINDOW;
+  else
+    spec_moni_ctx->window_fun_id = RECTANGULAR_WINDOW;
+  if(strcmp(manager_ctx->averaging_str, "welch") == 0)
+    spec_moni_ctx->averaging_id = WELCH_AVERAGING;
   else
-    spec_moni_ctx->window_fun_id = SEQUENTIAL_HOPPING_STRATEGY;
+    spec_moni_ctx->averaging_id = DB_AVERAGING;
   spec_moni_ctx->tcp_hosts = manager_ctx->tcp_hosts;
+  spec_moni_ctx->zoom_cnt = 0;
+  spec_moni_ctx->zoom_freqs = NULL;
+  spec_moni_ctx->zoom_log2_decims = NULL;
+  if(manager_ctx->zoom_bands != NULL) {
+    zoom_lst = strdup(manager_ctx->zoom_bands);
+    for(zoom_arg = strtok(zoom_lst, ","); zoom_arg != NULL; zoom_arg = strtok(NULL, ",")) {
+      i = spec_moni_ctx->zoom_cnt++;
+      spec_moni_ctx->zoom_freqs = (unsigned int *) realloc(spec_moni_ctx->zoom_freqs,
+							   (i+1)*sizeof(unsigned int));
+      spec_moni_ctx->zoom_log2_decims = (unsigned int *) realloc(spec_moni_ctx->zoom_log2_decims,
+								 (i+1)*sizeof(unsigned int));
+      spec_moni_ctx->zoom_freqs[i] = atol(zoom_arg);
+      spec_moni_ctx->zoom_log2_decims[i] = (strchr(zoom_arg, ':') != NULL) ?
+	atol(strchr(zoom_arg, ':')+1) : DEFAULT_ZOOM_LOG2_DECIM;
+      if(spec_moni_ctx->zoom_log2_decims[i] < 1 ||
+	 spec_moni_ctx->zoom_log2_decims[i] > DSP_ZOOM_MAX_LOG2_DECIM)
+	spec_moni_ctx->zoom_log2_decims[i] = DEFAULT_ZOOM_LOG2_DECIM;
+    }
+    free(zoom_lst);
+  }
   THR_initialize(&(spec_moni_ctx->thread), THR_SPEC_MONI);
+  spec_moni_ctx->thread->sched = manager_ctx->scheds[THR_SPEC_MONI];
+  
+  // Initialize sample sources and associated locks to guarantee mutual exclusive access 
+  src_lst = strdup(manager_ctx->iq_files != NULL ? manager_ctx->iq_files : manager_ctx->dev_indices);
+  for(src_arg = strtok(src_lst, ","); src_arg != NULL; src_arg = strtok(NULL, ",")) {
+    sdr_srcs = (SDR_Source **) realloc(sdr_srcs, (sdr_src_cnt+1)*sizeof(SDR_Source *));
+    if(sdr_srcs == NULL) {
+      fprintf(stderr, "ERROR: Out of memory.\n");
+      exit(1);
+    }
+    if(manager_ctx->iq_files != NULL)
+      sdr_srcs[sdr_src_cnt] = SDR_initialize(&SDR_FILE_BACKEND, src_arg);
+    else
+      sdr_srcs[sdr_src_cnt] = SDR_initialize(&SDR_RTLSDR_BACKEND, src_arg);
+    if(sdr_srcs[sdr_src_cnt] == NULL) {
+      fprintf(stderr, "ERROR: Failed to open sample source %s.\n", src_arg);
+      exit(1);
+    }
+    ++sdr_src_cnt;
+  }
+  free(src_lst);
+  if(sdr_src_cnt == 0) {
+    fprintf(stderr, "ERROR: No sample source.\n");
+    exit(1);
+  }
   
-  // Initialize RTL-SDR device and associated lock to guarantee mutual exclusive access 
-  SDR_initialize(&rtlsdr_dev, spec_moni_ctx->dev_index);
-  rtlsdr_mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
-  pthread_mutex_init(rtlsdr_mut, NULL);
+  // Every device has its own crystal error, and thus its own clock offset
+  manager_ctx->clk_offs = (int *) malloc(sdr_src_cnt*sizeof(int));
+  freq_corr_ctx->clk_offs = (int *) malloc(sdr_src_cnt*sizeof(int));
+  freq_corr_ctx->dev_indices = (int *) malloc(sdr_src_cnt*sizeof(int));
+  spec_moni_ctx->clk_offs = (int *) malloc(sdr_src_cnt*sizeof(int));
+  for(i=0; i<sdr_src_cnt; ++i) manager_ctx->clk_offs[i] = DEFAULT_CLK_OFF;
+  if(manager_ctx->clk_off_lst != NULL) {
+    clk_lst = strdup(manager_ctx->clk_off_lst);
+    len = 0;
+    for(clk_arg = strtok(clk_lst, ","); clk_arg != NULL; clk_arg = strtok(NULL, ",")) {
+      if(len < sdr_src_cnt) manager_ctx->clk_offs[len] = atoi(clk_arg);
+      ++len;
+    }
+    free(clk_lst);
+    // A single clock offset applies to all devices
+    if(len == 1)
+      for(i=1; i<sdr_src_cnt; ++i) manager_ctx->clk_offs[i] = manager_ctx->clk_offs[0];
+    else if(len != sdr_src_cnt) {
+      fprintf(stderr, "ERROR: Expected 1 or %u clock offsets, got %zu.\n", sdr_src_cnt, len);
+      exit(1);
+    }
+  }
+  memcpy(freq_corr_ctx->clk_offs, manager_ctx->clk_offs, sdr_src_cnt*sizeof(int));
+  memcpy(spec_moni_ctx->clk_offs, manager_ctx->clk_offs, sdr_src_cnt*sizeof(int));
+  src_lst = strdup(manager_ctx->dev_indices);
+  for(i=0, src_arg = strtok(src_lst, ","); i<sdr_src_cnt; ++i) {
+    freq_corr_ctx->dev_indices[i] = (manager_ctx->iq_files == NULL && src_arg != NULL) ?
+      atoi(src_arg) : -1;
+    if(src_arg != NULL) src_arg = strtok(NULL, ",");
+  }
+  free(src_lst);
   
 #if defined(VERBOSE) || defined(TID)
 #if defined(RPI_GPU)
@@ -601,7 +946,7 @@ int main(int argc, char *argv[]) {
   
   // Perform initial frequency correction
   pthread_mutex_lock(freq_corr_ctx->thread->lock);
-  freq_corr_ctx->clk_off = manager_ctx->clk_off;
+  memcpy(freq_corr_ctx->clk_offs, manager_ctx->clk_offs, sdr_src_cnt*sizeof(int));
   pthread_cond_signal(freq_corr_ctx->thread->awake);
   pthread_mutex_unlock(freq_corr_ctx->thread->lock);
   
@@ -619,7 +964,7 @@ int main(int argc, char *argv[]) {
     // Redo frequency correction
     if(r == ETIMEDOUT) {
       pthread_mutex_lock(freq_corr_ctx->thread->lock);
-      freq_corr_ctx->clk_off = manager_ctx->clk_off;
+      memcpy(freq_corr_ctx->clk_offs, manager_ctx->clk_offs, sdr_src_cnt*sizeof(int));
       pthread_cond_signal(freq_corr_ctx->thread->awake);
       pthread_mutex_unlock(freq_corr_ctx->thread->lock);
       
@@ -644,12 +989,12 @@ int main(int argc, char *argv[]) {
 	
 	// Update manager context
 	pthread_mutex_lock(freq_corr_ctx->thread->lock);
-	manager_ctx->clk_off = freq_corr_ctx->clk_off;
+	memcpy(manager_ctx->clk_offs, freq_corr_ctx->clk_offs, sdr_src_cnt*sizeof(int));
 	pthread_mutex_unlock(freq_corr_ctx->thread->lock);
 	
 	// Update frequency monitoring context
 	pthread_mutex_lock(spec_moni_ctx->thread->lock);
-	spec_moni_ctx->clk_off = manager_ctx->clk_off;
+	memcpy(spec_moni_ctx->clk_offs, manager_ctx->clk_offs, sdr_src_cnt*sizeof(int));
 	pthread_mutex_unlock(spec_moni_ctx->thread->lock);
       }
       
@@ -680,9 +1025,10 @@ int main(int argc, char *argv[]) {
 }
 
 static void* frequency_correction(void *args) {
-  int clk_off;
+  int *clk_offs;
+  unsigned int d;
   
-//   char buf[100];
+//   char buf[100], dev_arg[16];
 //   FILE *f_kal;
   int enable_temp_sensor = 0;
   char *temp_sensor = NULL;
@@ -700,6 +1046,8 @@ static void* frequency_correction(void *args) {
   manager_ctx = (ManagerCTX *) freq_corr_arg->manager_ctx;
   freq_corr_ctx = (FrequencyCorrectionCTX *) freq_corr_arg->freq_corr_ctx;
   
+  THR_sched_apply(&(freq_corr_ctx->thread->sched), 0, "FCOR");
+  
 #if defined(VERBOSE) || defined(VERBOSE_FCOR) || defined(TID)
 #if defined(RPI_GPU)
   fprintf(stderr, "[FCOR] Started.\tTID: %li\n", (long int) syscall(224));
@@ -737,6 +1085,9 @@ static void* frequency_correction(void *args) {
   fprintf(stderr, "[FCOR] Temperature sensor %sfound.\n", enable_temp_sensor ? "" : "not ");
 #endif
   
+  // Clock offsets of the devices, updated by the correction
+  clk_offs = (int *) malloc(sdr_src_cnt*sizeof(int));
+  
   // Signal manager that we are ready
   pthread_mutex_lock(freq_corr_ctx->thread->lock);
   pthread_cond_signal(manager_ctx->thread->awake);
@@ -746,37 +1097,41 @@ static void* frequency_correction(void *args) {
     if(!freq_corr_ctx->thread->is_running) break;
     
     // Read context
-    clk_off = freq_corr_ctx->clk_off;
+    memcpy(clk_offs, freq_corr_ctx->clk_offs, sdr_src_cnt*sizeof(int));
     pthread_mutex_unlock(freq_corr_ctx->thread->lock);
     
-    // Perform frequency correction
+    // Perform frequency correction of each device, every device has its own crystal error
+    for(d=0; d<sdr_src_cnt; ++d) {
 #if defined(VERBOSE) || defined(VERBOSE_FCOR)
-    fprintf(stderr, "[FCOR] Run frequency correction.\n");
+      fprintf(stderr, "[FCOR] Run frequency correction of device %u, clock offset %i PPM.\n", d,
+	      clk_offs[d]);
 #endif
-    
-//     // TODO: Implement frequency correction based on GSM signals
-//     
-//     // Acquire lock to RTL-SDR device, sampling gets blocked
-//     pthread_mutex_lock(rtlsdr_mut);
-//     
-//     // Release RTL-SDR device for external correction process
-//     SDR_release(rtlsdr_dev);
-//     
-//     f_kal = popen("kal -s GSM900 -g 48.0 -e 0 2> /dev/null | grep -o \"chan:\\s\\+[0-9]\\+\\|power:\\s\\+[0-9]\\+\\.[0-9]\\+\"", "r");
-//     if(f_kal != NULL) {
-//       while(fgets(buf, sizeof(buf), f_kal) != NULL) {
-// 	fprintf(stdout, ">>> %s\n", buf);
+      
+//       // TODO: Implement frequency correction based on GSM signals, updating clk_offs[d]
+//       
+//       // Acquire lock to RTL-SDR device, sampling gets blocked
+//       pthread_mutex_lock(sdr_srcs[d]->mut);
+//       
+//       // Release RTL-SDR device for external correction process
+//       sdr_srcs[d]->backend->close(sdr_srcs[d]);
+//       
+//       f_kal = popen("kal -s GSM900 -g 48.0 -e 0 2> /dev/null | grep -o \"chan:\\s\\+[0-9]\\+\\|power:\\s\\+[0-9]\\+\\.[0-9]\\+\"", "r");
+//       if(f_kal != NULL) {
+//         while(fgets(buf, sizeof(buf), f_kal) != NULL) {
+// 	  fprintf(stdout, ">>> %s\n", buf);
+//         }
+//         pclose(f_kal);
+//       } else {
+//         fprintf(stderr, "[FCOR] Failed opening kalibrate-rtl.\n");
 //       }
-//       pclose(f_kal);
-//     } else {
-//       fprintf(stderr, "[FCOR] Failed opening kalibrate-rtl.\n");
-//     }
-//     
-//     // Acquire RTL-SDR device
-//     SDR_initialize(&rtlsdr_dev, freq_corr_ctx->dev_index);
-//     
-//     // Release lock to RTL-SDR device
-//     pthread_mutex_unlock(rtlsdr_mut);
+//       
+//       // Acquire RTL-SDR device
+//       snprintf(dev_arg, sizeof(dev_arg), "%i", freq_corr_ctx->dev_indices[d]);
+//       sdr_srcs[d]->backend->open(sdr_srcs[d], dev_arg);
+//       
+//       // Release lock to RTL-SDR device
+//       pthread_mutex_unlock(sdr_srcs[d]->mut);
+    }
     
     // Read temperature measures
     if(enable_temp_sensor && (f_temp = fopen(temp_sensor, "r")) != NULL) {
@@ -797,7 +1152,7 @@ static void* frequency_correction(void *args) {
       
     // Write context
     pthread_mutex_lock(freq_corr_ctx->thread->lock);
-    freq_corr_ctx->clk_off = clk_off;
+    memcpy(freq_corr_ctx->clk_offs, clk_offs, sdr_src_cnt*sizeof(int));
     
     // Signal manager that frequency correction completed
     pthread_mutex_lock(manager_ctx->thread->lock);
@@ -808,6 +1163,7 @@ static void* frequency_correction(void *args) {
   pthread_mutex_unlock(freq_corr_ctx->thread->lock);
 
   free(temp_sensor);
+  free(clk_offs);
   
 #if defined(VERBOSE) || defined(VERBOSE_FCOR)
   fprintf(stderr, "[FCOR] Terminated.\n");
@@ -830,10 +1186,10 @@ static void* spectrum_monitoring(void *args) {
     unsigned int min_freq, max_freq;
     unsigned int samp_rate;
     unsigned int log2_fft_size, avg_factor, soverlap;
-    unsigned int monitor_time, min_time_res, fft_batchlen;
-    unsigned int cmpr_level;
+    unsigned int monitor_time, min_time_res, fft_batchlen, fft_workers;
+    unsigned int cmpr_level, stats_period;
 
-    int clk_off;
+    int *clk_offs = NULL;
     float gain, freq_overlap;
     int hopping_strategy_id;
     int window_fun_id;
@@ -847,7 +1203,7 @@ static void* spectrum_monitoring(void *args) {
     unsigned int *cmpr_levels = NULL;
     unsigned int *center_freqs = NULL, *full_center_freqs = NULL;
     float *freq_overlaps = NULL;
-    window_fun_ptr_t *window_funs = NULL;
+    int *window_fun_ids = NULL;
     
 #if defined(VERBOSE) || defined(VERBOSE_STRATEGY)
     long long cnt_total = 0, cnt_skipped = 0;
@@ -916,48 +1272,74 @@ static void* spectrum_monitoring(void *args) {
     
     // History hash table
     pthread_mutex_t *hist_htable_mut;
+#if defined(MEASURE_SIMILARITY)
+    FILE *f_stat_similarity;
+#endif
 
     time_t start_t, current_t, prev_t;
     
     
-    SamplingWindowingCTX *samp_wind_ctx = NULL;
-    SamplingWindowingARG *samp_wind_arg = NULL;
+    unsigned int         d, offset;
+    SamplingWindowingCTX *samp_wind_ctx = NULL, **samp_wind_ctxs = NULL;
+    SamplingWindowingARG **samp_wind_args = NULL;
     
     Queue                *q_fft = NULL;
-    FFTCTX               *fft_ctx;
-    FFTARG               *fft_arg;
+    FFTCTX               *fft_ctx = NULL;
+    Stage                *fft_stg = NULL;
+    
+    Queue                *q_reor = NULL;
+    ReorderingCTX        *reor_ctx = NULL;
+    Stage                *reor_stg = NULL;
     
     Queue                *q_avg = NULL;
     AveragingCTX         *avg_ctx = NULL;
-    AveragingARG         *avg_arg = NULL;
+    Stage                *avg_stg = NULL;
     
     Queue                *q_cmpr = NULL;
     CompressionCTX       *cmpr_ctx = NULL;
-    CompressionARG       *cmpr_arg = NULL;
+    Stage                *cmpr_stg = NULL;
     
     Queue                *q_tcp_trns = NULL;
     TcpTransmissionCTX   *tcp_trns_ctx = NULL;
-    TcpTransmissionARG   *tcp_trns_arg = NULL;
+    Stage                *tcp_trns_stg = NULL;
     
+    Thread               *stats_thread = NULL;
     
-    /*! Rectangular Window
-    */
-    float rectangular_window(int n, int N) {
-      return 1.0;
+    /*! Print the counters of the signal processing queues and stages
+     */
+    void print_stats() {
+      QUE_print_stats(q_fft, "q_fft", stderr);
+      if(q_reor != NULL) QUE_print_stats(q_reor, "q_reor", stderr);
+      QUE_print_stats(q_avg, "q_avg", stderr);
+      QUE_print_stats(q_cmpr, "q_cmpr", stderr);
+      QUE_print_stats(q_tcp_trns, "q_tcp_trns", stderr);
+      STG_print_stats(fft_stg, stderr);
+      if(reor_stg != NULL) STG_print_stats(reor_stg, stderr);
+      STG_print_stats(avg_stg, stderr);
+      STG_print_stats(cmpr_stg, stderr);
+      STG_print_stats(tcp_trns_stg, stderr);
     }
     
-    /*! Hanning Window
-    */
-    float hanning_window(int n, int N) {
-      return 0.5 * (1- cos(2*M_PI*n / (N-1)));
+    /*! Print the counters every stats_period seconds until asked to terminate
+     */
+    void* statistics(void *args) {
+      struct timespec deadline;
+      
+      THR_sched_apply(&(stats_thread->sched), 0, "STAT");
+      
+      pthread_mutex_lock(stats_thread->lock);
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      while(stats_thread->is_running) {
+	deadline.tv_sec += stats_period;
+	while(stats_thread->is_running &&
+	      pthread_cond_timedwait(stats_thread->awake, stats_thread->lock, &deadline) != ETIMEDOUT);
+	if(stats_thread->is_running) print_stats();
+      }
+      pthread_mutex_unlock(stats_thread->lock);
+      
+      pthread_exit(NULL);
     }
     
-    /*! 4-Term  Blackman-Harris Window
-    */
-    float blackman_harris_4_window(int n, int N) {
-      const float a0 = 0.35875, a1 = 0.48829, a2 = 0.14128, a3 = 0.01168;
-      return a0 - a1*cos(2*M_PI*n / (N-1)) + a2*cos(4*M_PI*n / (N-1)) - a3*cos(6*M_PI*n / (N-1));
-    }
     
     /*! Sequential Hopping Strategy
      * 
@@ -969,16 +1351,17 @@ static void* spectrum_monitoring(void *args) {
     void sequential_hopping_strategy() {
       int i;
       
-      // Update clk_off
-      clk_off = spec_moni_ctx->clk_off;
+      // Update clock offsets
+      memcpy(clk_offs, spec_moni_ctx->clk_offs, sdr_src_cnt*sizeof(int));
       
       // Calculate hopping parameters once
       if(length <= 0) {
 	unsigned int freq_step;
 	
 	// Set hopping strategy dependent callbacks
-	if(samp_wind_ctx != NULL) samp_wind_ctx->callback = NULL;
+	for(i=0; samp_wind_ctxs != NULL && i<sdr_src_cnt; ++i) samp_wind_ctxs[i]->callback = NULL;
 	if(fft_ctx != NULL) fft_ctx->callback = NULL;
+	if(reor_ctx != NULL) reor_ctx->callback = NULL;
 	if(avg_ctx != NULL) avg_ctx->callback = NULL;
 	if(cmpr_ctx != NULL) cmpr_ctx->callback = NULL;
 	if(tcp_trns_ctx != NULL) tcp_trns_ctx->callback = NULL;
@@ -1016,12 +1399,8 @@ static void* spectrum_monitoring(void *args) {
 	for(i=0; i<length; ++i) freq_overlaps[i] = freq_overlap;
 	
 	// Windowing functions
-	window_fun_ptr_t window_fun = NULL;
-	if(window_fun_id == HANNING_WINDOW) window_fun = hanning_window;
-	else if(window_fun_id == BLACKMAN_HARRIS_WINDOW) window_fun = blackman_harris_4_window;
-	else window_fun = rectangular_window;
-	window_funs = (window_fun_ptr_t *) malloc(length*sizeof(window_fun_ptr_t));
-	for(i=0; i<length; ++i) window_funs[i] = window_fun;
+	window_fun_ids = (int *) malloc(length*sizeof(int));
+	for(i=0; i<length; ++i) window_fun_ids[i] = window_fun_id;
       }
       
     }
@@ -1044,8 +1423,9 @@ static void* spectrum_monitoring(void *args) {
       if(length <= 0) {
 
 	// Set hopping strategy dependent callbacks
-	if(samp_wind_ctx != NULL) samp_wind_ctx->callback = NULL;
+	for(i=0; samp_wind_ctxs != NULL && i<sdr_src_cnt; ++i) samp_wind_ctxs[i]->callback = NULL;
 	if(fft_ctx != NULL) fft_ctx->callback = NULL;
+	if(reor_ctx != NULL) reor_ctx->callback = NULL;
 	if(avg_ctx != NULL) avg_ctx->callback = NULL;
 	if(cmpr_ctx != NULL) cmpr_ctx->callback = NULL;
 	if(tcp_trns_ctx != NULL) tcp_trns_ctx->callback = NULL;
@@ -1084,12 +1464,8 @@ static void* spectrum_monitoring(void *args) {
 	for(i=0; i<length; ++i) freq_overlaps[i] = freq_overlap;
 	
 	// Windowing functions
-	window_fun_ptr_t window_fun = NULL;
-	if(window_fun_id == HANNING_WINDOW) window_fun = hanning_window;
-	else if(window_fun_id == BLACKMAN_HARRIS_WINDOW) window_fun = blackman_harris_4_window;
-	else window_fun = rectangular_window;
-	window_funs = (window_fun_ptr_t *) malloc(length*sizeof(window_fun_ptr_t));
-	for(i=0; i<length; ++i) window_funs[i] = window_fun;
+	window_fun_ids = (int *) malloc(length*sizeof(int));
+	for(i=0; i<length; ++i) window_fun_ids[i] = window_fun_id;
       }
       
       // Tune to purely random center frequencies, at the resolution introduced by the FFT length
@@ -1211,6 +1587,9 @@ static void* spectrum_monitoring(void *args) {
 	return res;
       }
       
+      // Zoom bands are not part of the sweep
+      if(iout->log2_decim > 0) return;
+      
       key = iout->Fc;
       key_size = sizeof(int);
       signal_len = 1 << iout->log2_fft_size;
@@ -1235,9 +1614,8 @@ static void* spectrum_monitoring(void *args) {
 	
 #if defined(MEASURE_SIMILARITY)
 	// File format: TimeSecs, TimeMicrosecs, CenterFrequency, LatestSimilarity, EMASimilarity
-	FILE *f_stat_similarity = fopen("dat/stats/f_stat_similarity.dat", "a");
-	fprintf(f_stat_similarity, "%u, %u, %u, %.5f, %.5f\n", iout->Ts_sec, iout->Ts_usec, key, s, hentry->similarity);
-	fclose(f_stat_similarity);
+	if(f_stat_similarity != NULL)
+	  fprintf(f_stat_similarity, "%u, %u, %u, %.5f, %.5f\n", iout->Ts_sec, iout->Ts_usec, key, s, hentry->similarity);
 #endif
 	
 	// Keep latest signal in history
@@ -1265,8 +1643,9 @@ static void* spectrum_monitoring(void *args) {
 	unsigned int freq_step;
 	
 	// Set hopping strategy dependent callbacks
-	if(samp_wind_ctx != NULL) samp_wind_ctx->callback = NULL;
+	for(i=0; samp_wind_ctxs != NULL && i<sdr_src_cnt; ++i) samp_wind_ctxs[i]->callback = NULL;
 	if(fft_ctx != NULL) fft_ctx->callback = similarity_fft_callback;
+	if(reor_ctx != NULL) reor_ctx->callback = NULL;
 	if(avg_ctx != NULL) avg_ctx->callback = NULL;
 	if(cmpr_ctx != NULL) cmpr_ctx->callback = NULL;
 	if(tcp_trns_ctx != NULL) tcp_trns_ctx->callback = NULL;
@@ -1308,12 +1687,8 @@ static void* spectrum_monitoring(void *args) {
 	for(i=0; i<full_length; ++i) freq_overlaps[i] = freq_overlap;
 	
 	// Windowing functions
-	window_fun_ptr_t window_fun = NULL;
-	if(window_fun_id == HANNING_WINDOW) window_fun = hanning_window;
-	else if(window_fun_id == BLACKMAN_HARRIS_WINDOW) window_fun = blackman_harris_4_window;
-	else window_fun = rectangular_window;
-	window_funs = (window_fun_ptr_t *) malloc(full_length*sizeof(window_fun_ptr_t));
-	for(i=0; i<full_length; ++i) window_funs[i] = window_fun;
+	window_fun_ids = (int *) malloc(full_length*sizeof(int));
+	for(i=0; i<full_length; ++i) window_fun_ids[i] = window_fun_id;
 
       }
       
@@ -1359,7 +1734,8 @@ static void* spectrum_monitoring(void *args) {
     // Read spectrum monitoring context
     min_freq = spec_moni_ctx->min_freq;
     max_freq = spec_moni_ctx->max_freq;
-    clk_off = spec_moni_ctx->clk_off;
+    clk_offs = (int *) malloc(sdr_src_cnt*sizeof(int));
+    memcpy(clk_offs, spec_moni_ctx->clk_offs, sdr_src_cnt*sizeof(int));
     samp_rate = spec_moni_ctx->samp_rate;
     log2_fft_size = spec_moni_ctx->log2_fft_size;
     avg_factor = spec_moni_ctx->avg_factor;
@@ -1367,7 +1743,9 @@ static void* spectrum_monitoring(void *args) {
     monitor_time = spec_moni_ctx->monitor_time;
     min_time_res = spec_moni_ctx->min_time_res;
     fft_batchlen = spec_moni_ctx->fft_batchlen;
+    fft_workers = spec_moni_ctx->fft_workers;
     cmpr_level = spec_moni_ctx->cmpr_level;
+    stats_period = spec_moni_ctx->stats_period;
     gain = spec_moni_ctx->gain;
     freq_overlap = spec_moni_ctx->freq_overlap;
     if(spec_moni_ctx->hopping_strategy_id == RANDOM_HOPPING_STRATEGY)
@@ -1379,10 +1757,16 @@ static void* spectrum_monitoring(void *args) {
     hopping_strategy_id = spec_moni_ctx->hopping_strategy_id;
     window_fun_id = spec_moni_ctx->window_fun_id;
     
+    // Compute window coefficients (e.g. the filter bank prototype) before the first hop
+    DSP_window_table(window_fun_id, 1<<log2_fft_size);
+    
     // Initialize history
     hist_htable_mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
     pthread_mutex_init(hist_htable_mut, NULL);
     similarity_hist_htable = NULL;
+#if defined(MEASURE_SIMILARITY)
+    f_stat_similarity = fopen("dat/stats/f_stat_similarity.dat", "a");
+#endif
     
     // Parse TCP hosts
     parse_tcp_hosts();
@@ -1397,86 +1781,145 @@ static void* spectrum_monitoring(void *args) {
     
     // Initialize signal processing queues
     q_size = MIN(10*fft_batchlen, 100);
-    q_fft = QUE_initialize(q_size);
-    q_avg = QUE_initialize(q_size);
-    q_cmpr = QUE_initialize(q_size);
-    q_tcp_trns = QUE_initialize(q_size);
-    
-    // Initialize signal processing contexts
-    samp_wind_ctx = (SamplingWindowingCTX *) malloc(sizeof(SamplingWindowingCTX));
-    samp_wind_ctx->gain = gain;
-    samp_wind_ctx->hopping_strategy_id = hopping_strategy_id;
-    samp_wind_ctx->window_fun_id = window_fun_id;
-    THR_initialize(&(samp_wind_ctx->thread), THR_SAMP_WIND);
+    // Lock-free between single threads, the devices serialize their insertions by hop_mut
+    q_fft = (fft_workers > 1) ? QUE_initialize(q_size) : QUE_initialize_spsc(q_size);
+    if(fft_workers > 1) q_reor = QUE_initialize(q_size);
+    q_avg = QUE_initialize_spsc(q_size);
+    q_cmpr = QUE_initialize_spsc(q_size);
+    q_tcp_trns = QUE_initialize_spsc(q_size);
+    
+    // Initialize pool of items and sample buffers
+    spec_moni_ctx->pool = ITE_pool_init();
+    
+    // Initialize signal processing contexts, one sampling windowing context per device
+    samp_wind_ctxs = (SamplingWindowingCTX **) malloc(sdr_src_cnt*sizeof(SamplingWindowingCTX *));
+    for(d=0; d<sdr_src_cnt; ++d) {
+      samp_wind_ctx = (SamplingWindowingCTX *) malloc(sizeof(SamplingWindowingCTX));
+      samp_wind_ctx->callback = NULL;
+      samp_wind_ctx->src = sdr_srcs[d];
+      samp_wind_ctx->gain = gain;
+      samp_wind_ctx->acq_bufs = spec_moni_ctx->acq_bufs;
+      samp_wind_ctx->hopping_strategy_id = hopping_strategy_id;
+      samp_wind_ctx->window_fun_id = window_fun_id;
+      samp_wind_ctx->averaging_id = spec_moni_ctx->averaging_id;
+      THR_initialize(&(samp_wind_ctx->thread), THR_SAMP_WIND);
+      // Device d is pinned to CPU cpu+d
+      samp_wind_ctx->thread->sched = manager_ctx->scheds[THR_SAMP_WIND];
+      if(samp_wind_ctx->thread->sched.cpu >= 0) samp_wind_ctx->thread->sched.cpu += d;
+      samp_wind_ctxs[d] = samp_wind_ctx;
+    }
+    spec_moni_ctx->samp_wind_cnt = sdr_src_cnt;
+    spec_moni_ctx->samp_wind_done = 0;
+    spec_moni_ctx->hop_mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(spec_moni_ctx->hop_mut, NULL);
+    spec_moni_ctx->seq = 0;
     
+    // Initialize signal processing stages
     fft_ctx = (FFTCTX *) malloc(sizeof(FFTCTX));
+    fft_ctx->callback = NULL;
     fft_ctx->fft_batchlen = fft_batchlen;
-    THR_initialize(&(fft_ctx->thread), THR_FFT);
+    fft_ctx->averaging_id = spec_moni_ctx->averaging_id;
+    fft_ctx->reor_ctx = NULL;
+    fft_stg = STG_initialize("FFT ", THR_FFT, fft_workers, fft_batchlen);
+    fft_stg->ctx = fft_ctx;
+    fft_stg->sched = manager_ctx->scheds[THR_FFT];
+    fft_stg->init = fft_init;
+    fft_stg->process = fft;
+    fft_stg->flush = fft_flush;
+    fft_stg->release = fft_release;
+    fft_stg->qin = q_fft;
+    STG_output(fft_stg, (fft_workers > 1) ? q_reor : q_avg);
+    
+    // Parallel FFT workers complete out of order
+    if(fft_workers > 1) {
+      reor_ctx = (ReorderingCTX *) malloc(sizeof(ReorderingCTX));
+      reor_ctx->callback = NULL;
+      // Items in the queues and the workers' batches, the workers wait when they get further ahead
+      reor_ctx->window = q_size + fft_workers*fft_batchlen;
+      reor_ctx->next_seq = 0;
+      reor_ctx->mut = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
+      pthread_mutex_init(reor_ctx->mut, NULL);
+      reor_ctx->advanced = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
+      pthread_cond_init(reor_ctx->advanced, NULL);
+      fft_ctx->reor_ctx = reor_ctx;
+      reor_stg = STG_initialize("REOR", THR_REORDER, 1, fft_batchlen);
+      reor_stg->ctx = reor_ctx;
+      reor_stg->sched = manager_ctx->scheds[THR_REORDER];
+      reor_stg->init = reordering_init;
+      reor_stg->process = reordering;
+      reor_stg->release = reordering_release;
+      reor_stg->qin = q_reor;
+      STG_output(reor_stg, q_avg);
+    }
     
+    // Averaging relies on the order of the items, so it runs a single worker
     avg_ctx = (AveragingCTX *) malloc(sizeof(AveragingCTX));
-    THR_initialize(&(avg_ctx->thread), THR_AVG);
+    avg_ctx->callback = NULL;
+    avg_stg = STG_initialize("AVG ", THR_AVG, 1, fft_batchlen);
+    avg_stg->ctx = avg_ctx;
+    avg_stg->sched = manager_ctx->scheds[THR_AVG];
+    avg_stg->init = averaging_init;
+    avg_stg->process = averaging;
+    avg_stg->release = averaging_release;
+    avg_stg->qin = q_avg;
+    STG_output(avg_stg, q_cmpr);
     
     cmpr_ctx = (CompressionCTX *) malloc(sizeof(CompressionCTX));
-    THR_initialize(&(cmpr_ctx->thread), THR_CMPR);
+    cmpr_ctx->callback = NULL;
+    cmpr_stg = STG_initialize("CMPR", THR_CMPR, 1, fft_batchlen);
+    cmpr_stg->ctx = cmpr_ctx;
+    cmpr_stg->sched = manager_ctx->scheds[THR_CMPR];
+    cmpr_stg->init = compression_init;
+    cmpr_stg->process = compression;
+    cmpr_stg->release = compression_release;
+    cmpr_stg->qin = q_cmpr;
+    STG_output(cmpr_stg, q_tcp_trns);
     
     tcp_trns_ctx = (TcpTransmissionCTX *) malloc(sizeof(TcpTransmissionCTX));
+    tcp_trns_ctx->callback = NULL;
     tcp_trns_ctx->tcp_hosts_cnt = tcp_hosts_cnt;
     tcp_trns_ctx->tcp_host_lst = spec_moni_ctx->tcp_hosts;
     tcp_trns_ctx->tcp_hosts = tcp_hosts;
     tcp_trns_ctx->tcp_ports = tcp_ports;
     tcp_trns_ctx->tcp_bandwidths = tcp_bandwidths;
-    THR_initialize(&(tcp_trns_ctx->thread), THR_TCP_TRNS);
-    
-    // Initialize signal processing arguments
-    samp_wind_arg = (SamplingWindowingARG *) malloc(sizeof(SamplingWindowingARG));
-    samp_wind_arg->spec_moni_ctx = spec_moni_ctx;
-    samp_wind_arg->samp_wind_ctx = samp_wind_ctx;
-    samp_wind_arg->qin = NULL;
-    samp_wind_arg->qsout_cnt = 1;
-    samp_wind_arg->qsout = (Queue **) malloc(samp_wind_arg->qsout_cnt*sizeof(Queue *));
-    samp_wind_arg->qsout[0] = q_fft;
-    
-    fft_arg = (FFTARG *) malloc(sizeof(FFTARG));
-    fft_arg->spec_moni_ctx = spec_moni_ctx;
-    fft_arg->fft_ctx = fft_ctx;
-    fft_arg->qin = q_fft;
-    fft_arg->qsout_cnt = 1;
-    fft_arg->qsout = (Queue **) malloc(fft_arg->qsout_cnt*sizeof(Queue *));
-    fft_arg->qsout[0] = q_avg;
-    
-    avg_arg = (AveragingARG *) malloc(sizeof(AveragingARG));
-    avg_arg->spec_moni_ctx = spec_moni_ctx;
-    avg_arg->avg_ctx = avg_ctx;
-    avg_arg->qin = q_avg;
-    avg_arg->qsout_cnt = 1;
-    avg_arg->qsout = (Queue **) malloc(avg_arg->qsout_cnt*sizeof(Queue *));
-    avg_arg->qsout[0] = q_cmpr;
-
-    cmpr_arg = (CompressionARG *) malloc(sizeof(CompressionARG));
-    cmpr_arg->spec_moni_ctx = spec_moni_ctx;
-    cmpr_arg->cmpr_ctx = cmpr_ctx;
-    cmpr_arg->qin = q_cmpr;
-    cmpr_arg->qsout_cnt = 1;
-    cmpr_arg->qsout = (Queue **) malloc(cmpr_arg->qsout_cnt*sizeof(Queue *));
-    cmpr_arg->qsout[0] = q_tcp_trns;
-    
-    tcp_trns_arg = (TcpTransmissionARG *) malloc(sizeof(TcpTransmissionARG));
-    tcp_trns_arg->spec_moni_ctx = spec_moni_ctx;
-    tcp_trns_arg->tcp_trns_ctx = tcp_trns_ctx;
-    tcp_trns_arg->qin = q_tcp_trns;
-    tcp_trns_arg->qsout_cnt = 0;
-    tcp_trns_arg->qsout = (Queue **) malloc(tcp_trns_arg->qsout_cnt*sizeof(Queue *));
-
+    tcp_trns_stg = STG_initialize("TTRS", THR_TCP_TRNS, 1, fft_batchlen);
+    tcp_trns_stg->ctx = tcp_trns_ctx;
+    tcp_trns_stg->sched = manager_ctx->scheds[THR_TCP_TRNS];
+    tcp_trns_stg->init = tcp_transmission_init;
+    tcp_trns_stg->process = tcp_transmission;
+    tcp_trns_stg->release = tcp_transmission_release;
+    tcp_trns_stg->qin = q_tcp_trns;
+    
+    // Initialize signal processing arguments, all devices feed the same FFT queue
+    samp_wind_args = (SamplingWindowingARG **) malloc(sdr_src_cnt*sizeof(SamplingWindowingARG *));
+    for(d=0; d<sdr_src_cnt; ++d) {
+      samp_wind_args[d] = (SamplingWindowingARG *) malloc(sizeof(SamplingWindowingARG));
+      samp_wind_args[d]->spec_moni_ctx = spec_moni_ctx;
+      samp_wind_args[d]->samp_wind_ctx = samp_wind_ctxs[d];
+      samp_wind_args[d]->qin = NULL;
+      samp_wind_args[d]->qsout_cnt = 1;
+      samp_wind_args[d]->qsout = (Queue **) malloc(samp_wind_args[d]->qsout_cnt*sizeof(Queue *));
+      samp_wind_args[d]->qsout[0] = q_fft;
+    }
     
     // Start signal processing threads
-    pthread_mutex_lock(samp_wind_ctx->thread->lock);
-    pthread_create(tcp_trns_ctx->thread->fd, NULL, tcp_transmission, tcp_trns_arg);
-    pthread_create(cmpr_ctx->thread->fd, NULL, compression, cmpr_arg);
-    pthread_create(avg_ctx->thread->fd, NULL, averaging, avg_arg);
-    pthread_create(fft_ctx->thread->fd, NULL, fft, fft_arg);
-    pthread_create(samp_wind_ctx->thread->fd, NULL, sampling_windowing, samp_wind_arg);
-    pthread_cond_wait(spec_moni_ctx->thread->awake, samp_wind_ctx->thread->lock);
-    pthread_mutex_unlock(samp_wind_ctx->thread->lock);
+    STG_start(tcp_trns_stg);
+    STG_start(cmpr_stg);
+    STG_start(avg_stg);
+    if(reor_stg != NULL) STG_start(reor_stg);
+    STG_start(fft_stg);
+    if(stats_period > 0) {
+      THR_initialize(&stats_thread, THR_STATS);
+      stats_thread->sched = manager_ctx->scheds[THR_STATS];
+      pthread_create(stats_thread->fd, NULL, statistics, NULL);
+    }
+    for(d=0; d<sdr_src_cnt; ++d) {
+      samp_wind_ctx = samp_wind_ctxs[d];
+      pthread_mutex_lock(samp_wind_ctx->thread->lock);
+      pthread_create(samp_wind_ctx->thread->fd, NULL, sampling_windowing, samp_wind_args[d]);
+      pthread_cond_wait(spec_moni_ctx->thread->awake, samp_wind_ctx->thread->lock);
+      pthread_mutex_unlock(samp_wind_ctx->thread->lock);
+    }
     spec_moni_ctx->thread->flags |= FLAG_SAMP_WIND;
     
 
@@ -1515,24 +1958,29 @@ static void* spectrum_monitoring(void *args) {
 	  // Hopping strategy
 	  hopping_strategy();
 	  
-	  // Update sampling windowing context
-	  pthread_mutex_lock(samp_wind_ctx->thread->lock);
-	  samp_wind_ctx->clk_off = clk_off;
-	  samp_wind_ctx->length = length;
-	  samp_wind_ctx->samp_rates = samp_rates;
-	  samp_wind_ctx->log2_fft_sizes = log2_fft_sizes;
-	  samp_wind_ctx->avg_factors = avg_factors;
-	  samp_wind_ctx->soverlaps = soverlaps;
-	  samp_wind_ctx->cmpr_levels = cmpr_levels;
-	  samp_wind_ctx->center_freqs = center_freqs;
-	  samp_wind_ctx->freq_overlaps = freq_overlaps;
-	  samp_wind_ctx->window_funs = window_funs;
-	  samp_wind_ctx->hopping_strategy_id = hopping_strategy_id;
-	  samp_wind_ctx->window_fun_id = window_fun_id;
-	  
-	  // Start sampling windowing
-	  pthread_cond_signal(samp_wind_ctx->thread->awake);
-	  pthread_mutex_unlock(samp_wind_ctx->thread->lock);
+	  // Update sampling windowing contexts, each device sweeps a contiguous slice of the hops
+	  spec_moni_ctx->samp_wind_done = 0;
+	  for(d=0; d<sdr_src_cnt; ++d) {
+	    samp_wind_ctx = samp_wind_ctxs[d];
+	    offset = d*length/sdr_src_cnt;
+	    pthread_mutex_lock(samp_wind_ctx->thread->lock);
+	    samp_wind_ctx->clk_off = clk_offs[d];
+	    samp_wind_ctx->length = (d+1)*length/sdr_src_cnt - offset;
+	    samp_wind_ctx->samp_rates = samp_rates + offset;
+	    samp_wind_ctx->log2_fft_sizes = log2_fft_sizes + offset;
+	    samp_wind_ctx->avg_factors = avg_factors + offset;
+	    samp_wind_ctx->soverlaps = soverlaps + offset;
+	    samp_wind_ctx->cmpr_levels = cmpr_levels + offset;
+	    samp_wind_ctx->center_freqs = center_freqs + offset;
+	    samp_wind_ctx->freq_overlaps = freq_overlaps + offset;
+	    samp_wind_ctx->window_fun_ids = window_fun_ids + offset;
+	    samp_wind_ctx->hopping_strategy_id = hopping_strategy_id;
+	    samp_wind_ctx->window_fun_id = window_fun_id;
+	    
+	    // Start sampling windowing
+	    pthread_cond_signal(samp_wind_ctx->thread->awake);
+	    pthread_mutex_unlock(samp_wind_ctx->thread->lock);
+	  }
 
 	}
 	
@@ -1561,63 +2009,106 @@ EXIT_SPECTRUM_MONITORING:
      */
     
     // Ask signal processing threads to terminate
-    pthread_mutex_lock(samp_wind_ctx->thread->lock);
-    samp_wind_ctx->thread->is_running = 0;
-    pthread_mutex_unlock(samp_wind_ctx->thread->lock);
-    
-    // Awake signal processing threads when sleeping
-    pthread_cond_signal(samp_wind_ctx->thread->awake);
+    for(d=0; d<sdr_src_cnt; ++d) {
+      samp_wind_ctx = samp_wind_ctxs[d];
+      pthread_mutex_lock(samp_wind_ctx->thread->lock);
+      samp_wind_ctx->thread->is_running = 0;
+      pthread_mutex_unlock(samp_wind_ctx->thread->lock);
+      
+      // Awake signal processing threads when sleeping
+      pthread_cond_signal(samp_wind_ctx->thread->awake);
+    }
     
     // Join signal processing threads
     pthread_mutex_unlock(spec_moni_ctx->thread->lock);
-    pthread_join(*(samp_wind_ctx->thread->fd), NULL);
-    pthread_join(*(fft_ctx->thread->fd), NULL);
-    pthread_join(*(avg_ctx->thread->fd), NULL);
-    pthread_join(*(cmpr_ctx->thread->fd), NULL);
-    pthread_join(*(tcp_trns_ctx->thread->fd), NULL);
+    for(d=0; d<sdr_src_cnt; ++d) pthread_join(*(samp_wind_ctxs[d]->thread->fd), NULL);
+    STG_join(fft_stg);
+    if(reor_stg != NULL) STG_join(reor_stg);
+    STG_join(avg_stg);
+    STG_join(cmpr_stg);
+    STG_join(tcp_trns_stg);
     pthread_mutex_lock(spec_moni_ctx->thread->lock);
     
+    // Terminate statistics thread and print the final counters
+    if(stats_thread != NULL) {
+      pthread_mutex_lock(stats_thread->lock);
+      stats_thread->is_running = 0;
+      pthread_cond_signal(stats_thread->awake);
+      pthread_mutex_unlock(stats_thread->lock);
+      pthread_join(*(stats_thread->fd), NULL);
+      THR_release(stats_thread);
+      stats_thread = NULL;
+    }
+#if defined(VERBOSE)
+    print_stats();
+#else
+    if(stats_period > 0) print_stats();
+#endif
+    
     // Free hosts
     free(tcp_hosts);
     free(tcp_ports);
     free(tcp_bandwidths);
     
     // Free output queues
-    free(samp_wind_arg->qsout);
-    free(fft_arg->qsout);
-    free(avg_arg->qsout);
-    free(cmpr_arg->qsout);
-    free(tcp_trns_arg->qsout);
+    for(d=0; d<sdr_src_cnt; ++d) free(samp_wind_args[d]->qsout);
     
     // Free signal processing arguments
-    free(samp_wind_arg);
-    free(fft_arg);
-    free(avg_arg);
-    free(cmpr_arg);
-    free(tcp_trns_arg);
+    for(d=0; d<sdr_src_cnt; ++d) free(samp_wind_args[d]);
+    free(samp_wind_args);
     
     // Free signal processing contexts
-    THR_release(samp_wind_ctx->thread);
-    free(samp_wind_ctx);
+    for(d=0; d<sdr_src_cnt; ++d) {
+      THR_release(samp_wind_ctxs[d]->thread);
+      free(samp_wind_ctxs[d]);
+    }
+    free(samp_wind_ctxs);
+    pthread_mutex_destroy(spec_moni_ctx->hop_mut);
+    free(spec_moni_ctx->hop_mut);
     
-    THR_release(fft_ctx->thread);
+    // Free signal processing stages
+    STG_release(fft_stg);
     free(fft_ctx);
+    fft_ctx = NULL;
+    
+    if(reor_stg != NULL) {
+      STG_release(reor_stg);
+      pthread_cond_destroy(reor_ctx->advanced);
+      free(reor_ctx->advanced);
+      pthread_mutex_destroy(reor_ctx->mut);
+      free(reor_ctx->mut);
+      free(reor_ctx);
+      reor_stg = NULL;
+      reor_ctx = NULL;
+    }
     
-    THR_release(avg_ctx->thread);
+    STG_release(avg_stg);
     free(avg_ctx);
+    avg_ctx = NULL;
     
-    THR_release(cmpr_ctx->thread);
+    STG_release(cmpr_stg);
     free(cmpr_ctx);
+    cmpr_ctx = NULL;
     
-    THR_release(tcp_trns_ctx->thread);
+    STG_release(tcp_trns_stg);
     free(tcp_trns_ctx);
+    tcp_trns_ctx = NULL;
     
     // Free signal processing queues
     QUE_release(q_fft);
+    if(q_reor != NULL) QUE_release(q_reor);
     QUE_release(q_avg);
     QUE_release(q_cmpr);
     QUE_release(q_tcp_trns);
     
+    // Free pool, all items have been returned by now
+#if defined(VERBOSE)
+    fprintf(stderr, "[FMON] Pool saved %lu of %lu allocations.\n",
+	    atomic_load(&spec_moni_ctx->pool->saved), atomic_load(&spec_moni_ctx->pool->allocs));
+#endif
+    ITE_pool_release(spec_moni_ctx->pool);
+    spec_moni_ctx->pool = NULL;
+    
     SimilarityHistEntry *similarity_centry, *similarity_tentry;
     HASH_ITER(hh, similarity_hist_htable, similarity_centry, similarity_tentry) {
       HASH_DELETE(hh, similarity_hist_htable, similarity_centry);
@@ -1627,7 +2118,11 @@ EXIT_SPECTRUM_MONITORING:
 
     pthread_mutex_destroy(hist_htable_mut);
     free(hist_htable_mut);
+#if defined(MEASURE_SIMILARITY)
+    if(f_stat_similarity != NULL) fclose(f_stat_similarity);
+#endif
     
+    free(clk_offs);
     free(samp_rates);
     free(log2_fft_sizes);
     free(avg_factors);
@@ -1636,7 +2131,7 @@ EXIT_SPECTRUM_MONITORING:
     free(center_freqs);
     free(full_center_freqs);
     free(freq_overlaps);
-    free(window_funs);
+    free(window_fun_ids);
   }
   
   
@@ -1645,6 +2140,8 @@ EXIT_SPECTRUM_MONITORING:
   manager_ctx = (ManagerCTX *) spec_moni_arg->manager_ctx;
   spec_moni_ctx = (SpectrumMonitoringCTX *) spec_moni_arg->spec_moni_ctx;
   
+  THR_sched_apply(&(spec_moni_ctx->thread->sched), 0, "SMON");
+  
 #if defined(VERBOSE) || defined(TID)
 #if defined(RPI_GPU)
   fprintf(stderr, "[SMON] Started.\tTID: %li\n", (long int) syscall(224));
@@ -1680,24 +2177,32 @@ EXIT_SPECTRUM_MONITORING:
 }
 
 static void* sampling_windowing(void *args) {
-  int i, j, l;
-  uint8_t *iq_buf = NULL;
+  int i, last;
+  Buffer *iq_buf = NULL;
   struct timeval tv;
   unsigned int slen = 0;
   
   float gain;
   unsigned int prev_length = 0, length;
-  unsigned int samp_rate, *samp_rates = NULL, prev_samp_rate = 0;
-  unsigned int prev_fft_size = 0, fft_size, *log2_fft_sizes = NULL;
-  unsigned int prev_avg_factor = 0, avg_factor, *avg_factors = NULL;
-  unsigned int prev_soverlap = 0, soverlap, *soverlaps = NULL;
-  unsigned int cmpr_level, *cmpr_levels = NULL;
-  unsigned int center_freq, *center_freqs = NULL, prev_center_freq = 0;
+  unsigned int *samp_rates = NULL, prev_samp_rate = 0;
+  unsigned int *log2_fft_sizes = NULL;
+  unsigned int *avg_factors = NULL;
+  unsigned int *soverlaps = NULL;
+  unsigned int *cmpr_levels = NULL;
+  unsigned int *center_freqs = NULL, prev_center_freq = 0;
   int hopping_strategy_id;
-  int window_fun_id;
+  int averaging_id;
   int clk_off;
-  float freq_overlap, *freq_overlaps = NULL;
-  window_fun_ptr_t window_fun, *window_funs = NULL;
+  float *freq_overlaps = NULL;
+  int *window_fun_ids = NULL;
+  
+  unsigned int acq_bufs;
+  SDR_Source *sdr_src;
+  SDR_Async *sdr_async = NULL;
+  SDR_Buffers *sdr_bufs = NULL;
+  SDR_Hop *hop;
+  float *means = NULL;			// DC bias of the segments of a hop
+  unsigned int means_cnt = 0;
   
   SamplingWindowingARG *samp_wind_arg;
   SpectrumMonitoringCTX *spec_moni_ctx;
@@ -1705,16 +2210,12 @@ static void* sampling_windowing(void *args) {
   
   size_t k, qsout_cnt;
   Queue **qsout;
-  Item  *iout, *nout;
-  
-#if defined(MEASURE_SAWI)
-  struct timespec tstartA = {0,0}, tendA = {0,0};
-  struct timespec tstartB = {0,0}, tendB = {0,0};
-  FILE *f_stat_sawi_sweep = fopen("dat/stats/f_stat_sawi_sweep.dat", "w");
-  FILE *f_stat_sawi_set_sample_rate = fopen("dat/stats/f_stat_sawi_set_sample_rate.dat", "w");
-  FILE *f_stat_sawi_retune = fopen("dat/stats/f_stat_sawi_retune.dat", "w");
-  FILE *f_stat_sawi_read = fopen("dat/stats/f_stat_sawi_read.dat", "w");
-#endif
+  
+  // Retuning and reading are measured by the sample source
+  uint64_t t0, t1;
+  Histogram *m_sweep = MET_histogram("sawi_sweep_ns");
+  Histogram *m_hop_wait = MET_histogram("sawi_hop_wait_ns");
+  Counter *m_hops = MET_counter("sawi_hops");
   
   // Parse arguments
   samp_wind_arg = (SamplingWindowingARG *) args;
@@ -1726,16 +2227,196 @@ static void* sampling_windowing(void *args) {
   // Fixed parameters
   gain = samp_wind_ctx->gain;
   hopping_strategy_id = samp_wind_ctx->hopping_strategy_id;
-  window_fun_id = samp_wind_ctx->window_fun_id;
+  averaging_id = samp_wind_ctx->averaging_id;
+  acq_bufs = samp_wind_ctx->acq_bufs;
+  sdr_src = samp_wind_ctx->src;
+  
+  // The asynchronous acquisition engine started below inherits the scheduling
+  THR_sched_apply(&(samp_wind_ctx->thread->sched), 0, "SAWI");
+  
+  /*! Whether zoom band b lies in the alias-free part of hop i
+   */
+  int zoom_band(int i, unsigned int b) {
+    double offset = (double) spec_moni_ctx->zoom_freqs[b] - center_freqs[i];
+    double half_width = 2*DSP_ZOOM_PASSBAND * samp_rates[i] / (1<<spec_moni_ctx->zoom_log2_decims[b]);
+    return fabs(offset) + half_width <= (1-freq_overlaps[i]) * samp_rates[i] / 2;
+  }
+  
+  /*! Length of the interleaved I/Q stream to read for hop i
+   */
+  unsigned int hop_length(int i) {
+    unsigned int b, len, fft_size = 1<<log2_fft_sizes[i];
+    unsigned int span = DSP_window_taps(window_fun_ids[i])*fft_size;
+    len = ((fft_size-soverlaps[i])*(avg_factors[i]-1)+span)*2;
+    // Zoom bands need at least one segment after decimation
+    for(b=0; b<spec_moni_ctx->zoom_cnt; ++b)
+      if(zoom_band(i, b) && 2*DSP_zoom_input(span, spec_moni_ctx->zoom_log2_decims[b]) > len)
+	len = 2*DSP_zoom_input(span, spec_moni_ctx->zoom_log2_decims[b]);
+    // NOTE: libusb_bulk_transfer for RTL-SDR seems to crash when not reading multiples of 512
+    if(len % 512 != 0) len = len + (512 - (len % 512));
+    return len;
+  }
+  
+  /*! Submit hop i for asynchronous acquisition
+   */
+  void submit(int i) {
+    if(SDR_async_submit(sdr_async, samp_rates[i], center_freqs[i], hop_length(i)) != 0) {
+      fprintf(stderr, "[SAWI] ERROR: Failed allocating hop buffer.\n");
+      exit(1);
+    }
+  }
+  
+  /*! Write item to the output queues
+   */
+  void push(Item *iout) {
+    size_t k;
+    
+    // Strategy dependent callback to the monitoring logic
+    if(samp_wind_ctx != NULL && samp_wind_ctx->callback != NULL)
+      samp_wind_ctx->callback(iout);
+    
+    // Single output queue
+    if(qsout_cnt == 1) {
+#if defined(VERBOSE) || defined(VERBOSE_SAWI)
+      fprintf(stderr, "[SAWI] Push item %u to output queue 0.\n", iout->avg_index);
+#endif
+      // Write item to output queue, waits while the queue is full
+      QUE_insert(qsout[0], iout);
+    }
+    // Multiple output queues
+    else if(qsout_cnt > 1) {
+      // Share item with the output queues, one reference per queue
+      ITE_retain(iout, qsout_cnt-1);
+      for(k=0; k<qsout_cnt; ++k) {
+#if defined(VERBOSE) || defined(VERBOSE_SAWI)
+	fprintf(stderr, "[SAWI] Push item %u to output queue %zd.\n", iout->avg_index, k);
+#endif
+	// Write item to output queue, waits while the queue is full
+	QUE_insert(qsout[k], iout);
+      }
+    }
+  }
+  
+  /*! Segmentation and DC bias estimation of hop i
+   * 
+   * Items reference their segment in the shared I/Q stream, windowing is done by the FFT stage. With
+   * Welch averaging, a single item references all segments of the hop and the FFT stage averages them.
+   */
+  void process_hop(int i, Buffer *iq_buf, const struct timeval *tv) {
+    int j;
+    unsigned int b;
+    Item *iout;
+    
+    unsigned int samp_rate = samp_rates[i];
+    unsigned int fft_size = 1<<log2_fft_sizes[i];
+    unsigned int avg_factor = avg_factors[i];
+    unsigned int soverlap = soverlaps[i];
+    unsigned int cmpr_level = cmpr_levels[i];
+    unsigned int center_freq = center_freqs[i];
+    float freq_overlap = freq_overlaps[i];
+    unsigned int span = DSP_window_taps(window_fun_ids[i])*fft_size;
+    unsigned int item_cnt = (averaging_id == WELCH_AVERAGING) ? 1 : avg_factor;
+    float *resized;
+    
+    // DC bias of all segments, estimated by the FFT stage with Welch averaging
+    if(averaging_id != WELCH_AVERAGING) {
+      if(means_cnt < avg_factor) {
+	resized = (float *) realloc(means, 2*avg_factor*sizeof(float));
+	if(resized == NULL) {
+	  fprintf(stderr, "[SAWI] WARNING: Out of memory, dropped hop at %u Hz.\n", center_freq);
+	  return;
+	}
+	means = resized;
+	means_cnt = avg_factor;
+      }
+      DSP_segment_means(means, iq_buf->data, span, fft_size-soverlap, avg_factor);
+    }
+    
+    // Don't interleave with segments of hops from other devices
+    pthread_mutex_lock(spec_moni_ctx->hop_mut);
+    
+    for(j=0; j<item_cnt; ++j) {
+      
+      // Initialize output item
+      iout = ITE_pool_item(spec_moni_ctx->pool);
+      iout->Fc = center_freq;
+      iout->Ts_sec = (uint32_t) tv->tv_sec;
+      iout->Ts_usec = (uint32_t) tv->tv_usec;
+      iout->hopping_strategy_id = hopping_strategy_id;
+      iout->window_fun_id = window_fun_ids[i];
+      iout->gain = gain;
+      iout->samp_rate = samp_rate;
+      iout->log2_fft_size = log2_fft_sizes[i];
+      iout->avg_index = item_cnt-j;
+      iout->avg_factor = avg_factor;
+      iout->cmpr_level = cmpr_level;
+      iout->freq_overlap = freq_overlap;
+      iout->soverlap = soverlap;
+      
+      iout->iq_buf = ITE_buffer_retain(iq_buf);
+      if(averaging_id == WELCH_AVERAGING) {
+	iout->iq_offset = 0;
+	iout->iq_size = ((fft_size-soverlap)*(avg_factor-1)+span)*2;
+	iout->iq_mean[0] = 0;
+	iout->iq_mean[1] = 0;
+      } else {
+	iout->iq_offset = j*(fft_size-soverlap)*2;
+	iout->iq_size = span*2;
+	iout->iq_mean[0] = means[2*j];
+	iout->iq_mean[1] = means[2*j+1];
+      }
+      iout->seq = spec_moni_ctx->seq++;
+      
+      push(iout);
+    }
+    
+    // Zoom bands, a single item references the whole hop and the FFT stage zooms in
+    for(b=0; b<spec_moni_ctx->zoom_cnt; ++b) {
+      if(!zoom_band(i, b)) continue;
+      iout = ITE_pool_item(spec_moni_ctx->pool);
+      iout->Fc = spec_moni_ctx->zoom_freqs[b];
+      iout->Ts_sec = (uint32_t) tv->tv_sec;
+      iout->Ts_usec = (uint32_t) tv->tv_usec;
+      iout->hopping_strategy_id = hopping_strategy_id;
+      iout->window_fun_id = window_fun_ids[i];
+      iout->gain = gain;
+      iout->samp_rate = samp_rate >> spec_moni_ctx->zoom_log2_decims[b];
+      iout->log2_fft_size = log2_fft_sizes[i];
+      iout->avg_index = 1;
+      iout->avg_factor = avg_factor;
+      iout->cmpr_level = cmpr_level;
+      iout->freq_overlap = 1 - 4*DSP_ZOOM_PASSBAND;
+      iout->soverlap = soverlap;
+      iout->log2_decim = spec_moni_ctx->zoom_log2_decims[b];
+      iout->zoom_shift = ((double) spec_moni_ctx->zoom_freqs[b] - center_freq) / samp_rate;
+      iout->iq_buf = ITE_buffer_retain(iq_buf);
+      iout->iq_offset = 0;
+      iout->iq_size = iq_buf->size;
+      iout->iq_mean[0] = 0;
+      iout->iq_mean[1] = 0;
+      iout->seq = spec_moni_ctx->seq++;
+      push(iout);
+    }
+    
+    pthread_mutex_unlock(spec_moni_ctx->hop_mut);
+  }
   
   // Acquire lock to RTL-SDR device
-  pthread_mutex_lock(rtlsdr_mut);
+  pthread_mutex_lock(sdr_src->mut);
   
   // Set RTL-SDR device's gain
-  SDR_set_gain(rtlsdr_dev, gain);
+  SDR_set_gain(sdr_src, gain);
+  
+  // Start asynchronous acquisition engine, otherwise recycle the hop buffers of synchronous reads
+  if(acq_bufs > 0 && (sdr_async = SDR_async_initialize(sdr_src, acq_bufs)) == NULL)
+    fprintf(stderr, "[SAWI] WARNING: Failed starting acquisition engine, reading synchronously.\n");
+  if(sdr_async == NULL && (sdr_bufs = SDR_buffers_initialize()) == NULL) {
+    fprintf(stderr, "[SAWI] ERROR: Failed allocating hop buffers.\n");
+    exit(1);
+  }
   
   // Release lock to RTL-SDR device
-  pthread_mutex_unlock(rtlsdr_mut);
+  pthread_mutex_unlock(sdr_src->mut);
   
 #if defined(VERBOSE) || defined(VERBOSE_SAWI) || defined(TID)
 #if defined(RPI_GPU)
@@ -1768,7 +2449,7 @@ static void* sampling_windowing(void *args) {
       cmpr_levels = (unsigned int *) realloc(cmpr_levels, length*sizeof(unsigned int));
       center_freqs = (unsigned int *) realloc(center_freqs, length*sizeof(unsigned int));
       freq_overlaps = (float *) realloc(freq_overlaps, length*sizeof(float));
-      window_funs = (window_fun_ptr_t *) realloc(window_funs, length*sizeof(window_fun_ptr_t));
+      window_fun_ids = (int *) realloc(window_fun_ids, length*sizeof(int));
       prev_length = length;
     }
     for(i=0; i<length; ++i) {
@@ -1779,7 +2460,7 @@ static void* sampling_windowing(void *args) {
       cmpr_levels[i] = samp_wind_ctx->cmpr_levels[i];
       center_freqs[i] = samp_wind_ctx->center_freqs[i];
       freq_overlaps[i] = samp_wind_ctx->freq_overlaps[i];
-      window_funs[i] = samp_wind_ctx->window_funs[i];
+      window_fun_ids[i] = samp_wind_ctx->window_fun_ids[i];
     }
     pthread_mutex_unlock(samp_wind_ctx->thread->lock);
  
@@ -1787,159 +2468,67 @@ static void* sampling_windowing(void *args) {
     // BEGIN SAMPLING WINDOWING
     
     // Acquire lock to RTL-SDR device
-    pthread_mutex_lock(rtlsdr_mut);
+    pthread_mutex_lock(sdr_src->mut);
     
     // Correct RTL-SDR device's clock error
-    SDR_set_freq_correction(rtlsdr_dev, clk_off);
+    SDR_set_freq_correction(sdr_src, clk_off);
     
     // Frequency hopping
-#if defined(MEASURE_SAWI)
-    TICK(tstartA);
-#endif
-    for(i=0; i<length; ++i) {
-      
-      samp_rate = samp_rates[i];
-      fft_size = 1<<log2_fft_sizes[i];
-      avg_factor = avg_factors[i];
-      soverlap = soverlaps[i];
-      cmpr_level = cmpr_levels[i];
-      center_freq = center_freqs[i];
-      freq_overlap = freq_overlaps[i];
-      window_fun = window_funs[i];
-      
-      // Buffer to store I/Q sample stream
-      if(prev_fft_size != fft_size || prev_avg_factor != avg_factor || prev_soverlap != soverlap) {
-	slen = ((fft_size-soverlap)*avg_factor+soverlap)*2;
-	// NOTE: libusb_bulk_transfer for RTL-SDR seems to crash when not reading multiples of 512
-	if(slen % 512 != 0) slen = slen + (512 - (slen % 512));
-	iq_buf = (uint8_t *) realloc(iq_buf,slen*sizeof(uint8_t));
-	prev_fft_size = fft_size;
-	prev_avg_factor = avg_factor;
-	prev_soverlap = soverlap;
-      }
-      
-      // Read I/Q samples from RTL-SDR device
-#if defined(MEASURE_SAWI)
-      TICK(tstartB);
-#endif
-      if(samp_rate != prev_samp_rate) {
-	SDR_set_sample_rate(rtlsdr_dev, samp_rate);
-	prev_samp_rate = samp_rate;
-      }
-#if defined(MEASURE_SAWI)
-      TACK(tstartB, tendB, f_stat_sawi_set_sample_rate);
-      TICK(tstartB);
-#endif
-      if(center_freq != prev_center_freq) {
-	SDR_retune(rtlsdr_dev, center_freq);
-	prev_center_freq = center_freq;
-      }
-#if defined(MEASURE_SAWI)
-      TACK(tstartB, tendB, f_stat_sawi_retune);
-      TICK(tstartB);
-#endif
-      SDR_read(rtlsdr_dev, iq_buf, slen);
-      
-#if defined(MEASURE_SAWI)
-      TACK(tstartB, tendB, f_stat_sawi_read);
-#endif
-      
+    t0 = MET_now();
+    // Asynchronous acquisition: while hop i is processed, the next hops are being read
+    if(sdr_async != NULL) {
+      for(i=0; i<length && i<acq_bufs; ++i) submit(i);
       
-      // Segmentation, DC removal and windowing
-      gettimeofday(&tv, NULL);
-      for(j=0; j<avg_factor; ++j) {
+      for(i=0; i<length; ++i) {
+	t1 = MET_now();
+	hop = SDR_async_wait(sdr_async);
+	MET_record(m_hop_wait, MET_now()-t1);
 	
-	// Initialize output item
-	iout = ITE_init();
-	iout->Fc = center_freq;
-	iout->Ts_sec = (uint32_t) tv.tv_sec;
-	iout->Ts_usec = (uint32_t) tv.tv_usec;
-	iout->samples_size = fft_size*2*sizeof(float);
-	iout->samples = (float *) malloc(iout->samples_size);
-	iout->hopping_strategy_id = hopping_strategy_id;
-	iout->window_fun_id = window_fun_id;
-	iout->gain = gain;
-	iout->samp_rate = samp_rate;
-	iout->log2_fft_size = log2_fft_sizes[i];
-	iout->avg_index = avg_factor-j;
-	iout->avg_factor = avg_factor;
-	iout->cmpr_level = cmpr_level;
-	iout->freq_overlap = freq_overlap;
-	iout->soverlap = soverlap;
+	// Segmentation, the hop buffer is handed over to the items
+	if((iq_buf = SDR_async_detach(sdr_async)) != NULL) {
+	  process_hop(i, iq_buf, &hop->tv);
+	  ITE_buffer_release(iq_buf);
+	} else
+	  fprintf(stderr, "[SAWI] WARNING: Out of memory, dropped hop at %u Hz.\n", center_freqs[i]);
 	
-	// Remove DC bias and apply windowing function
-	float i_val, q_val;
-	float i_mean = 0, q_mean = 0;
-	for(l=0; l<fft_size*2; l=l+2) {
-	  i_val = (float) iq_buf[l+j*(fft_size-soverlap)*2];
-	  q_val = (float) iq_buf[l+1+j*(fft_size-soverlap)*2];
-	  i_mean += i_val;
-	  q_mean += q_val;
-	  iout->samples[l] = i_val;
-	  iout->samples[l+1] = q_val;
-	}
-	i_mean = i_mean / fft_size;
-	q_mean = q_mean / fft_size;
-	for(l=0; l<fft_size*2; l=l+2) {
-	  iout->samples[l] = (iout->samples[l] - i_mean)*window_fun(l, fft_size);
-	  iout->samples[l+1] = (iout->samples[l+1] - q_mean)*window_fun(l, fft_size);
-	}
+	// Reuse ring slot for the next hop
+	SDR_async_recycle(sdr_async);
+	if(i+acq_bufs < length) submit(i+acq_bufs);
+      }
+    }
+    // Synchronous acquisition
+    else {
+      for(i=0; i<length; ++i) {
 	
-	// Strategy dependent callback to the monitoring logic
-	if(samp_wind_ctx != NULL && samp_wind_ctx->callback != NULL)
-	  samp_wind_ctx->callback(iout);
+	// Buffer to store I/Q sample stream, shared by the hop's items and recycled after them
+	slen = hop_length(i);
+	if((iq_buf = SDR_buffers_get(sdr_bufs, slen)) == NULL) {
+	  fprintf(stderr, "[SAWI] WARNING: Out of memory, dropped hop at %u Hz.\n", center_freqs[i]);
+	  continue;
+	}
 	
-	// Single output queue
-	if(qsout_cnt == 1) {
-	  // Wait for output queue not being full
-	  pthread_mutex_lock(qsout[0]->mut);
-	  while(qsout[0]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_SAWI)
-	    fprintf(stderr, "[SAWI] Output queue 0 full.\n");
-#endif
-	    pthread_cond_wait(qsout[0]->notFull, qsout[0]->mut);
-	  }
-	  QUE_insert(qsout[0], iout);
-#if defined(VERBOSE) || defined(VERBOSE_SAWI)
-	  fprintf(stderr, "[SAWI] Push item %u to output queue 0.\n", iout->avg_index);
-#endif
-	  pthread_mutex_unlock(qsout[0]->mut);
-	  pthread_cond_signal(qsout[0]->notEmpty);
+	// Read I/Q samples from RTL-SDR device
+	if(samp_rates[i] != prev_samp_rate) {
+	  SDR_set_sample_rate(sdr_src, samp_rates[i]);
+	  prev_samp_rate = samp_rates[i];
 	}
-	// Multiple output queues
-	else if(qsout_cnt > 1) {
-	  // Put item to output queues
-	  for(k=0; k<qsout_cnt; ++k) {
-	    // Wait for output queue not being full
-	    pthread_mutex_lock(qsout[k]->mut);
-	    while(qsout[k]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_SAWI)
-	      fprintf(stderr, "[SAWI] Output queue %zd full.\n", k);
-#endif
-	      pthread_cond_wait(qsout[k]->notFull, qsout[k]->mut);
-	    }
-	    nout = ITE_copy(iout);
-	    // Write item to output queue
-	    QUE_insert(qsout[k], nout);
-#if defined(VERBOSE) || defined(VERBOSE_SAWI)
-	    fprintf(stderr, "[SAWI] Push item %u to output queue %zd.\n", nout->avg_index, k);
-#endif
-	    pthread_mutex_unlock(qsout[k]->mut);
-	    pthread_cond_signal(qsout[k]->notEmpty);
-	  }
-	  // Release item
-	  ITE_free(iout);
+	if(center_freqs[i] != prev_center_freq) {
+	  SDR_retune(sdr_src, center_freqs[i]);
+	  prev_center_freq = center_freqs[i];
 	}
+	SDR_read(sdr_src, iq_buf->data, slen);
 	
+	// Segmentation
+	gettimeofday(&tv, NULL);
+	process_hop(i, iq_buf, &tv);
+	ITE_buffer_release(iq_buf);
       }
-      
     }
-#if defined(MEASURE_SAWI)
-    TACK(tstartA, tendA, f_stat_sawi_sweep);
-#endif
+    MET_record(m_sweep, MET_now()-t0);
+    MET_add(m_hops, length);
     
     // Release lock to RTL-SDR device
-    pthread_mutex_unlock(rtlsdr_mut);
+    pthread_mutex_unlock(sdr_src->mut);
 
     // END SAMPLING WINDOWING
 
@@ -1951,28 +2540,21 @@ static void* sampling_windowing(void *args) {
     // Write context
     pthread_mutex_lock(samp_wind_ctx->thread->lock);
     
-    // Signal monitoring logic that sampling windowing completed
+    // Signal monitoring logic that sampling windowing completed on all devices
     pthread_mutex_lock(spec_moni_ctx->thread->lock);
-    spec_moni_ctx->thread->flags |= FLAG_SAMP_WIND;
-    pthread_cond_signal(spec_moni_ctx->thread->awake);
+    if(++spec_moni_ctx->samp_wind_done == sdr_src_cnt) {
+      spec_moni_ctx->thread->flags |= FLAG_SAMP_WIND;
+      pthread_cond_signal(spec_moni_ctx->thread->awake);
+    }
     pthread_mutex_unlock(spec_moni_ctx->thread->lock);
   }
   pthread_mutex_unlock(samp_wind_ctx->thread->lock);
   
-  // Signal that we are done and no further items will appear in the queues
-  for(k=0; k<qsout_cnt; ++k) {
-    pthread_mutex_lock(qsout[k]->mut);
-    qsout[k]->exit = 1;
-    pthread_cond_signal(qsout[k]->notEmpty);
-    pthread_cond_signal(qsout[k]->notFull);
-    pthread_mutex_unlock(qsout[k]->mut);
-  }
-  
-#if defined(MEASURE_SAWI)
-  fclose(f_stat_sawi_set_sample_rate);
-  fclose(f_stat_sawi_retune);
-  fclose(f_stat_sawi_read);
-#endif
+  // Once all devices are done, signal that no further items will appear in the queues
+  pthread_mutex_lock(spec_moni_ctx->hop_mut);
+  last = (--spec_moni_ctx->samp_wind_cnt == 0);
+  pthread_mutex_unlock(spec_moni_ctx->hop_mut);
+  for(k=0; last && k<qsout_cnt; ++k) QUE_close(qsout[k]);
   
   free(samp_rates);
   free(log2_fft_sizes);
@@ -1981,8 +2563,12 @@ static void* sampling_windowing(void *args) {
   free(cmpr_levels);
   free(center_freqs);
   free(freq_overlaps);
-  free(window_funs);
-  free(iq_buf);
+  free(window_fun_ids);
+  free(means);
+  
+  // Stop asynchronous acquisition engine
+  if(sdr_async != NULL) SDR_async_release(sdr_async);
+  if(sdr_bufs != NULL) SDR_buffers_release(sdr_bufs);
   
 #if defined(VERBOSE) || defined(VERBOSE_SAWI)
   fprintf(stderr, "[SAWI] Terminated.\n");
@@ -1992,515 +2578,487 @@ static void* sampling_windowing(void *args) {
   
 }
 
-static void* fft(void *args) {
-  int i;
-  
-  unsigned int prev_log2_fft_size = 0, log2_fft_size, fft_size;
-  unsigned int fft_batchlen;
-  unsigned int batch_cnt = 0;
-  
-  FFTARG *fft_arg;
-  FFTCTX *fft_ctx;
+static void* fft_init(Stage *stg) {
+  FFTCTX *fft_ctx = (FFTCTX *) stg->ctx;
+  FFTState *st;
+  
+  st = (FFTState *) malloc(sizeof(FFTState));
+  st->fft_batchlen = fft_ctx->fft_batchlen;
+  st->its = (Item **) malloc(st->fft_batchlen*sizeof(Item *));
+  st->batch_in = (float **) calloc(st->fft_batchlen, sizeof(float *));
+  st->batch_out = (float **) malloc(st->fft_batchlen*sizeof(float *));
+  st->batch_cnt = 0;
+  st->prev_log2_fft_size = 0;
+  st->fft_size = 0;
+  st->prev_window_fun_id = -1;
+  st->window = NULL;
+  st->taps = 1;
+  st->means = NULL;
+  st->means_cnt = 0;
+  st->zoomed = NULL;
+  st->zoomed_cnt = 0;
+  st->zoom_scratch = NULL;
+  st->zoom_scratch_cnt = 0;
+  st->m_batch = MET_histogram("fft_batch_ns");
+  st->m_hop = MET_histogram("fft_hop_ns");
+  
+  // FFT resources owned by this worker
+  st->fft_engine = FFT_initialize();
+  
+  return st;
+}
 
-  size_t k, qsout_cnt;
-  Queue *qin, **qsout;
-  Item  *iin, **its, *nout;
+/*! Forward FFT of the first cnt segments of the batch
+ */
+static void fft_execute(FFTState *st, unsigned int cnt) {
+  uint64_t t0 = MET_now();
   
-  float *IQ_samples, *dB_samples;
-  float **batch_in, **batch_out;
+  if(cnt == st->fft_batchlen)
+    FFT_forward(st->fft_engine, st->batch_in, st->batch_out);
+  else
+    FFT_forward_n(st->fft_engine, st->batch_in, st->batch_out, cnt);
+  MET_record(st->m_batch, MET_now()-t0);
+}
+
+/*! Write the first cnt items of the batch to the output queues
+ */
+static void fft_push_batch(Stage *stg, FFTState *st, unsigned int cnt) {
+  FFTCTX *fft_ctx = (FFTCTX *) stg->ctx;
+  ReorderingCTX *reor_ctx = fft_ctx->reor_ctx;
+  Item **its = st->its;
+  int i;
   
-  // Parse arguments
-  fft_arg = (FFTARG *) args;
-  fft_ctx = (FFTCTX *) fft_arg->fft_ctx;
-  qin = (Queue *) fft_arg->qin;
-  qsout = (Queue **) fft_arg->qsout;
-  qsout_cnt = fft_arg->qsout_cnt;
+  // Don't run ahead of the reordering window. The batch holds consecutive items, so the worker
+  // holding the next item to write never waits.
+  if(reor_ctx != NULL) {
+    pthread_mutex_lock(reor_ctx->mut);
+    while(its[cnt-1]->seq >= reor_ctx->next_seq + reor_ctx->window)
+      pthread_cond_wait(reor_ctx->advanced, reor_ctx->mut);
+    pthread_mutex_unlock(reor_ctx->mut);
+  }
   
-  // Fixed parameters
-  fft_batchlen = fft_ctx->fft_batchlen;
+  for(i=0; i<cnt; ++i) {
+    // Release I/Q stream
+    ITE_buffer_release(its[i]->iq_buf);
+    its[i]->iq_buf = NULL;
+    // Magnitude values
+    its[i]->samples_size = (1<<its[i]->log2_fft_size)*sizeof(float);
+    // Store dB samples
+    its[i]->samples = st->batch_out[i];
+    // Strategy dependent callback to the monitoring logic
+    if(fft_ctx->callback != NULL)
+      fft_ctx->callback(its[i]);
+#if defined(VERBOSE) || defined(VERBOSE_FFT)
+    fprintf(stderr, "[FFT ] Push item %u to output queues.\n", its[i]->avg_index);
+#endif
+  }
   
-  its = (Item **) malloc(fft_batchlen*sizeof(Item *));
-  batch_in = (float **) malloc(fft_batchlen*sizeof(float *));
-  batch_out = (float **) malloc(fft_batchlen*sizeof(float *));
+  // Write items to output queues, waits while a queue is full
+  STG_push_many(stg, its, cnt);
+}
 
-#if defined(VERBOSE) || defined(VERBOSE_FFT) || defined(TID)
-#if defined(RPI_GPU)
-  fprintf(stderr, "[FFT ] Started.\tTID: %li\n", (long int) syscall(224));
-#else
-  fprintf(stderr, "[FFT ] Started.\n");
-#endif
-#endif
+/*! Welch averaging of all segments of the hop referenced by item it
+ * 
+ * The segments are transformed in batches and their linear power is accumulated in acc, which
+ * is converted to dB once at the end.
+ */
+static void fft_welch(FFTState *st, const Item *it, float *acc) {
+  int i;
+  unsigned int j, n;
+  unsigned int fft_size = st->fft_size, cnt = it->avg_factor, step = fft_size-it->soverlap;
+  const uint8_t *iq = (const uint8_t *) it->iq_buf->data + it->iq_offset;
+  
+  // DC bias of all segments
+  if(st->means_cnt < cnt) {
+    st->means = (float *) realloc(st->means, 2*cnt*sizeof(float));
+    st->means_cnt = cnt;
+  }
+  DSP_segment_means(st->means, iq, st->taps*fft_size, step, cnt);
+  
+  // Sum up magnitudes squared of all segments
+  memset(acc, 0, fft_size*sizeof(float));
+  for(j=0; j<cnt; j=j+n) {
+    n = MIN(st->fft_batchlen, cnt-j);
+    for(i=0; i<n; ++i) {
+      DSP_window_segment(st->batch_in[i], iq+(j+i)*step*2, st->window, fft_size, st->taps,
+			 st->means+2*(j+i));
+      st->batch_out[i] = acc;
+    }
+    FFT_accumulate_n(st->fft_engine, st->batch_in, st->batch_out, n);
+  }
+  
+  // Mean power, scaled by 1/N^2 as in FFT_forward, in dB
+  DSP_db(acc, acc, fft_size, 1.f / ((float) fft_size*fft_size*cnt));
+}
 
-  while(1) {
-    // Wait for input queue not being empty
-    pthread_mutex_lock(qin->mut);
-    while(qin->empty) {
-      // No more input is coming to this queue
-      if(qin->exit) {
-	pthread_mutex_unlock(qin->mut);
-	// Process remaining jobs in a smaller batch
-	if(batch_cnt > 0) {
-	  // Reinitialize FFT resources for smaller batch size
-	  FFT_release();
-	  FFT_initialize(prev_log2_fft_size, batch_cnt);
-	  // Perform batched forward FFT
-	  FFT_forward(batch_in, batch_out);
-	  // Write items to output queue
-	  for(i=0; i<batch_cnt; ++i) {
-	    // Release I/Q samples
-	    free(batch_in[i]);
-	    // Magnitude values require half the I/Q size
-	    its[i]->samples_size /= 2;
-	    // Store dB samples
-	    its[i]->samples = batch_out[i];
-	    // Strategy dependent callback to the monitoring logic
-	    if(fft_ctx != NULL && fft_ctx->callback != NULL)
-	      fft_ctx->callback(its[i]);
-	    
-	    // Single output queue
-	    if(qsout_cnt == 1) {
-	      // Wait for output queue not being full
-	      pthread_mutex_lock(qsout[0]->mut);
-	      while(qsout[0]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-		fprintf(stderr, "[FFT ] Output queue 0 full.\n");
-#endif
-		pthread_cond_wait(qsout[0]->notFull, qsout[0]->mut);
-	      }
-	      QUE_insert(qsout[0], its[i]);
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-	      fprintf(stderr, "[FFT ] Push item %u to output queue 0.\n", its[i]->avg_index);
-#endif
-	      pthread_mutex_unlock(qsout[0]->mut);
-	      pthread_cond_signal(qsout[0]->notEmpty);
-	    }
-	    // Multiple output queues
-	    else if(qsout_cnt > 1) {
-	      // Put item to output queues
-	      for(k=0; k<qsout_cnt; ++k) {
-		// Wait for output queue not being full
-		pthread_mutex_lock(qsout[k]->mut);
-		while(qsout[k]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-		  fprintf(stderr, "[FFT ] Output queue %zd full.\n", k);
-#endif
-		  pthread_cond_wait(qsout[k]->notFull, qsout[k]->mut);
-		}
-		nout = ITE_copy(its[i]);
-		// Write item to output queue
-		QUE_insert(qsout[k], nout);
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-		fprintf(stderr, "[FFT ] Push item %u to output queue %zd.\n", nout->avg_index, k);
-#endif
-		pthread_mutex_unlock(qsout[k]->mut);
-		pthread_cond_signal(qsout[k]->notEmpty);
-	      }
-	      // Release item
-	      ITE_free(its[i]);
-	    }
-	    
-	  }
-	}
-	// Release FFT resources
-	FFT_release();
-	goto EXIT;
-      }
-      // Wait for more input coming to this queue
-      pthread_cond_wait(qin->notEmpty, qin->mut);
+/*! Zoom into the band referenced by item it
+ * 
+ * The hop is mixed down and decimated, the segments of the decimated stream are transformed in
+ * batches and their linear power is averaged in acc as with Welch averaging.
+ */
+static void fft_zoom(FFTState *st, const Item *it, float *acc) {
+  int i;
+  unsigned int j, n, cnt, M;
+  unsigned int fft_size = st->fft_size, len = it->iq_size/2, step = fft_size-it->soverlap;
+  unsigned int span = st->taps*fft_size;
+  const uint8_t *iq = (const uint8_t *) it->iq_buf->data + it->iq_offset;
+  float mean[2];
+  
+  // Decimated stream
+  M = DSP_zoom_length(len, it->log2_decim);
+  if(st->zoomed_cnt < M) {
+    st->zoomed = (float *) realloc(st->zoomed, 2*M*sizeof(float));
+    st->zoomed_cnt = M;
+  }
+  n = DSP_zoom_scratch(len, it->log2_decim);
+  if(st->zoom_scratch_cnt < n) {
+    st->zoom_scratch = (float *) realloc(st->zoom_scratch, n*sizeof(float));
+    st->zoom_scratch_cnt = n;
+  }
+  DSP_segment_means(mean, iq, len, len, 1);
+  M = DSP_zoom(st->zoomed, st->zoom_scratch, iq, len, mean, it->zoom_shift, it->log2_decim);
+  if(M < span) {
+    for(j=0; j<fft_size; ++j) acc[j] = -100.f;
+    return;
+  }
+  cnt = MIN(it->avg_factor, (M-span)/step+1);
+  
+  // Sum up magnitudes squared of all segments
+  memset(acc, 0, fft_size*sizeof(float));
+  for(j=0; j<cnt; j=j+n) {
+    n = MIN(st->fft_batchlen, cnt-j);
+    for(i=0; i<n; ++i) {
+      DSP_window_samples(st->batch_in[i], st->zoomed+(j+i)*step*2, st->window, fft_size, st->taps);
+      st->batch_out[i] = acc;
     }
-    
-    // Read item from input queue
-    iin = (Item *) QUE_remove(qin);
-    pthread_mutex_unlock(qin->mut);
-    pthread_cond_signal(qin->notFull);
+    FFT_accumulate_n(st->fft_engine, st->batch_in, st->batch_out, n);
+  }
+  
+  // Mean power, scaled by 1/N^2 as in FFT_forward, in dB
+  DSP_db(acc, acc, fft_size, 1.f / ((float) fft_size*fft_size*cnt));
+}
+
+static void fft(Stage *stg, void *state, Item **ins, int cnt) {
+  int i, l;
+  unsigned int log2_fft_size;
+  float *dB_samples;
+  Item *iin;
+  uint64_t t0;
+  
+  FFTCTX *fft_ctx = (FFTCTX *) stg->ctx;
+  FFTState *st = (FFTState *) state;
+  
+  for(l=0; l<cnt; ++l) {
+    // The FFT output is stored in the item
+    iin = ITE_unshare(ins[l]);
     
     // Get item's FFT size
     log2_fft_size = iin->log2_fft_size;
-    fft_size = 1<<log2_fft_size;
-    
-    // I/Q and dB buffers
-    IQ_samples = iin->samples;
-    dB_samples = (float *) malloc(fft_size*sizeof(float));
     
 #if defined(VERBOSE) || defined(VERBOSE_FFT)
     fprintf(stderr, "[FFT ] Pull item. LOG2FFT:\t%u\n", log2_fft_size);
 #endif
     
     // FFT size changes
-    if(prev_log2_fft_size != log2_fft_size) {
+    if(st->prev_log2_fft_size != log2_fft_size) {
       
       // Process remaining jobs from previous FFT size
-      if(batch_cnt > 0) {
-	// Reinitialize FFT resources
-	FFT_release();
-	FFT_initialize(prev_log2_fft_size, batch_cnt);
-	// Perform batched forward FFT
-	FFT_forward(batch_in, batch_out);
+      if(st->batch_cnt > 0) {
+	// Perform partial batch with the plan of the previous FFT size
+	fft_execute(st, st->batch_cnt);
 	// Write items to output queue
-	for(i=0; i<batch_cnt; ++i) {
-	  // Release I/Q samples
-	  free(batch_in[i]);
-	  // Magnitude values require half the I/Q size
-	  its[i]->samples_size /= 2;
-	  // Store dB samples
-	  its[i]->samples = batch_out[i];
-	  // Strategy dependent callback to the monitoring logic
-	  if(fft_ctx != NULL && fft_ctx->callback != NULL)
-	    fft_ctx->callback(its[i]);
-	  
-	  // Single output queue
-	  if(qsout_cnt == 1) {
-	    // Wait for output queue not being full
-	    pthread_mutex_lock(qsout[0]->mut);
-	    while(qsout[0]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-	      fprintf(stderr, "[FFT ] Output queue 0 full.\n");
-#endif
-	      pthread_cond_wait(qsout[0]->notFull, qsout[0]->mut);
-	    }
-	    QUE_insert(qsout[0], its[i]);
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-	    fprintf(stderr, "[FFT ] Push item %u to output queue 0.\n", its[i]->avg_index);
-#endif
-	    pthread_mutex_unlock(qsout[0]->mut);
-	    pthread_cond_signal(qsout[0]->notEmpty);
-	  }
-	  // Multiple output queues
-	  else if(qsout_cnt > 1) {
-	    // Put item to output queues
-	    for(k=0; k<qsout_cnt; ++k) {
-	      // Wait for output queue not being full
-	      pthread_mutex_lock(qsout[k]->mut);
-	      while(qsout[k]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-		fprintf(stderr, "[FFT ] Output queue %zd full.\n", k);
-#endif
-		pthread_cond_wait(qsout[k]->notFull, qsout[k]->mut);
-	      }
-	      nout = ITE_copy(its[i]);
-	      // Write item to output queue
-	      QUE_insert(qsout[k], nout);
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-	      fprintf(stderr, "[FFT ] Push item %u to output queue %zd.\n", nout->avg_index, k);
-#endif
-	      pthread_mutex_unlock(qsout[k]->mut);
-	      pthread_cond_signal(qsout[k]->notEmpty);
-	    }
-	    // Release item
-	    ITE_free(its[i]);
-	  }
-	  
-	}
+	fft_push_batch(stg, st, st->batch_cnt);
 	// Reset batch_cnt
-	batch_cnt = 0;
+	st->batch_cnt = 0;
       }
       
-      // Change FFT size
-      FFT_release();
-      FFT_initialize(log2_fft_size, fft_batchlen);
-      prev_log2_fft_size = log2_fft_size;
+      // Change FFT size, plans are cached and only created on first use
+      FFT_prepare(st->fft_engine, log2_fft_size, st->fft_batchlen);
+      st->prev_log2_fft_size = log2_fft_size;
+      st->fft_size = 1<<log2_fft_size;
+      
+      // Resize staging buffers for windowed I/Q samples
+      for(i=0; i<st->fft_batchlen; ++i)
+	st->batch_in[i] = (float *) realloc(st->batch_in[i], 2*st->fft_size*sizeof(float));
+      st->prev_window_fun_id = -1;
     }
     
+    // dB buffer
+    dB_samples = ITE_pool_samples(iin->pool, st->fft_size*sizeof(float));
+    
+    // Window coefficients
+    if(st->prev_window_fun_id != iin->window_fun_id) {
+      st->window = DSP_window_table(iin->window_fun_id, st->fft_size);
+      st->taps = DSP_window_taps(iin->window_fun_id);
+      st->prev_window_fun_id = iin->window_fun_id;
+    }
+    
+    // Zoom band, the item holds the whole hop
+    if(iin->log2_decim > 0) {
+      // Keep the order of the items
+      if(st->batch_cnt > 0) {
+	fft_execute(st, st->batch_cnt);
+	fft_push_batch(stg, st, st->batch_cnt);
+	st->batch_cnt = 0;
+      }
+      t0 = MET_now();
+      fft_zoom(st, iin, dB_samples);
+      MET_record(st->m_hop, MET_now()-t0);
+      // Write item to output queue
+      st->its[0] = iin;
+      st->batch_out[0] = dB_samples;
+      fft_push_batch(stg, st, 1);
+      continue;
+    }
+    
+    // Welch averaging, the item holds all segments of a hop
+    if(fft_ctx->averaging_id == WELCH_AVERAGING) {
+      t0 = MET_now();
+      fft_welch(st, iin, dB_samples);
+      MET_record(st->m_hop, MET_now()-t0);
+      // Write item to output queue
+      st->its[0] = iin;
+      st->batch_out[0] = dB_samples;
+      fft_push_batch(stg, st, 1);
+      continue;
+    }
+    
+    // Remove DC bias and apply windowing function
+    DSP_window_segment(st->batch_in[st->batch_cnt], (uint8_t *) iin->iq_buf->data + iin->iq_offset,
+		       st->window, st->fft_size, st->taps, iin->iq_mean);
+    
     // Process items in batches
-    its[batch_cnt] = iin;
-    batch_in[batch_cnt] = IQ_samples;
-    batch_out[batch_cnt] = dB_samples;
-    if(++batch_cnt >= fft_batchlen) {
+    st->its[st->batch_cnt] = iin;
+    st->batch_out[st->batch_cnt] = dB_samples;
+    if(++st->batch_cnt >= st->fft_batchlen) {
       // Perform batched forward FFT
-      FFT_forward(batch_in, batch_out);
+      fft_execute(st, st->fft_batchlen);
       // Write items to output queue
-      for(i=0; i<fft_batchlen; ++i) {
-	// Release I/Q samples
-	free(batch_in[i]);
-	// Magnitude values require half the I/Q size
-	its[i]->samples_size /= 2;
-	// Store dB samples
-	its[i]->samples = batch_out[i];
-	// Strategy dependent callback to the monitoring logic
-	if(fft_ctx != NULL && fft_ctx->callback != NULL)
-	  fft_ctx->callback(its[i]);
-	
-	  // Single output queue
-	  if(qsout_cnt == 1) {
-	    // Wait for output queue not being full
-	    pthread_mutex_lock(qsout[0]->mut);
-	    while(qsout[0]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-	      fprintf(stderr, "[FFT ] Output queue 0 full.\n");
-#endif
-	      pthread_cond_wait(qsout[0]->notFull, qsout[0]->mut);
-	    }
-	    QUE_insert(qsout[0], its[i]);
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-	    fprintf(stderr, "[FFT ] Push item %u to output queue 0.\n", its[i]->avg_index);
-#endif
-	    pthread_mutex_unlock(qsout[0]->mut);
-	    pthread_cond_signal(qsout[0]->notEmpty);
-	  }
-	  // Multiple output queues
-	  else if(qsout_cnt > 1) {
-	    // Put item to output queues
-	    for(k=0; k<qsout_cnt; ++k) {
-	      // Wait for output queue not being full
-	      pthread_mutex_lock(qsout[k]->mut);
-	      while(qsout[k]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-		fprintf(stderr, "[FFT ] Output queue %zd full.\n", k);
-#endif
-		pthread_cond_wait(qsout[k]->notFull, qsout[k]->mut);
-	      }
-	      nout = ITE_copy(its[i]);
-	      // Write item to output queue
-	      QUE_insert(qsout[k], nout);
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-	      fprintf(stderr, "[FFT ] Push item %u to output queue %zd.\n", nout->avg_index, k);
-#endif
-	      pthread_mutex_unlock(qsout[k]->mut);
-	      pthread_cond_signal(qsout[k]->notEmpty);
-	    }
-	    // Release item
-	    ITE_free(its[i]);
-	  }
-	
-      }
+      fft_push_batch(stg, st, st->fft_batchlen);
       // Reset batch_cnt
-      batch_cnt = 0;
+      st->batch_cnt = 0;
     }
     
   }
   
-EXIT:
+  // Don't hold a partial batch until more input arrives, later items of the other workers would
+  // wait for it in the reordering stage. It only remains when the queue ran short of a batch or
+  // the items were not aligned to batches.
+  fft_flush(stg, st);
+}
 
-  // Signal that we are done and no further items will appear in the queues
-  for(k=0; k<qsout_cnt; ++k) {
-    pthread_mutex_lock(qsout[k]->mut);
-    qsout[k]->exit = 1;
-    pthread_cond_signal(qsout[k]->notEmpty);
-    pthread_cond_signal(qsout[k]->notFull);
-    pthread_mutex_unlock(qsout[k]->mut);
-  }
+static void fft_flush(Stage *stg, void *state) {
+  FFTState *st = (FFTState *) state;
   
-  free(batch_out);
-  free(batch_in);
-  free(its);
+  // Process remaining jobs in a smaller batch
+  if(st->batch_cnt > 0) {
+    // Perform partial batch with the current plan
+    fft_execute(st, st->batch_cnt);
+    // Write items to output queue
+    fft_push_batch(stg, st, st->batch_cnt);
+    st->batch_cnt = 0;
+  }
+}
+
+static void fft_release(Stage *stg, void *state) {
+  FFTState *st = (FFTState *) state;
+  int i;
   
-#if defined(VERBOSE) || defined(VERBOSE_FFT)
-  fprintf(stderr, "[FFT ] Terminated.\n");
-#endif
+  // Release FFT resources
+  FFT_release(st->fft_engine);
+  
+  for(i=0; i<st->fft_batchlen; ++i) free(st->batch_in[i]);
+  free(st->batch_out);
+  free(st->batch_in);
+  free(st->its);
+  free(st->means);
+  free(st->zoomed);
+  free(st->zoom_scratch);
+  free(st);
+}
+
+static void* reordering_init(Stage *stg) {
+  ReorderingCTX *reor_ctx = (ReorderingCTX *) stg->ctx;
+  ReorderingState *st;
   
-  pthread_exit(NULL);
+  st = (ReorderingState *) malloc(sizeof(ReorderingState));
+  if(st == NULL) {
+    fprintf(stderr, "[REOR] ERROR: Out of memory.\n");
+    exit(1);
+  }
+  st->next_seq = 0;
+  // The FFT workers never get further ahead than the window
+  st->pending_size = reor_ctx->window;
+  st->pending = (Item **) calloc(st->pending_size, sizeof(Item *));
+  if(st->pending == NULL) {
+    fprintf(stderr, "[REOR] ERROR: Out of memory.\n");
+    exit(1);
+  }
   
+  return st;
 }
 
-static void* averaging(void *args) {
-  int i, j;
+static void reordering(Stage *stg, void *state, Item **ins, int cnt) {
+  int l;
+  Item *iin, *iout;
   
-  unsigned int avg_index;
-  unsigned int fft_size;
+  ReorderingCTX *reor_ctx = (ReorderingCTX *) stg->ctx;
+  ReorderingState *st = (ReorderingState *) state;
   
-  AveragingARG *avg_arg;
-  AveragingCTX *avg_ctx;
+  for(l=0; l<cnt; ++l) {
+    iin = ins[l];
+    
+#if defined(VERBOSE) || defined(VERBOSE_REOR)
+    fprintf(stderr, "[REOR] Pull item. SEQ:\t%llu\n", (unsigned long long) iin->seq);
+#endif
+    
+    // Within the window, see fft_push_batch
+    st->pending[iin->seq % st->pending_size] = iin;
+    
+    // Write items to output queue in sequence order
+    while((iout = st->pending[st->next_seq % st->pending_size]) != NULL) {
+      st->pending[st->next_seq % st->pending_size] = NULL;
+      ++st->next_seq;
+      
+      // Strategy dependent callback to the monitoring logic
+      if(reor_ctx->callback != NULL)
+	reor_ctx->callback(iout);
+      
+#if defined(VERBOSE) || defined(VERBOSE_REOR)
+      fprintf(stderr, "[REOR] Push item %u to output queues.\n", iout->avg_index);
+#endif
+      // Write item to output queues, waits while a queue is full
+      STG_push(stg, iout);
+    }
+  }
   
-  size_t k, qsout_cnt;
-  Queue *qin, **qsout;
-  Item  *iin, *iout, *nout;
+  // Let the FFT workers move on
+  pthread_mutex_lock(reor_ctx->mut);
+  if(reor_ctx->next_seq != st->next_seq) {
+    reor_ctx->next_seq = st->next_seq;
+    pthread_cond_broadcast(reor_ctx->advanced);
+  }
+  pthread_mutex_unlock(reor_ctx->mut);
+}
+
+static void reordering_release(Stage *stg, void *state) {
+  ReorderingState *st = (ReorderingState *) state;
+  size_t j;
   
-  // Parse arguments
-  avg_arg = (AveragingARG *) args;
-  avg_ctx = (AveragingCTX *) avg_arg->avg_ctx;
-  qin = (Queue *) avg_arg->qin;
-  qsout = (Queue **) avg_arg->qsout;
-  qsout_cnt = avg_arg->qsout_cnt;
+  // Every item reaches this block, so nothing is left pending unless an item was lost upstream
+  for(j=0; j<st->pending_size; ++j) if(st->pending[j] != NULL) ITE_free(st->pending[j]);
+  free(st->pending);
+  free(st);
+}
+
+static void* averaging_init(Stage *stg) {
+  AveragingState *st;
   
-#if defined(VERBOSE) || defined(VERBOSE_AVG) || defined(TID)
-#if defined(RPI_GPU)
-  fprintf(stderr, "[AVG ] Started.\tTID: %li\n", (long int) syscall(224));
-#else
-  fprintf(stderr, "[AVG ] Started.\n");
-#endif
-#endif
+  st = (AveragingState *) malloc(sizeof(AveragingState));
+  st->iout = NULL;
+  st->avg_index = 0;
+  st->i = 0;
   
-  while(1) {
-    // Wait for input queue not being empty
-    pthread_mutex_lock(qin->mut);
-    while(qin->empty) {
-      // No more input is coming to this queue
-      if(qin->exit) {
-	pthread_mutex_unlock(qin->mut);
-	goto EXIT;
-      }
-      // Wait for more input coming to this queue
-      pthread_cond_wait(qin->notEmpty, qin->mut);
-    }
-    
-    // Read item from input queue
-    iout = (Item *) QUE_remove(qin);
-    pthread_mutex_unlock(qin->mut);
-    pthread_cond_signal(qin->notFull);
-    
-    // Average avg_index items
-    avg_index = iout->avg_index;
-    fft_size = 1<<iout->log2_fft_size;
+  return st;
+}
+
+static void averaging(Stage *stg, void *state, Item **ins, int cnt) {
+  int j, l;
+  unsigned int fft_size;
+  Item *iin;
+  
+  AveragingCTX *avg_ctx = (AveragingCTX *) stg->ctx;
+  AveragingState *st = (AveragingState *) state;
+  
+  for(l=0; l<cnt; ++l) {
     
+    // First item, the average is accumulated in it
+    if(st->iout == NULL) {
+      st->iout = ITE_unshare(ins[l]);
+      st->avg_index = st->iout->avg_index;
+      st->i = 1;
+      fft_size = 1<<st->iout->log2_fft_size;
+      
 #if defined(VERBOSE) || defined(VERBOSE_AVG)
-    fprintf(stderr, "[AVG ] Pull item. IND:\t%u\n", avg_index);
+      fprintf(stderr, "[AVG ] Pull item. IND:\t%u\n", st->avg_index);
 #endif
-    
-    for(j=0; j<fft_size; ++j) iout->samples[j] /= avg_index;
-    
-    for(i=1; i<avg_index; ++i) {
-      // Wait for input queue not being empty
-      pthread_mutex_lock(qin->mut);
-      while(qin->empty) {
-	// No more input is coming to this queue
-	if(qin->exit) {
-	  pthread_mutex_unlock(qin->mut);
-	  goto EXIT;
-	}
-	// Wait for more input coming to this queue
-	pthread_cond_wait(qin->notEmpty, qin->mut);
-      }
       
-      // Read item from input queue
-      iin = (Item *) QUE_remove(qin);
-      pthread_mutex_unlock(qin->mut);
-      pthread_cond_signal(qin->notFull);
+      for(j=0; j<fft_size; ++j) st->iout->samples[j] /= st->avg_index;
+    }
+    // Average avg_index items
+    else {
+      iin = ins[l];
+      fft_size = 1<<st->iout->log2_fft_size;
       
 #if defined(VERBOSE) || defined(VERBOSE_AVG)
       fprintf(stderr, "[AVG ] Pull item. IND:\t%u\n", iin->avg_index);
 #endif
       
       // Assert correct items
-      assert(iin->avg_index == avg_index-i);
+      assert(iin->avg_index == st->avg_index-st->i);
+      
+      for(j=0; j<fft_size; ++j) st->iout->samples[j] += iin->samples[j] / st->avg_index;
+      ++st->i;
       
-      for(j=0; j<fft_size; ++j) iout->samples[j] += iin->samples[j] / avg_index;
-
       // Release input item
       ITE_free(iin);
-      
     }
     
+    if(st->i < st->avg_index) continue;
+    
     // Strategy dependent callback to the monitoring logic
     if(avg_ctx != NULL && avg_ctx->callback != NULL)
-      avg_ctx->callback(iout);
-
-    // Single output queue
-    if(qsout_cnt == 1) {
-      // Wait for output queue not being full
-      pthread_mutex_lock(qsout[0]->mut);
-      while(qsout[0]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_AVG)
-	fprintf(stderr, "[AVG ] Output queue 0 full.\n");
-#endif
-	pthread_cond_wait(qsout[0]->notFull, qsout[0]->mut);
-      }
-      QUE_insert(qsout[0], iout);
-#if defined(VERBOSE) || defined(VERBOSE_AVG)
-      fprintf(stderr, "[AVG ] Push item %u to output queue 0.\n", iout->avg_index);
-#endif
-      pthread_mutex_unlock(qsout[0]->mut);
-      pthread_cond_signal(qsout[0]->notEmpty);
-    }
-    // Multiple output queues
-    else if(qsout_cnt > 1) {
-      // Put item to output queues
-      for(k=0; k<qsout_cnt; ++k) {
-	// Wait for output queue not being full
-	pthread_mutex_lock(qsout[k]->mut);
-	while(qsout[k]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_AVG)
-	  fprintf(stderr, "[AVG ] Output queue %zd full.\n", k);
-#endif
-	  pthread_cond_wait(qsout[k]->notFull, qsout[k]->mut);
-	}
-	nout = ITE_copy(iout);
-	// Write item to output queue
-	QUE_insert(qsout[k], nout);
+      avg_ctx->callback(st->iout);
+    
 #if defined(VERBOSE) || defined(VERBOSE_AVG)
-	fprintf(stderr, "[AVG ] Push item %u to output queue %zd.\n", nout->avg_index, k);
+    fprintf(stderr, "[AVG ] Push item %u to output queues.\n", st->iout->avg_index);
 #endif
-	pthread_mutex_unlock(qsout[k]->mut);
-	pthread_cond_signal(qsout[k]->notEmpty);
-      }
-      // Release item
-      ITE_free(iout);
-    }
-    
+    // Write item to output queues, waits while a queue is full
+    STG_push(stg, st->iout);
+    st->iout = NULL;
   }
-  
-EXIT:
+}
 
-  // Signal that we are done and no further items will appear in the queues
-  for(k=0; k<qsout_cnt; ++k) {
-    pthread_mutex_lock(qsout[k]->mut);
-    qsout[k]->exit = 1;
-    pthread_cond_signal(qsout[k]->notEmpty);
-    pthread_cond_signal(qsout[k]->notFull);
-    pthread_mutex_unlock(qsout[k]->mut);
-  }
+static void averaging_release(Stage *stg, void *state) {
+  AveragingState *st = (AveragingState *) state;
   
-#if defined(VERBOSE) || defined(VERBOSE_AVG)
-  fprintf(stderr, "[AVG ] Terminated.\n");
-#endif
+  // Incomplete average
+  if(st->iout != NULL) ITE_free(st->iout);
+  free(st);
+}
+
+static void* compression_init(Stage *stg) {
+  CompressionState *st;
   
-  pthread_exit(NULL);
+  st = (CompressionState *) malloc(sizeof(CompressionState));
+  st->prev_reduced_fft_size = 0;
+  st->src_len = 0;
+  st->src_buf = NULL;
+  st->m_time = MET_histogram("cmpr_ns");
+  st->m_ratio = MET_histogram("cmpr_ratio_permille");
+  st->m_bytes_in = MET_counter("cmpr_bytes_in");
+  st->m_bytes_out = MET_counter("cmpr_bytes_out");
   
+  return st;
 }
 
-static void* compression(void *args) {
-  int r, i, l;
-
+static void compression(Stage *stg, void *state, Item **ins, int cnt) {
+  int r, i, l, m;
+  
   unsigned int cmpr_level;
-  uint32_t fft_size, prev_reduced_fft_size = 0, reduced_fft_size;
+  uint32_t fft_size, reduced_fft_size;
   float freq_res, s, *samples;
-  size_t src_len = 0, tgt_len;
-  uint32_t *src_buf = NULL, *tgt_buf;
-  
-  CompressionARG *cmpr_arg;
-  CompressionCTX *cmpr_ctx;
+  size_t tgt_len;
+  uint32_t *tgt_buf;
+  Item *iin, *iout;
+  uint64_t t0;
   
-  size_t k, qsout_cnt;
-  Queue *qin, **qsout;
-  Item  *iin, *iout, *nout;
-  
-#if defined(MEASURE_CMPR)
-  struct timespec tstart = {0,0}, tend = {0,0};
-  FILE *f_stat_cmpr_time = fopen("dat/stats/f_stat_cmpr_time.dat", "w");
-  FILE *f_stat_cmpr_rat = fopen("dat/stats/f_stat_cmpr_rat.dat", "w");
-#endif
-  
-  // Parse arguments
-  cmpr_arg = (CompressionARG *) args;
-  cmpr_ctx = (CompressionCTX *) cmpr_arg->cmpr_ctx;
-  qin = (Queue *) cmpr_arg->qin;
-  qsout = (Queue **) cmpr_arg->qsout;
-  qsout_cnt = cmpr_arg->qsout_cnt;
+  CompressionCTX *cmpr_ctx = (CompressionCTX *) stg->ctx;
+  CompressionState *st = (CompressionState *) state;
   
-#if defined(VERBOSE) || defined(VERBOSE_CMPR) || defined(TID)
-#if defined(RPI_GPU)
-  fprintf(stderr, "[CMPR] Started.\tTID: %li\n", (long int) syscall(224));
-#else
-  fprintf(stderr, "[CMPR] Started.\n");
-#endif
-#endif
-  
-  while(1) {
-    // Wait for input queue not being empty
-    pthread_mutex_lock(qin->mut);
-    while(qin->empty) {
-      // No more input is coming to this queue
-      if(qin->exit) {
-	pthread_mutex_unlock(qin->mut);
-	goto EXIT;
-      }
-      // Wait for more input coming to this queue
-      pthread_cond_wait(qin->notEmpty, qin->mut);
-    }
-    
-    // Read item from input queue
-    iin = (Item *) QUE_remove(qin);
-    pthread_mutex_unlock(qin->mut);
-    pthread_cond_signal(qin->notFull);
+  for(m=0; m<cnt; ++m) {
+    // The compressed data is stored in the item
+    iin = ITE_unshare(ins[m]);
     
 #if defined(VERBOSE) || defined(VERBOSE_CMPR)
     fprintf(stderr, "[CMPR] Pull item.\n");
@@ -2514,35 +3072,34 @@ static void* compression(void *args) {
     samples = iin->samples;
     
     // Check for changing FFT sizes
-    if(reduced_fft_size != prev_reduced_fft_size) {
-      src_len = (4 + reduced_fft_size) * sizeof(uint32_t);
-      src_buf = (uint32_t *) realloc(src_buf, src_len);
-      prev_reduced_fft_size = reduced_fft_size;
+    if(reduced_fft_size != st->prev_reduced_fft_size) {
+      st->src_len = (4 + reduced_fft_size) * sizeof(uint32_t);
+      st->src_buf = (uint32_t *) realloc(st->src_buf, st->src_len);
+      st->prev_reduced_fft_size = reduced_fft_size;
     }
     
     // Marshalling data
-    src_buf[0] = htonl(iin->Fc);		// Center frequency in Hz
-    src_buf[1] = htonl(iin->Ts_sec);		// Seconds since UNIX epoch
-    src_buf[2] = htonl(iin->Ts_usec);		// Time stamp microseconds
-    src_buf[3] = htonl(pack754_32(freq_res));	// Frequency resolution in Hz
+    st->src_buf[0] = htonl(iin->Fc);			// Center frequency in Hz
+    st->src_buf[1] = htonl(iin->Ts_sec);		// Seconds since UNIX epoch
+    st->src_buf[2] = htonl(iin->Ts_usec);		// Time stamp microseconds
+    st->src_buf[3] = htonl(pack754_32(freq_res));	// Frequency resolution in Hz
     // Quantization and FFT reduction
     l = (fft_size - reduced_fft_size) / 2;
     for(i=0; i<reduced_fft_size; ++i) {
       s = roundf(samples[l+i]*10.0f) / 10.0f;
-      src_buf[4+i] = htonl(pack754_32(s));
+      st->src_buf[4+i] = htonl(pack754_32(s));
     }
     
     // Compress data
-    tgt_len = compressBound(src_len);
+    tgt_len = compressBound(st->src_len);
     tgt_buf = (uint32_t *) malloc(tgt_len);
-#if defined(MEASURE_CMPR)
-    TICK(tstart);
-#endif
+    t0 = MET_now();
     r = compress2((Bytef *) tgt_buf, (uLongf *) &tgt_len,
-		  (Bytef *) src_buf, (uLong) src_len, cmpr_level);
-#if defined(MEASURE_CMPR)
-    TACK(tstart, tend, f_stat_cmpr_time);
-#endif
+		  (Bytef *) st->src_buf, (uLong) st->src_len, cmpr_level);
+    MET_record(st->m_time, MET_now()-t0);
+    MET_record(st->m_ratio, tgt_len*1000 / st->src_len);
+    MET_add(st->m_bytes_in, st->src_len);
+    MET_add(st->m_bytes_out, tgt_len);
     
     // Error handling
     if(r != Z_OK) {
@@ -2568,155 +3125,69 @@ static void* compression(void *args) {
     if(cmpr_ctx != NULL && cmpr_ctx->callback != NULL)
       cmpr_ctx->callback(iout);
     
-    // Single output queue
-    if(qsout_cnt == 1) {
-      // Wait for output queue not being full
-      pthread_mutex_lock(qsout[0]->mut);
-      while(qsout[0]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_CMPR)
-	fprintf(stderr, "[CMPR] Output queue 0 full.\n");
-#endif
-	pthread_cond_wait(qsout[0]->notFull, qsout[0]->mut);
-      }
-      QUE_insert(qsout[0], iout);
-#if defined(VERBOSE) || defined(VERBOSE_CMPR)
-      fprintf(stderr, "[CMPR] Push item %u to output queue 0.\n", iout->avg_index);
-#endif
-      pthread_mutex_unlock(qsout[0]->mut);
-      pthread_cond_signal(qsout[0]->notEmpty);
-    }
-    // Multiple output queues
-    else if(qsout_cnt > 1) {
-      // Put item to output queues
-      for(k=0; k<qsout_cnt; ++k) {
-	// Wait for output queue not being full
-	pthread_mutex_lock(qsout[k]->mut);
-	while(qsout[k]->full) {
-#if defined(VERBOSE) || defined(VERBOSE_CMPR)
-	  fprintf(stderr, "[CMPR] Output queue %zd full.\n", k);
-#endif
-	  pthread_cond_wait(qsout[k]->notFull, qsout[k]->mut);
-	}
-	nout = ITE_copy(iout);
-	// Write item to output queue
-	QUE_insert(qsout[k], nout);
 #if defined(VERBOSE) || defined(VERBOSE_CMPR)
-	fprintf(stderr, "[CMPR] Push item %u to output queue %zd.\n", nout->avg_index, k);
-#endif
-	pthread_mutex_unlock(qsout[k]->mut);
-	pthread_cond_signal(qsout[k]->notEmpty);
-      }
-      // Release item
-      ITE_free(iout);
-    }
-    
-#if defined(MEASURE_CMPR)
-    // Compression ratio
-    float cmpr_rat = (1.0f - ((float) tgt_len / src_len))*100.f;
-    fprintf(f_stat_cmpr_rat, "%f\n", cmpr_rat);
+    fprintf(stderr, "[CMPR] Push item %u to output queues.\n", iout->avg_index);
 #endif
+    // Write item to output queues, waits while a queue is full
+    STG_push(stg, iout);
   }
-  
-EXIT:
+}
 
-  // Signal that we are done and no further items will appear in the queues
-  for(k=0; k<qsout_cnt; ++k) {
-    pthread_mutex_lock(qsout[k]->mut);
-    qsout[k]->exit = 1;
-    pthread_cond_signal(qsout[k]->notEmpty);
-    pthread_cond_signal(qsout[k]->notFull);
-    pthread_mutex_unlock(qsout[k]->mut);
-  }
-  
-#if defined(MEASURE_CMPR)
-  fclose(f_stat_cmpr_time);
-  fclose(f_stat_cmpr_rat);
-#endif
-  
-  free(src_buf);
-  
-#if defined(VERBOSE) || defined(VERBOSE_CMPR)
-  fprintf(stderr, "[CMPR] Terminated.\n");
-#endif
-  
-  pthread_exit(NULL);
+static void compression_release(Stage *stg, void *state) {
+  CompressionState *st = (CompressionState *) state;
   
+  free(st->src_buf);
+  free(st);
 }
 
-static void* tcp_transmission(void *args) {
-  int                     i;
-  size_t                  tcp_hosts_cnt;
-  char                    **tcp_hosts = NULL;
-  uint32_t                *tcp_ports = NULL;
-  int                     *tcp_bandwidths = NULL;
-  TCP_Connection          **tcp_con = NULL;
-
-  uint32_t                *buf = NULL;
-  uint32_t                log2_fft_size, fft_size, reduced_fft_size;
-  uint32_t                prev_data_size = 0, data_size, payload_size, packet_size = 0;
-  float                   freq_overlap;
-  
-  int                     bytes_sent = 0;
-  UTI_BandwidthController **bcs = NULL;
-  
-  Queue                   *qin;
-  Item                    *iin;
+static void* tcp_transmission_init(Stage *stg) {
+  int i;
+  TcpTransmissionCTX *tcp_trns_ctx = (TcpTransmissionCTX *) stg->ctx;
+  TcpTransmissionState *st;
   
-  TcpTransmissionARG      *tcp_trns_arg;
-  TcpTransmissionCTX      *tcp_trns_ctx;
-  
-  // Parse arguments
-  tcp_trns_arg = (TcpTransmissionARG *) args;
-  tcp_trns_ctx = (TcpTransmissionCTX *) tcp_trns_arg->tcp_trns_ctx;
-  qin = (Queue *) tcp_trns_arg->qin;
-  tcp_hosts_cnt = tcp_trns_ctx->tcp_hosts_cnt;
-  tcp_hosts = tcp_trns_ctx->tcp_hosts;
-  tcp_ports = tcp_trns_ctx->tcp_ports;
-  tcp_bandwidths = tcp_trns_ctx->tcp_bandwidths;
-
-#if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS) || defined(TID)
-#if defined(RPI_GPU)
-  fprintf(stderr, "[TTRS] Started.\tTID: %li\n", (long int) syscall(224));
-#else
-  fprintf(stderr, "[TTRS] Started.\n");
-#endif
-#endif
+  st = (TcpTransmissionState *) malloc(sizeof(TcpTransmissionState));
+  st->buf = NULL;
+  st->prev_data_size = 0;
+  st->packet_size = 0;
+  st->bytes_sent = 0;
+  st->m_send = MET_histogram("ttrs_send_ns");
+  st->m_bytes = MET_counter("ttrs_bytes");
   
   // Initialize TCP connections
-  tcp_con = (TCP_Connection **) malloc(tcp_hosts_cnt*sizeof(TCP_Connection *));
-  for(i=0; i<tcp_hosts_cnt; ++i) {
+  st->tcp_con = (TCP_Connection **) malloc(tcp_trns_ctx->tcp_hosts_cnt*sizeof(TCP_Connection *));
+  for(i=0; i<tcp_trns_ctx->tcp_hosts_cnt; ++i) {
 #if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS)
-    tcp_init_p(&tcp_con[i], tcp_hosts[i], tcp_ports[i]);
-    while(tcp_connect_p(tcp_con[i]) < 0) {sleep(1);}
+    tcp_init_p(&st->tcp_con[i], tcp_trns_ctx->tcp_hosts[i], tcp_trns_ctx->tcp_ports[i]);
+    while(tcp_connect_p(st->tcp_con[i]) < 0) {sleep(1);}
 #else
-    tcp_init(&tcp_con[i], tcp_hosts[i], tcp_ports[i]);
-    while(tcp_connect(tcp_con[i]) < 0) {sleep(1);}
+    tcp_init(&st->tcp_con[i], tcp_trns_ctx->tcp_hosts[i], tcp_trns_ctx->tcp_ports[i]);
+    while(tcp_connect(st->tcp_con[i]) < 0) {sleep(1);}
 #endif
   }
   
   // Initialize bandwidth controllers
-  bcs = (UTI_BandwidthController **) malloc(tcp_hosts_cnt * sizeof(UTI_BandwidthController *));
-  for(i=0; i<tcp_hosts_cnt; ++i) {
-    bcs[i] = UTI_initialize_bandwidth_controller(tcp_bandwidths[i]);
+  st->bcs = (UTI_BandwidthController **)
+    malloc(tcp_trns_ctx->tcp_hosts_cnt * sizeof(UTI_BandwidthController *));
+  for(i=0; i<tcp_trns_ctx->tcp_hosts_cnt; ++i) {
+    st->bcs[i] = UTI_initialize_bandwidth_controller(tcp_trns_ctx->tcp_bandwidths[i]);
   }
+  
+  return st;
+}
 
-  while(1) {
-    // Wait for input queue not being empty
-    pthread_mutex_lock(qin->mut);
-    while(qin->empty) {
-      // No more input is coming to this queue
-      if(qin->exit) {
-	pthread_mutex_unlock(qin->mut);
-	goto EXIT;
-      }
-      // Wait for more input coming to this queue
-      pthread_cond_wait(qin->notEmpty, qin->mut);
-    }
-   
-    // Read item from input queue
-    iin = (Item *) QUE_remove(qin);
-    pthread_mutex_unlock(qin->mut);
-    pthread_cond_signal(qin->notFull);
+static void tcp_transmission(Stage *stg, void *state, Item **ins, int cnt) {
+  int i, l;
+  uint32_t log2_fft_size, fft_size, reduced_fft_size;
+  uint32_t data_size, payload_size;
+  float freq_overlap;
+  Item *iin;
+  uint64_t t0;
+  
+  TcpTransmissionCTX *tcp_trns_ctx = (TcpTransmissionCTX *) stg->ctx;
+  TcpTransmissionState *st = (TcpTransmissionState *) state;
+  
+  for(l=0; l<cnt; ++l) {
+    iin = ins[l];
     
 #if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS)
     fprintf(stderr, "[TTRS] Pull item.\n");
@@ -2730,87 +3201,86 @@ static void* tcp_transmission(void *args) {
     data_size = iin->data_size;
     
     // Check for changing data sizes
-    if(data_size != prev_data_size) {
+    if(data_size != st->prev_data_size) {
       // The payload consists of the compressed data plus some padding, guaranteeing the packet size
       // to be a multiple of 4
       payload_size = (data_size + 3) & ~0x03;
-      packet_size = 2*sizeof(uint32_t) + payload_size;
-      buf = (uint32_t *) realloc(buf, packet_size);
-      memset(buf, 0, packet_size);
-      prev_data_size = data_size;
+      st->packet_size = 2*sizeof(uint32_t) + payload_size;
+      st->buf = (uint32_t *) realloc(st->buf, st->packet_size);
+      memset(st->buf, 0, st->packet_size);
+      st->prev_data_size = data_size;
     }
     
     // Packing
-    buf[0] = htonl(data_size);			// Data size
-    buf[1] = htonl(reduced_fft_size);		// Reduced FFT Size
-    memcpy(buf+2, iin->data, data_size);	// Compressed data
+    st->buf[0] = htonl(data_size);		// Data size
+    st->buf[1] = htonl(reduced_fft_size);	// Reduced FFT Size
+    memcpy(st->buf+2, iin->data, data_size);	// Compressed data
     
     // Send item over TCP
-    for(i=0; i<tcp_hosts_cnt; ++i) {
+    for(i=0; i<tcp_trns_ctx->tcp_hosts_cnt; ++i) {
+      t0 = MET_now();
       
       // Enforce bandwidth throttling
-      UTI_enforce_bandwidth_throttling(bcs[i], bytes_sent);
+      UTI_enforce_bandwidth_throttling(st->bcs[i], st->bytes_sent);
       
 #if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS)
-      tcp_write_p(tcp_con[i], buf, packet_size);
+      tcp_write_p(st->tcp_con[i], st->buf, st->packet_size);
 #else
-      tcp_write(tcp_con[i], buf, packet_size);
+      tcp_write(st->tcp_con[i], st->buf, st->packet_size);
 #endif
+      MET_record(st->m_send, MET_now()-t0);
+      MET_add(st->m_bytes, st->packet_size);
     }
     
     // Bytes sent
-    bytes_sent = packet_size;
+    st->bytes_sent = st->packet_size;
     
     // Strategy dependent callback to the monitoring logic
     if(tcp_trns_ctx != NULL && tcp_trns_ctx->callback != NULL)
       tcp_trns_ctx->callback(iin);
-
-    // Release item
-    ITE_free(iin);
     
 #if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS)
     fprintf(stderr, "[TTRS] Push item.\n");
 #endif
-    
+    // Write item to output queues, released without output queue
+    STG_push(stg, iin);
   }
-  
-  EXIT:
+}
 
+static void tcp_transmission_release(Stage *stg, void *state) {
+  int i;
+  TcpTransmissionCTX *tcp_trns_ctx = (TcpTransmissionCTX *) stg->ctx;
+  TcpTransmissionState *st = (TcpTransmissionState *) state;
+  
   // Release bandwidth controllers
-  for(i=0; i<tcp_hosts_cnt; ++i) {
-    UTI_release_bandwidth_controller(bcs[i]);
+  for(i=0; i<tcp_trns_ctx->tcp_hosts_cnt; ++i) {
+    UTI_release_bandwidth_controller(st->bcs[i]);
   }
-  free(bcs);
+  free(st->bcs);
   
   // Signal that we are done and no further items will appear in the queue
-  if(buf == NULL) buf = (uint32_t *) malloc(sizeof(uint32_t));
-  buf[0] = htonl(0);
-  for(i=0; i<tcp_hosts_cnt; ++i) {
+  if(st->buf == NULL) st->buf = (uint32_t *) malloc(sizeof(uint32_t));
+  st->buf[0] = htonl(0);
+  for(i=0; i<tcp_trns_ctx->tcp_hosts_cnt; ++i) {
 #if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS)
-    tcp_write_p(tcp_con[i], buf, sizeof(uint32_t));
+    tcp_write_p(st->tcp_con[i], st->buf, sizeof(uint32_t));
 #else
-    tcp_write(tcp_con[i], buf, sizeof(uint32_t));
+    tcp_write(st->tcp_con[i], st->buf, sizeof(uint32_t));
 #endif
   }
   
   // Release TCP connections
-  for(i=0; i<tcp_hosts_cnt; ++i) {
+  for(i=0; i<tcp_trns_ctx->tcp_hosts_cnt; ++i) {
 #if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS)
-    tcp_disconnect_p(tcp_con[i]);
-    tcp_release_p(tcp_con[i]);
+    tcp_disconnect_p(st->tcp_con[i]);
+    tcp_release_p(st->tcp_con[i]);
 #else
-    tcp_disconnect(tcp_con[i]);
-    tcp_release(tcp_con[i]);
+    tcp_disconnect(st->tcp_con[i]);
+    tcp_release(st->tcp_con[i]);
 #endif
   }
-  free(tcp_con);
-  
-  free(buf);
-  
-#if defined(VERBOSE) || defined(VERBOSE_TCP_TRNS)
-  fprintf(stderr, "[TTRS] Terminated.\n");
-#endif
-  
-  pthread_exit(NULL);
+  free(st->tcp_con);
   
+  free(st->buf);
+  free(st);
 }
\ No newline at end of file